@@ -0,0 +1,161 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/util.h"
+#include "arena.h"
+
+/*
+ * Bump allocator for everything the boot manager allocates while scanning
+ * for entries. Memory is taken from the firmware in page-sized chunks and
+ * only returned all at once.
+ */
+#define ARENA_CHUNK_PAGES       16
+
+struct ArenaChunk {
+        ArenaChunk *next;
+        UINTN n_pages;
+};
+
+struct ArenaString {
+        ArenaString *next;
+        CHAR16 str[];
+};
+
+static UINTN align8(UINTN n) {
+        return (n + 7) & ~7;
+}
+
+static EFI_STATUS arena_grow(Arena *arena, UINTN size) {
+        ArenaChunk *chunk;
+        EFI_PHYSICAL_ADDRESS addr;
+        UINTN n_pages;
+        EFI_STATUS r;
+
+        n_pages = EFI_SIZE_TO_PAGES(align8(sizeof(ArenaChunk)) + size);
+        if (n_pages < ARENA_CHUNK_PAGES)
+                n_pages = ARENA_CHUNK_PAGES;
+
+        r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, n_pages, &addr);
+        if (EFI_ERROR(r))
+                return r;
+
+        chunk = (ArenaChunk *)(UINTN)addr;
+        chunk->next = arena->chunks;
+        chunk->n_pages = n_pages;
+        arena->chunks = chunk;
+        arena->pos = (UINT8 *)chunk + align8(sizeof(ArenaChunk));
+        arena->end = (UINT8 *)chunk + n_pages * EFI_PAGE_SIZE;
+
+        return EFI_SUCCESS;
+}
+
+VOID *arena_alloc(Arena *arena, UINTN size) {
+        VOID *p;
+
+        size = align8(size);
+        if ((UINTN)(arena->end - arena->pos) < size)
+                if (EFI_ERROR(arena_grow(arena, size)))
+                        return NULL;
+
+        p = arena->pos;
+        arena->pos += size;
+        arena->last = p;
+
+        return p;
+}
+
+VOID *arena_alloc0(Arena *arena, UINTN size) {
+        VOID *p;
+
+        p = arena_alloc(arena, size);
+        if (p)
+                ZeroMem(p, size);
+
+        return p;
+}
+
+VOID *arena_realloc(Arena *arena, VOID *p, UINTN old_size, UINTN new_size) {
+        VOID *n;
+
+        if (!p)
+                return arena_alloc(arena, new_size);
+
+        /* the most recent allocation can grow in place */
+        if (p == arena->last && (UINTN)(arena->end - (UINT8 *)p) >= align8(new_size)) {
+                arena->pos = (UINT8 *)p + align8(new_size);
+                return p;
+        }
+
+        n = arena_alloc(arena, new_size);
+        if (n)
+                CopyMem(n, p, old_size < new_size ? old_size : new_size);
+
+        return n;
+}
+
+CHAR16 *arena_strdup(Arena *arena, const CHAR16 *s) {
+        CHAR16 *p;
+        UINTN size;
+
+        size = (StrLen(s) + 1) * sizeof(CHAR16);
+        p = arena_alloc(arena, size);
+        if (p)
+                CopyMem(p, s, size);
+
+        return p;
+}
+
+/* Return a shared copy of a string which is likely to appear many times. */
+CHAR16 *arena_intern(Arena *arena, const CHAR16 *s) {
+        ArenaString *string;
+        UINTN hash = 5381;
+        UINTN size;
+
+        for (const CHAR16 *c = s; *c; c++)
+                hash = hash * 33 + *c;
+        hash %= C_ARRAY_SIZE(arena->strings);
+
+        for (string = arena->strings[hash]; string; string = string->next)
+                if (StrCmp(string->str, s) == 0)
+                        return string->str;
+
+        size = (StrLen(s) + 1) * sizeof(CHAR16);
+        string = arena_alloc(arena, sizeof(ArenaString) + size);
+        if (!string)
+                return NULL;
+
+        CopyMem(string->str, s, size);
+        string->next = arena->strings[hash];
+        arena->strings[hash] = string;
+
+        return string->str;
+}
+
+VOID arena_free(Arena *arena) {
+        while (arena->chunks) {
+                ArenaChunk *chunk = arena->chunks;
+
+                arena->chunks = chunk->next;
+                uefi_call_wrapper(BS->FreePages, 2, (EFI_PHYSICAL_ADDRESS)(UINTN)chunk, chunk->n_pages);
+        }
+
+        ZeroMem(arena, sizeof(Arena));
+}
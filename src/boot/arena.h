@@ -0,0 +1,35 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+typedef struct ArenaChunk ArenaChunk;
+typedef struct ArenaString ArenaString;
+
+typedef struct {
+        ArenaChunk *chunks;
+        UINT8 *pos;
+        UINT8 *end;
+        VOID *last;
+        ArenaString *strings[64];
+} Arena;
+
+VOID *arena_alloc(Arena *arena, UINTN size);
+VOID *arena_alloc0(Arena *arena, UINTN size);
+VOID *arena_realloc(Arena *arena, VOID *p, UINTN old_size, UINTN new_size);
+CHAR16 *arena_strdup(Arena *arena, const CHAR16 *s);
+CHAR16 *arena_intern(Arena *arena, const CHAR16 *s);
+VOID arena_free(Arena *arena);
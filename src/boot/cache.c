@@ -0,0 +1,328 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/util.h"
+#include "cache.h"
+
+/*
+ * The boot manager remembers what it found in the images of the org.bus1
+ * directory, keyed by the directory record of every file. Images which did
+ * not change since the last boot are not opened or parsed again; images which
+ * were rejected are remembered as well.
+ */
+#define CACHE_FILE              L".cache"
+#define CACHE_MAGIC             "bus1ecch"
+#define CACHE_VERSION           1
+#define CACHE_SIZE_MAX          (4 * 1024 * 1024)
+
+enum {
+        CACHE_RECORD_INVALID    = 1ULL <<  0,
+};
+
+typedef struct {
+        UINT8 magic[8];
+        UINT32 version;
+        UINT32 crc32;
+        UINT32 n_records;
+        UINT32 size;
+} CacheHeader;
+
+typedef struct {
+        UINT32 record_size;
+        UINT32 flags;
+        UINT64 file_size;
+        EFI_TIME create_time;
+        EFI_TIME modification_time;
+        INT32 boot_count;
+        UINT16 name_len;
+        UINT16 release_len;
+        UINT32 options_len;
+        UINT32 reserved;
+        /* followed by the NUL-terminated name, release and options strings */
+} CacheRecord;
+
+static UINTN align8(UINTN n) {
+        return (n + 7) & ~7;
+}
+
+static BOOLEAN time_equal(EFI_TIME *a, EFI_TIME *b) {
+        return a->Year == b->Year && a->Month == b->Month && a->Day == b->Day &&
+               a->Hour == b->Hour && a->Minute == b->Minute && a->Second == b->Second &&
+               a->Nanosecond == b->Nanosecond;
+}
+
+static CHAR16 *record_name(CacheRecord *rec) {
+        return (CHAR16 *)(rec + 1);
+}
+
+static CHAR16 *record_release(CacheRecord *rec) {
+        return record_name(rec) + rec->name_len + 1;
+}
+
+static CHAR16 *record_options(CacheRecord *rec) {
+        return record_release(rec) + rec->release_len + 1;
+}
+
+static BOOLEAN record_valid(UINT8 *buf, UINTN size, UINTN pos) {
+        CacheRecord *rec;
+        UINTN len;
+
+        if (size - pos < sizeof(CacheRecord))
+                return FALSE;
+
+        rec = (CacheRecord *)(buf + pos);
+        if (rec->record_size < sizeof(CacheRecord) || rec->record_size > size - pos || rec->record_size & 7)
+                return FALSE;
+
+        len = sizeof(CacheRecord) + ((UINTN)rec->name_len + rec->release_len + rec->options_len + 3) * sizeof(CHAR16);
+        if (len > rec->record_size)
+                return FALSE;
+
+        if (record_name(rec)[rec->name_len] != '\0' ||
+            record_release(rec)[rec->release_len] != '\0' ||
+            record_options(rec)[rec->options_len] != '\0')
+                return FALSE;
+
+        return TRUE;
+}
+
+EFI_STATUS entry_cache_load(EntryCache *cache, EFI_FILE_HANDLE dir) {
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE handle = NULL;
+        _c_cleanup_(CFreePoolP) UINT8 *buf = NULL;
+        EFI_FILE_INFO *info;
+        CacheHeader *header;
+        UINTN size;
+        UINTN n;
+        UINT32 crc;
+        EFI_STATUS r;
+
+        ZeroMem(cache, sizeof(EntryCache));
+        cache->out_size = sizeof(CacheHeader);
+
+        r = uefi_call_wrapper(dir->Open, 5, dir, &handle, CACHE_FILE, EFI_FILE_MODE_READ, 0ULL);
+        if (EFI_ERROR(r))
+                return r;
+
+        info = LibFileInfo(handle);
+        if (!info)
+                return EFI_LOAD_ERROR;
+        size = info->FileSize;
+        FreePool(info);
+
+        if (size < sizeof(CacheHeader) || size > CACHE_SIZE_MAX)
+                return EFI_INVALID_PARAMETER;
+
+        buf = AllocatePool(size);
+        if (!buf)
+                return EFI_OUT_OF_RESOURCES;
+
+        n = size;
+        r = uefi_call_wrapper(handle->Read, 3, handle, &n, buf);
+        if (EFI_ERROR(r))
+                return r;
+        if (n != size)
+                return EFI_INVALID_PARAMETER;
+
+        header = (CacheHeader *)buf;
+        if (CompareMem(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != CACHE_VERSION ||
+            header->size != size - sizeof(CacheHeader))
+                return EFI_INVALID_PARAMETER;
+
+        r = uefi_call_wrapper(BS->CalculateCrc32, 3, buf + sizeof(CacheHeader), header->size, &crc);
+        if (EFI_ERROR(r))
+                return r;
+        if (crc != header->crc32)
+                return EFI_CRC_ERROR;
+
+        /* validate all records once, lookups can trust them afterwards */
+        n = 0;
+        for (UINTN pos = sizeof(CacheHeader); pos < size; pos += ((CacheRecord *)(buf + pos))->record_size) {
+                if (!record_valid(buf, size, pos))
+                        return EFI_INVALID_PARAMETER;
+                n++;
+        }
+        if (n != header->n_records)
+                return EFI_INVALID_PARAMETER;
+
+        cache->buf = buf;
+        cache->size = size;
+        cache->pos = sizeof(CacheHeader);
+        cache->n_records = n;
+        buf = NULL;
+
+        return EFI_SUCCESS;
+}
+
+static BOOLEAN record_match(CacheRecord *rec, EFI_FILE_INFO *info) {
+        return rec->file_size == info->FileSize &&
+               time_equal(&rec->modification_time, &info->ModificationTime) &&
+               time_equal(&rec->create_time, &info->CreateTime) &&
+               StrCmp(record_name(rec), info->FileName) == 0;
+}
+
+BOOLEAN entry_cache_lookup(EntryCache *cache, EFI_FILE_INFO *info,
+                           CHAR16 **release, CHAR16 **options, INTN *boot_count) {
+        CacheRecord *rec = NULL;
+        UINTN pos;
+
+        if (!cache->buf) {
+                cache->dirty = TRUE;
+                return FALSE;
+        }
+
+        /* The directory is usually enumerated in the same order as last time. */
+        pos = cache->pos;
+        for (UINTN i = 0; i < cache->n_records; i++) {
+                if (pos >= cache->size)
+                        pos = sizeof(CacheHeader);
+
+                if (record_match((CacheRecord *)(cache->buf + pos), info)) {
+                        rec = (CacheRecord *)(cache->buf + pos);
+                        cache->pos = pos + rec->record_size;
+                        break;
+                }
+
+                pos += ((CacheRecord *)(cache->buf + pos))->record_size;
+        }
+
+        if (!rec) {
+                cache->dirty = TRUE;
+                return FALSE;
+        }
+
+        if (rec->flags & CACHE_RECORD_INVALID) {
+                *release = NULL;
+                *options = NULL;
+        } else {
+                *release = record_release(rec);
+                *options = rec->options_len > 0 ? record_options(rec) : NULL;
+        }
+        *boot_count = rec->boot_count;
+
+        return TRUE;
+}
+
+VOID entry_cache_add(EntryCache *cache, EFI_FILE_INFO *info,
+                     CHAR16 *release, CHAR16 *options, INTN boot_count) {
+        CacheRecord *rec;
+        UINTN name_len;
+        UINTN release_len;
+        UINTN options_len;
+        UINTN size;
+
+        name_len = StrLen(info->FileName);
+        release_len = release ? StrLen(release) : 0;
+        options_len = options ? StrLen(options) : 0;
+        if (name_len > 0xffff || release_len > 0xffff)
+                return;
+
+        size = align8(sizeof(CacheRecord) + (name_len + release_len + options_len + 3) * sizeof(CHAR16));
+
+        if (cache->out_size + size > cache->out_allocated) {
+                UINTN allocated;
+                UINT8 *out;
+
+                allocated = cache->out_allocated * 2;
+                if (allocated < 4096)
+                        allocated = 4096;
+                while (allocated < cache->out_size + size)
+                        allocated *= 2;
+
+                if (cache->out)
+                        out = ReallocatePool(cache->out, cache->out_allocated, allocated);
+                else
+                        out = AllocatePool(allocated);
+                if (!out)
+                        return;
+
+                cache->out = out;
+                cache->out_allocated = allocated;
+        }
+
+        rec = (CacheRecord *)(cache->out + cache->out_size);
+        ZeroMem(rec, size);
+        rec->record_size = size;
+        rec->flags = release ? 0 : CACHE_RECORD_INVALID;
+        rec->file_size = info->FileSize;
+        rec->create_time = info->CreateTime;
+        rec->modification_time = info->ModificationTime;
+        rec->boot_count = boot_count;
+        rec->name_len = name_len;
+        rec->release_len = release_len;
+        rec->options_len = options_len;
+        CopyMem(record_name(rec), info->FileName, name_len * sizeof(CHAR16));
+        if (release)
+                CopyMem(record_release(rec), release, release_len * sizeof(CHAR16));
+        if (options)
+                CopyMem(record_options(rec), options, options_len * sizeof(CHAR16));
+
+        cache->out_size += size;
+        cache->n_out++;
+}
+
+EFI_STATUS entry_cache_write(EntryCache *cache, EFI_FILE_HANDLE dir) {
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE handle = NULL;
+        CacheHeader *header;
+        UINTN size;
+        EFI_STATUS r;
+
+        /* nothing changed since the last boot */
+        if (!cache->dirty && cache->n_out == cache->n_records)
+                return EFI_SUCCESS;
+
+        if (!cache->out)
+                return EFI_NOT_FOUND;
+
+        header = (CacheHeader *)cache->out;
+        CopyMem(header->magic, CACHE_MAGIC, sizeof(header->magic));
+        header->version = CACHE_VERSION;
+        header->n_records = cache->n_out;
+        header->size = cache->out_size - sizeof(CacheHeader);
+        r = uefi_call_wrapper(BS->CalculateCrc32, 3, cache->out + sizeof(CacheHeader), header->size, &header->crc32);
+        if (EFI_ERROR(r))
+                return r;
+
+        /* truncate the old file by deleting it */
+        r = uefi_call_wrapper(dir->Open, 5, dir, &handle, CACHE_FILE, EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE, 0ULL);
+        if (!EFI_ERROR(r)) {
+                uefi_call_wrapper(handle->Delete, 1, handle);
+                handle = NULL;
+        }
+
+        r = uefi_call_wrapper(dir->Open, 5, dir, &handle, CACHE_FILE,
+                              EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE|EFI_FILE_MODE_CREATE, 0ULL);
+        if (EFI_ERROR(r))
+                return r;
+
+        size = cache->out_size;
+        r = uefi_call_wrapper(handle->Write, 3, handle, &size, cache->out);
+        if (EFI_ERROR(r))
+                return r;
+
+        return uefi_call_wrapper(handle->Flush, 1, handle);
+}
+
+VOID entry_cache_free(EntryCache *cache) {
+        FreePool(cache->buf);
+        FreePool(cache->out);
+        ZeroMem(cache, sizeof(EntryCache));
+}
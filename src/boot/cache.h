@@ -0,0 +1,37 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+typedef struct {
+        UINT8 *buf;
+        UINTN size;
+        UINTN pos;
+        UINT8 *out;
+        UINTN out_size;
+        UINTN out_allocated;
+        UINTN n_out;
+        UINTN n_records;
+        BOOLEAN dirty;
+} EntryCache;
+
+EFI_STATUS entry_cache_load(EntryCache *cache, EFI_FILE_HANDLE dir);
+BOOLEAN entry_cache_lookup(EntryCache *cache, EFI_FILE_INFO *info,
+                           CHAR16 **release, CHAR16 **options, INTN *boot_count);
+VOID entry_cache_add(EntryCache *cache, EFI_FILE_INFO *info,
+                     CHAR16 *release, CHAR16 *options, INTN boot_count);
+EFI_STATUS entry_cache_write(EntryCache *cache, EFI_FILE_HANDLE dir);
+VOID entry_cache_free(EntryCache *cache);
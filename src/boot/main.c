@@ -22,11 +22,22 @@
 #include "shared/graphics.h"
 #include "shared/disk.h"
 #include "shared/pefile.h"
+#include "shared/timer.h"
+#include "shared/handoff.h"
 #include "console.h"
+#include "cache.h"
+#include "arena.h"
+#include "volume.h"
+
+/* loader file names, and their path in the org.bus1 directory */
+#define LOADER_NAME_MAX         256
+#define LOADER_PATH_MAX         (LOADER_NAME_MAX + 16)
 
 enum {
         ENTRY_EDITOR            = 1ULL <<  0,
         ENTRY_AUTOSELECT        = 1ULL <<  1,
+        ENTRY_HANDOFF           = 1ULL <<  2,
+        ENTRY_ADDONS            = 1ULL <<  3,
 };
 
 typedef struct {
@@ -36,18 +47,37 @@ typedef struct {
         CHAR16 *options_edit;
         CHAR16 key;
         EFI_HANDLE *device;
+        EFI_FILE_HANDLE root;
+        Volume *volume;
         EFI_STATUS (*call)(VOID);
         INTN boot_count;
         UINT64 flags;
+        UINT32 *sort_key;
+        UINTN sort_key_len;
 } ConfigEntry;
 
 typedef struct {
-        ConfigEntry **entries;
+        Arena arena;
+        ConfigEntry *entries;
         UINTN n_entries;
+        UINTN n_entries_allocated;
         INTN idx_default;
         EFI_LOADED_IMAGE *loaded_image;
+        VolumeInventory volumes;
+        BOOLEAN probed;
+        UINTN n_file_reads;
+        UINTN n_cache_hits;
+        /* timestamps in usec, published before the chosen image is started */
+        UINT64 time_entry;
+        UINT64 time_scan;
+        UINT64 time_sort;
+        UINT64 time_menu;
+        BOOLEAN menu_shown;
 } Config;
 
+static const EFI_GUID boot_efi_guid = BOOT_EFI_VARIABLE_GUID;
+static const EFI_GUID boot_handoff_guid = BOOT_HANDOFF_PROTOCOL_GUID;
+
 static VOID cursor_left(UINTN *cursor, UINTN *first) {
         if ((*cursor) > 0)
                 (*cursor)--;
@@ -248,6 +278,7 @@ static BOOLEAN line_edit(CHAR16 *line_in, CHAR16 **line_out, UINTN x_max, UINTN
                 case KEYPRESS(0, 0, CHAR_LINEFEED):
                 case KEYPRESS(0, 0, CHAR_CARRIAGE_RETURN):
                         if (StrCmp(line, line_in) != 0) {
+                                FreePool(*line_out);
                                 *line_out = line;
                                 line = NULL;
                         }
@@ -322,11 +353,11 @@ static UINTN entry_lookup_key(Config *config, UINTN start, CHAR16 key) {
 
         /* find matching key in config entries */
         for (UINTN i = start; i < config->n_entries; i++)
-                if (config->entries[i]->key == key)
+                if (config->entries[i].key == key)
                         return i;
 
         for (UINTN i = 0; i < start; i++)
-                if (config->entries[i]->key == key)
+                if (config->entries[i].key == key)
                         return i;
 
         return -1;
@@ -336,10 +367,9 @@ static VOID print_status(Config *config) {
         CHAR16 *s;
         CHAR16 uuid[37];
         UINT64 key;
-        CHAR8 *b;
+        UINT64 value;
         UINTN x;
         UINTN y;
-        UINTN size;
 
         uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
         uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
@@ -362,24 +392,21 @@ static VOID print_status(Config *config) {
         if (uefi_call_wrapper(ST->ConOut->QueryMode, 4, ST->ConOut, ST->ConOut->Mode->Mode, &x, &y) == EFI_SUCCESS)
                 Print(L"console size:           %d x %d\n", x, y);
 
-        if (efivar_get(NULL, L"SecureBoot", &b, &size) == EFI_SUCCESS) {
-                Print(L"SecureBoot:             %s\n", yes_no(*b > 0));
-                FreePool(b);
-        }
+        if (efivar_get_int(NULL, L"SecureBoot", &value) == EFI_SUCCESS)
+                Print(L"SecureBoot:             %s\n", yes_no(value > 0));
 
-        if (efivar_get(NULL, L"SetupMode", &b, &size) == EFI_SUCCESS) {
-                Print(L"SetupMode:              %s\n", *b > 0 ? L"setup" : L"user");
-                FreePool(b);
-        }
+        if (efivar_get_int(NULL, L"SetupMode", &value) == EFI_SUCCESS)
+                Print(L"SetupMode:              %s\n", value > 0 ? L"setup" : L"user");
 
-        if (efivar_get(NULL, L"OsIndicationsSupported", &b, &size) == EFI_SUCCESS) {
-                Print(L"OsIndicationsSupported: %d\n", (UINT64)*b);
-                FreePool(b);
-        }
+        if (efivar_get_int(NULL, L"OsIndicationsSupported", &value) == EFI_SUCCESS)
+                Print(L"OsIndicationsSupported: %d\n", value);
         Print(L"\n");
 
         Print(L"config entry count:     %d\n", config->n_entries);
         Print(L"entry selected idx:     %d\n", config->idx_default);
+        Print(L"file reads during scan: %d\n", config->n_file_reads);
+        Print(L"entry cache hits:       %d\n", config->n_cache_hits);
+        Print(L"volumes:                %d (%d opened)\n", config->volumes.n_volumes, config->volumes.n_roots_opened);
         Print(L"\n");
 
         Print(L"\n--- press key ---\n\n");
@@ -391,7 +418,7 @@ static VOID print_status(Config *config) {
                 if (key == KEYPRESS(0, SCAN_ESC, 0) || key == KEYPRESS(0, 0, 'q'))
                         break;
 
-                entry = config->entries[i];
+                entry = &config->entries[i];
                 Print(L"config entry:           %d/%d\n", i+1, config->n_entries);
                 Print(L"release                 '%s'\n", entry->release);
                 if (entry->file_path)
@@ -477,7 +504,7 @@ static BOOLEAN menu_run(Config *config, ConfigEntry **chosen_entry) {
         for (UINTN i = 0; i < config->n_entries; i++) {
                 UINTN entry_len;
 
-                entry_len = StrLen(config->entries[i]->release);
+                entry_len = StrLen(config->entries[i].release);
                 if (line_width < entry_len)
                         line_width = entry_len;
         }
@@ -501,8 +528,8 @@ static BOOLEAN menu_run(Config *config, ConfigEntry **chosen_entry) {
                 for (j = 0; j < x_start; j++)
                         lines[i][j] = ' ';
 
-                for (k = 0; config->entries[i]->release[k] != '\0' && j < x_max; j++, k++)
-                        lines[i][j] = config->entries[i]->release[k];
+                for (k = 0; config->entries[i].release[k] != '\0' && j < x_max; j++, k++)
+                        lines[i][j] = config->entries[i].release[k];
 
                 for (; j < x_max; j++)
                         lines[i][j] = ' ';
@@ -641,12 +668,12 @@ static BOOLEAN menu_run(Config *config, ConfigEntry **chosen_entry) {
                         break;
 
                 case KEYPRESS(0, 0, 'e'):
-                        if (!config->entries[idx_highlight]->flags & ENTRY_EDITOR)
+                        if (!(config->entries[idx_highlight].flags & ENTRY_EDITOR))
                                 break;
                         uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
                         uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, 0, y_max-1);
                         uefi_call_wrapper(ST->ConOut->OutputString, 2, ST->ConOut, clearline+1);
-                        if (line_edit(config->entries[idx_highlight]->options, &config->entries[idx_highlight]->options_edit, x_max-1, y_max-1))
+                        if (line_edit(config->entries[idx_highlight].options, &config->entries[idx_highlight].options_edit, x_max-1, y_max-1))
                                 exit = TRUE;
                         uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, 0, y_max-1);
                         uefi_call_wrapper(ST->ConOut->OutputString, 2, ST->ConOut, clearline+1);
@@ -691,7 +718,7 @@ static BOOLEAN menu_run(Config *config, ConfigEntry **chosen_entry) {
                         highlight = TRUE;
         }
 
-        *chosen_entry = config->entries[idx_highlight];
+        *chosen_entry = &config->entries[idx_highlight];
 
         for (UINTN i = 0; i < config->n_entries; i++)
                 FreePool(lines[i]);
@@ -703,23 +730,29 @@ static BOOLEAN menu_run(Config *config, ConfigEntry **chosen_entry) {
         return run;
 }
 
-static VOID config_add_entry(Config *config, ConfigEntry *entry) {
-        if ((config->n_entries & 15) == 0) {
-                UINTN i;
+/* Returns a zeroed entry at the end of the array; earlier entry pointers become invalid. */
+static ConfigEntry *config_add_entry(Config *config) {
+        ConfigEntry *entry;
 
-                i = config->n_entries + 16;
-                if (config->n_entries == 0)
-                        config->entries = AllocatePool(sizeof(VOID *) * i);
-                else
-                        config->entries = ReallocatePool(config->entries,
-                                                         sizeof(VOID *) * config->n_entries, sizeof(VOID *) * i);
+        if (config->n_entries == config->n_entries_allocated) {
+                ConfigEntry *entries;
+                UINTN n;
+
+                n = config->n_entries_allocated ? config->n_entries_allocated * 2 : 16;
+                entries = arena_realloc(&config->arena, config->entries,
+                                        config->n_entries_allocated * sizeof(ConfigEntry),
+                                        n * sizeof(ConfigEntry));
+                if (!entries)
+                        return NULL;
+
+                config->entries = entries;
+                config->n_entries_allocated = n;
         }
-        config->entries[config->n_entries++] = entry;
-}
 
-static VOID config_entry_free(ConfigEntry *entry) {
-        FreePool(entry->release);
-        FreePool(entry->options);
+        entry = &config->entries[config->n_entries++];
+        ZeroMem(entry, sizeof(ConfigEntry));
+
+        return entry;
 }
 
 static BOOLEAN is_digit(CHAR16 c) {
@@ -779,26 +812,136 @@ static INTN str_verscmp(CHAR16 *s1, CHAR16 *s2) {
         return StrCmp(os1, os2);
 }
 
-static VOID config_sort_entries(Config *config) {
-        for (UINTN i = 1; i < config->n_entries; i++) {
-                BOOLEAN more;
-
-                more = FALSE;
-                for (UINTN k = 0; k < config->n_entries - i; k++) {
-                        ConfigEntry *entry;
+/*
+ * Precompute a key for str_verscmp(): every non-digit character is stored as
+ * its c_order(), every run of non-digits is terminated by 0, and every run of
+ * digits is stored as its length without leading zeros followed by the
+ * digits. Comparing two keys element by element, with a key that is a prefix
+ * of the other being smaller, gives the same order as str_verscmp().
+ */
+static UINTN version_key_fill(CHAR16 *s, UINT32 *key) {
+        UINTN n = 0;
 
-                        if (str_verscmp(config->entries[k]->file_path, config->entries[k+1]->file_path) <= 0)
-                                continue;
+        for (;;) {
+                CHAR16 *digits;
 
-                        entry = config->entries[k];
-                        config->entries[k] = config->entries[k+1];
-                        config->entries[k+1] = entry;
-                        more = TRUE;
+                while (*s && !is_digit(*s)) {
+                        if (key)
+                                key[n] = c_order(*s);
+                        n++;
+                        s++;
+                }
+                if (key)
+                        key[n] = 0;
+                n++;
+
+                while (*s == '0')
+                        s++;
+
+                digits = s;
+                while (is_digit(*s))
+                        s++;
+
+                if (key)
+                        key[n] = s - digits;
+                n++;
+                while (digits < s) {
+                        if (key)
+                                key[n] = *digits;
+                        n++;
+                        digits++;
                 }
 
-                if (!more)
+                if (*s == '\0')
                         break;
         }
+
+        return n;
+}
+
+static UINT32 *version_key_new(Arena *arena, CHAR16 *s, UINTN *len) {
+        UINT32 *key;
+        UINTN n;
+
+        n = version_key_fill(s, NULL);
+        key = arena_alloc(arena, n * sizeof(UINT32));
+        if (!key)
+                return NULL;
+
+        version_key_fill(s, key);
+        *len = n;
+        return key;
+}
+
+static INTN config_entry_cmp(ConfigEntry *a, ConfigEntry *b) {
+        UINTN len;
+
+        /* entries added without a key are compared the slow way */
+        if (!a->sort_key || !b->sort_key)
+                return str_verscmp(a->file_path, b->file_path);
+
+        len = a->sort_key_len < b->sort_key_len ? a->sort_key_len : b->sort_key_len;
+        for (UINTN i = 0; i < len; i++)
+                if (a->sort_key[i] != b->sort_key[i])
+                        return a->sort_key[i] < b->sort_key[i] ? -1 : 1;
+
+        if (a->sort_key_len != b->sort_key_len)
+                return a->sort_key_len < b->sort_key_len ? -1 : 1;
+
+        return StrCmp(a->file_path, b->file_path);
+}
+
+/* stable bottom-up merge sort of all entries starting at index first */
+static VOID config_sort_entries(Config *config, UINTN first) {
+        _c_cleanup_(CFreePoolP) ConfigEntry *tmp = NULL;
+        ConfigEntry *entries = config->entries + first;
+        UINTN n = config->n_entries - first;
+        ConfigEntry *from = entries;
+        ConfigEntry *to;
+
+        if (n < 2)
+                return;
+
+        tmp = AllocatePool(n * sizeof(ConfigEntry));
+        if (!tmp)
+                return;
+        to = tmp;
+
+        for (UINTN width = 1; width < n; width *= 2) {
+                ConfigEntry *swap;
+
+                for (UINTN start = 0; start < n; start += 2 * width) {
+                        UINTN mid = start + width;
+                        UINTN end = start + 2 * width;
+                        UINTN i, k, o;
+
+                        if (mid > n)
+                                mid = n;
+                        if (end > n)
+                                end = n;
+
+                        i = start;
+                        k = mid;
+                        o = start;
+                        while (i < mid && k < end) {
+                                if (config_entry_cmp(&from[i], &from[k]) <= 0)
+                                        to[o++] = from[i++];
+                                else
+                                        to[o++] = from[k++];
+                        }
+                        while (i < mid)
+                                to[o++] = from[i++];
+                        while (k < end)
+                                to[o++] = from[k++];
+                }
+
+                swap = from;
+                from = to;
+                to = swap;
+        }
+
+        if (from != entries)
+                CopyMem(entries, from, n * sizeof(ConfigEntry));
 }
 
 static VOID config_default_entry_select(Config *config) {
@@ -810,11 +953,11 @@ static VOID config_default_entry_select(Config *config) {
 
         i = config->n_entries;
         while (i--) {
-                if (!(config->entries[i]->flags & ENTRY_AUTOSELECT))
+                if (!(config->entries[i].flags & ENTRY_AUTOSELECT))
                         continue;
 
                 /* Remember the first "-boot0" entry, in case we don't find a better one. */
-                if (config->entries[i]->boot_count == 0) {
+                if (config->entries[i].boot_count == 0) {
                         if (idx_default_fallback < 0)
                                 idx_default_fallback = i;
 
@@ -832,160 +975,396 @@ static VOID config_default_entry_select(Config *config) {
 static BOOLEAN config_entry_add_call(Config *config, CHAR16 *release, EFI_STATUS (*call)(VOID)) {
         ConfigEntry *entry;
 
-        entry = AllocateZeroPool(sizeof(ConfigEntry));
+        entry = config_add_entry(config);
+        if (!entry)
+                return FALSE;
+
         entry->boot_count = -1;
-        entry->release = StrDuplicate(release);
+        entry->release = arena_strdup(&config->arena, release);
         entry->call = call;
-        config_add_entry(config, entry);
 
         return TRUE;
 }
 
-static EFI_STATUS config_entry_add_file(Config *config, EFI_HANDLE *device, EFI_FILE_HANDLE root_dir,
+/* Add an entry for a file which is known to exist, e.g. from a directory listing. */
+static EFI_STATUS config_entry_add(Config *config, Volume *volume,
+                                   CHAR16 *release, CHAR16 key, CHAR16 *file_path, CHAR16 *options,
+                                   INTN boot_count, UINT64 flags) {
+        ConfigEntry *entry;
+
+        entry = config_add_entry(config);
+        if (!entry)
+                return EFI_OUT_OF_RESOURCES;
+
+        if (release)
+                entry->release = arena_strdup(&config->arena, release);
+        entry->key = key;
+        entry->file_path = arena_strdup(&config->arena, file_path);
+        entry->sort_key = version_key_new(&config->arena, file_path, &entry->sort_key_len);
+        /* most images share the same command line */
+        if (options)
+                entry->options = arena_intern(&config->arena, options);
+        entry->boot_count = boot_count;
+        entry->flags = flags;
+        entry->device = volume->device;
+        entry->root = volume->root;
+        entry->volume = volume;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS config_entry_add_file(Config *config, Volume *volume,
                                         CHAR16 *release, CHAR16 key, CHAR16 *file_path, CHAR16 *options,
                                         INTN boot_count, UINT64 flags) {
-        ConfigEntry *entry;
         _c_cleanup_(CCloseP) EFI_FILE_HANDLE handle = NULL;
-        EFI_FILE_INFO *info;
-        UINTN size = 0;
+        _c_cleanup_(CFreePoolP) EFI_FILE_INFO *info = NULL;
+        EFI_FILE_HANDLE root_dir;
         EFI_STATUS r;
 
+        root_dir = volume_root(&config->volumes, volume);
+        if (!root_dir)
+                return EFI_NOT_FOUND;
+
         /* check existence */
         r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &handle, file_path, EFI_FILE_MODE_READ, 0ULL);
         if (EFI_ERROR(r))
                 return r;
 
         info = LibFileInfo(handle);
-        size = info->FileSize;
-        FreePool(info);
-
-        if (size == 0)
+        if (!info)
                 return EFI_LOAD_ERROR;
 
-        entry = AllocateZeroPool(sizeof(ConfigEntry));
-        if (release)
-                entry->release = StrDuplicate(release);
-        entry->key = key;
-        entry->file_path = StrDuplicate(file_path);
-        if (options)
-                entry->options = StrDuplicate(options);
-        entry->boot_count = boot_count;
-        entry->flags = flags;
-        entry->device = device;
-        config_add_entry(config, entry);
+        if (info->FileSize == 0)
+                return EFI_LOAD_ERROR;
 
-        return EFI_SUCCESS;
+        return config_entry_add(config, volume, release, key, file_path, options, boot_count, flags);
 }
 
-static VOID config_entry_add_osx(Config *config) {
+/* Read the release and options strings of a loader image. EFI_INVALID_PARAMETER marks a permanent rejection. */
+static EFI_STATUS config_entry_parse_linux(Config *config, EFI_FILE_HANDLE dir, EFI_FILE_INFO *info,
+                                           CHAR16 **releasep, CHAR16 **optionsp, INTN *boot_countp) {
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE f = NULL;
+        enum {
+                SECTION_RELEASE,
+                SECTION_OPTIONS,
+        };
+        CHAR8 *sections[] = {
+                [SECTION_RELEASE] = (UINT8 *)".release",
+                [SECTION_OPTIONS] = (UINT8 *)".options",
+        };
+        UINTN offs[C_ARRAY_SIZE(sections)] = {};
+        UINTN szs[C_ARRAY_SIZE(sections)] = {};
+        UINTN raw_szs[C_ARRAY_SIZE(sections)] = {};
+        UINTN addrs[C_ARRAY_SIZE(sections)] = {};
+        FileRange ranges[C_ARRAY_SIZE(sections)];
+        UINTN n_ranges = 0;
+        _c_cleanup_(CFreePoolP) CHAR16 *release = NULL;
+        _c_cleanup_(CFreePoolP) CHAR16 *options = NULL;
         EFI_STATUS r;
-        UINTN handle_count = 0;
-        EFI_HANDLE *handles = NULL;
 
-        r = LibLocateHandle(ByProtocol, &FileSystemProtocol, NULL, &handle_count, &handles);
-        if (!EFI_ERROR(r)) {
-                for (UINTN i = 0; i < handle_count; i++) {
-                        _c_cleanup_(CCloseP) EFI_FILE_HANDLE root = NULL;
+        /* look for .release and .options sections in the .efi binary */
+        r = uefi_call_wrapper(dir->Open, 5, dir, &f, info->FileName, EFI_FILE_MODE_READ, 0ULL);
+        if (EFI_ERROR(r))
+                return r;
 
-                        root = LibOpenRoot(handles[i]);
-                        if (!root)
-                                continue;
+        r = pefile_locate_sections(f, sections, C_ARRAY_SIZE(sections), addrs, offs, szs, raw_szs,
+                                   &config->n_file_reads);
+        if (EFI_ERROR(r))
+                return r;
 
-                        r = config_entry_add_file(config, handles[i], root, L"osx", 'a',
-                                                  L"\\System\\Library\\CoreServices\\boot.efi", NULL, -1, 0);
-                        if (!EFI_ERROR(r))
-                                break;
-                }
+        if (szs[SECTION_RELEASE] < sizeof(CHAR16))
+                return EFI_INVALID_PARAMETER;
 
-                FreePool(handles);
+        /* past its raw data a section is zero; only read what is in the file */
+        for (UINTN n = 0; n < C_ARRAY_SIZE(sections); n++)
+                if (raw_szs[n] > szs[n])
+                        raw_szs[n] = szs[n];
+
+        /* read both strings through the already open handle */
+        release = AllocateZeroPool(szs[SECTION_RELEASE] + sizeof(CHAR16));
+        if (!release)
+                return EFI_OUT_OF_RESOURCES;
+        ranges[n_ranges++] = (FileRange){ offs[SECTION_RELEASE], raw_szs[SECTION_RELEASE], release };
+
+        if (szs[SECTION_OPTIONS] > 0) {
+                options = AllocateZeroPool(szs[SECTION_OPTIONS] + sizeof(CHAR16));
+                if (!options)
+                        return EFI_OUT_OF_RESOURCES;
+                ranges[n_ranges++] = (FileRange){ offs[SECTION_OPTIONS], raw_szs[SECTION_OPTIONS], options };
         }
+
+        r = file_read_ranges(f, info->FileSize, ranges, n_ranges, &config->n_file_reads);
+        if (EFI_ERROR(r))
+                return r;
+
+        r = loader_filename_parse(info->FileName, release, szs[SECTION_RELEASE] / sizeof(CHAR16), boot_countp);
+        if (EFI_ERROR(r))
+                return r;
+
+        *releasep = release;
+        *optionsp = options;
+        release = NULL;
+        options = NULL;
+
+        return EFI_SUCCESS;
 }
 
-static EFI_STATUS config_entry_add_linux( Config *config, EFI_FILE_HANDLE root_dir) {
+/* The initrd add-ons of the images live in <release>.extra.d directories next to them. */
+static BOOLEAN addons_dir_match(EFI_FILE_INFO *info) {
+        UINTN len;
+
+        if (!(info->Attribute & EFI_FILE_DIRECTORY))
+                return FALSE;
+
+        len = StrLen(info->FileName);
+        return len > 8 && StriCmp(info->FileName + len - 8, L".extra.d") == 0;
+}
+
+/* The org.bus1 entries from first on are stubs; tell them whether they need to look for add-ons at all. */
+static VOID config_entries_mark_stubs(Config *config, UINTN first, BOOLEAN addons) {
+        for (UINTN i = first; i < config->n_entries; i++) {
+                config->entries[i].flags |= ENTRY_HANDOFF;
+                if (addons)
+                        config->entries[i].flags |= ENTRY_ADDONS;
+        }
+}
+
+/*
+ * The cache is only written back to the volume we booted from; other
+ * volumes, which may be removable media or another system's ESP, are
+ * only read.
+ */
+static EFI_STATUS config_entry_add_linux(Config *config, Volume *volume, UINT64 flags, BOOLEAN cache_write) {
         _c_cleanup_(CCloseP) EFI_FILE_HANDLE bus1_dir = NULL;
+        EntryCache cache;
+        DirIterator iter;
+        EFI_FILE_HANDLE root_dir;
+        UINTN first = config->n_entries;
+        BOOLEAN addons = FALSE;
         EFI_STATUS r;
 
+        root_dir = volume_root(&config->volumes, volume);
+        if (!root_dir)
+                return EFI_NOT_FOUND;
+
         r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &bus1_dir, L"\\EFI\\org.bus1", EFI_FILE_MODE_READ, 0ULL);
         if (EFI_ERROR(r))
                 return r;
 
+        entry_cache_load(&cache, bus1_dir);
+        dir_iterator_init(&iter, bus1_dir);
+
         for (;;) {
-                _c_cleanup_(CCloseP) EFI_FILE_HANDLE f = NULL;
-                struct {
-                        EFI_FILE_INFO info;
-                        CHAR16 buf[256];
-                } file_info;
-                UINTN file_info_size;
-                enum {
-                        SECTION_RELEASE,
-                        SECTION_OPTIONS,
-                };
-                CHAR8 *sections[] = {
-                        [SECTION_RELEASE] = (UINT8 *)".release",
-                        [SECTION_OPTIONS] = (UINT8 *)".options",
-                };
-                UINTN offs[C_ARRAY_SIZE(sections)] = {};
-                UINTN szs[C_ARRAY_SIZE(sections)] = {};
-                UINTN addrs[C_ARRAY_SIZE(sections)] = {};
+                EFI_FILE_INFO *info;
                 _c_cleanup_(CFreePoolP) CHAR16 *release = NULL;
                 _c_cleanup_(CFreePoolP) CHAR16 *options = NULL;
-                _c_cleanup_(CFreePoolP) CHAR16 *file = NULL;
+                CHAR16 file[LOADER_PATH_MAX];
+                CHAR16 *cached_release;
+                CHAR16 *cached_options;
                 INTN boot_count;
-                INTN n;
 
-                file_info_size = sizeof(file_info);
-                r = uefi_call_wrapper(bus1_dir->Read, 3, bus1_dir, &file_info_size, &file_info);
-                if (file_info_size == 0 || EFI_ERROR(r))
+                r = dir_iterator_next(&iter, &info);
+                if (EFI_ERROR(r))
                         break;
 
-                if (file_info.info.FileName[0] == '.')
+                if (info->FileName[0] == '.')
                         continue;
-                if (file_info.info.Attribute & EFI_FILE_DIRECTORY)
+                if (addons_dir_match(info))
+                        addons = TRUE;
+                if (info->Attribute & EFI_FILE_DIRECTORY)
+                        continue;
+                if (info->FileSize == 0)
                         continue;
 
-                /* look for .release and .options sections in the .efi binary */
-                r = uefi_call_wrapper(bus1_dir->Open, 5, bus1_dir, &f, file_info.info.FileName, EFI_FILE_MODE_READ, 0ULL);
-                if (EFI_ERROR(r))
+                /* the boot counter could not rename it */
+                if (StrLen(info->FileName) >= LOADER_NAME_MAX)
+                        continue;
+
+                SPrint(file, sizeof(file), L"\\EFI\\org.bus1\\%s", info->FileName);
+
+                /* unchanged images do not need to be opened again */
+                if (entry_cache_lookup(&cache, info, &cached_release, &cached_options, &boot_count)) {
+                        entry_cache_add(&cache, info, cached_release, cached_options, boot_count);
+                        if (!cached_release)
+                                continue;
+
+                        config->n_cache_hits++;
+                        config_entry_add(config, volume, cached_release, 'l', file, cached_options,
+                                         boot_count, flags);
                         continue;
+                }
 
-                r = pefile_locate_sections(f, sections, C_ARRAY_SIZE(sections), addrs, offs, szs);
+                r = config_entry_parse_linux(config, bus1_dir, info, &release, &options, &boot_count);
+                if (r == EFI_INVALID_PARAMETER)
+                        entry_cache_add(&cache, info, NULL, NULL, -1);
                 if (EFI_ERROR(r))
                         continue;
 
-                if (szs[SECTION_RELEASE] == 0)
+                entry_cache_add(&cache, info, release, options, boot_count);
+                config_entry_add(config, volume, release, 'l', file, options,
+                                 boot_count, flags);
+        }
+
+        dir_iterator_free(&iter);
+        if (cache_write)
+                entry_cache_write(&cache, bus1_dir);
+        entry_cache_free(&cache);
+
+        config_entries_mark_stubs(config, first, addons);
+        return EFI_SUCCESS;
+}
+
+/* Derive release string and boot count from a loader file name without looking into the image. */
+static BOOLEAN loader_filename_guess(CHAR16 *name, UINTN *release_len, INTN *boot_count) {
+        UINTN len;
+
+        len = StrLen(name);
+        if (len > 10 && loader_filename_parse(name, name, len - 10, boot_count) == EFI_SUCCESS) {
+                *release_len = len - 10;
+                return TRUE;
+        }
+
+        if (len > 4 && loader_filename_parse(name, name, len - 4, boot_count) == EFI_SUCCESS) {
+                *release_len = len - 4;
+                return TRUE;
+        }
+
+        return FALSE;
+}
+
+/*
+ * Pick the entry config_default_entry_select() would pick after a full scan
+ * from the file names in the org.bus1 directory alone. Images which were
+ * rejected at an earlier boot are skipped. Only the picked one is looked
+ * at: unless the cache knows it, it is checked like the full scan checks
+ * every image, before it can use up a boot try. A rejected image makes
+ * the caller fall back to the full scan.
+ */
+static EFI_STATUS config_entry_add_linux_fast(Config *config) {
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE bus1_dir = NULL;
+        _c_cleanup_(CFreePoolP) EFI_FILE_INFO *best = NULL;
+        _c_cleanup_(CFreePoolP) EFI_FILE_INFO *best_boot0 = NULL;
+        _c_cleanup_(CFreePoolP) CHAR16 *parsed_release = NULL;
+        _c_cleanup_(CFreePoolP) CHAR16 *parsed_options = NULL;
+        _c_cleanup_(CFreePoolP) CHAR16 *file = NULL;
+        Volume *volume = &config->volumes.volumes[0];
+        EntryCache cache;
+        DirIterator iter;
+        EFI_FILE_HANDLE root_dir;
+        EFI_FILE_INFO *info;
+        CHAR16 *release;
+        CHAR16 *options;
+        UINTN release_len;
+        INTN boot_count;
+        BOOLEAN addons = FALSE;
+        EFI_STATUS r;
+
+        root_dir = volume_root(&config->volumes, volume);
+        if (!root_dir)
+                return EFI_NOT_FOUND;
+
+        r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &bus1_dir, L"\\EFI\\org.bus1", EFI_FILE_MODE_READ, 0ULL);
+        if (EFI_ERROR(r))
+                return r;
+
+        entry_cache_load(&cache, bus1_dir);
+
+        dir_iterator_init(&iter, bus1_dir);
+
+        for (;;) {
+                EFI_FILE_INFO **slot;
+
+                r = dir_iterator_next(&iter, &info);
+                if (EFI_ERROR(r))
+                        break;
+
+                if (info->FileName[0] == '.')
+                        continue;
+                if (addons_dir_match(info))
+                        addons = TRUE;
+                if (info->Attribute & EFI_FILE_DIRECTORY)
+                        continue;
+                if (info->FileSize == 0)
+                        continue;
+                if (StrLen(info->FileName) >= LOADER_NAME_MAX)
                         continue;
 
-                n = file_read_str(bus1_dir, file_info.info.FileName, offs[SECTION_RELEASE], szs[SECTION_RELEASE], &release);
-                if (n <= 0)
+                /* known images are kept in the cache, the others are left to the next full scan */
+                if (entry_cache_lookup(&cache, info, &release, &options, &boot_count)) {
+                        entry_cache_add(&cache, info, release, options, boot_count);
+                        if (!release)
+                                continue;
+                } else if (!loader_filename_guess(info->FileName, &release_len, &boot_count))
                         continue;
 
-                if (loader_filename_parse(f, release, n, &boot_count) != EFI_SUCCESS)
+                /* remember the newest entry, and the newest one which ran out of boot tries */
+                slot = boot_count == 0 ? &best_boot0 : &best;
+                if (*slot && str_verscmp((*slot)->FileName, info->FileName) >= 0)
                         continue;
 
-                if (szs[SECTION_OPTIONS] > 0)
-                        file_read_str(bus1_dir, file_info.info.FileName, offs[SECTION_OPTIONS], szs[SECTION_OPTIONS], &options);
+                FreePool(*slot);
+                *slot = AllocatePool(info->Size);
+                if (*slot)
+                        CopyMem(*slot, info, info->Size);
+        }
 
-                file = PoolPrint(L"\\EFI\\org.bus1\\%s", file_info.info.FileName);
-                config_entry_add_file(config, config->loaded_image->DeviceHandle, root_dir,
-                                      release, 'l', file, options,
-                                      boot_count, ENTRY_EDITOR|ENTRY_AUTOSELECT);
+        dir_iterator_free(&iter);
+
+        info = best ? best : best_boot0;
+        if (!info) {
+                r = EFI_NOT_FOUND;
+                goto finish;
         }
 
-        return EFI_SUCCESS;
+        if (entry_cache_lookup(&cache, info, &release, &options, &boot_count)) {
+                config->n_cache_hits++;
+        } else {
+                r = config_entry_parse_linux(config, bus1_dir, info,
+                                             &parsed_release, &parsed_options, &boot_count);
+                if (r == EFI_INVALID_PARAMETER)
+                        entry_cache_add(&cache, info, NULL, NULL, -1);
+                if (EFI_ERROR(r))
+                        goto finish;
+
+                entry_cache_add(&cache, info, parsed_release, parsed_options, boot_count);
+                release = parsed_release;
+                options = parsed_options;
+        }
+
+        file = PoolPrint(L"\\EFI\\org.bus1\\%s", info->FileName);
+        if (!file) {
+                r = EFI_OUT_OF_RESOURCES;
+                goto finish;
+        }
+
+        r = config_entry_add(config, volume, release, 'l', file, options,
+                             boot_count, ENTRY_EDITOR|ENTRY_AUTOSELECT);
+        if (EFI_ERROR(r))
+                goto finish;
+
+        config->idx_default = config->n_entries - 1;
+        config_entries_mark_stubs(config, config->idx_default, addons);
+
+finish:
+        /* a rejected image is remembered as well, the full scan does not open it again */
+        entry_cache_write(&cache, bus1_dir);
+        entry_cache_free(&cache);
+        return r;
 }
 
-static EFI_STATUS image_set_boot_count(EFI_FILE_HANDLE root_dir, ConfigEntry *entry, UINTN count) {
+static EFI_STATUS image_set_boot_count(Config *config, ConfigEntry *entry, UINTN count) {
         static EFI_GUID EfiFileInfoGuid = EFI_FILE_INFO_ID;
         struct {
                 EFI_FILE_INFO info;
-                CHAR16 buf[256];
+                CHAR16 buf[LOADER_NAME_MAX];
         } file_info;
         UINTN file_info_size = sizeof(file_info);
         _c_cleanup_(CCloseP) EFI_FILE_HANDLE file = NULL;
+        CHAR16 path[LOADER_PATH_MAX];
         CHAR16 *file_path;
         EFI_STATUS r;
 
-        r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &file, entry->file_path, EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE, 0ULL);
+        r = uefi_call_wrapper(entry->root->Open, 5, entry->root, &file, entry->file_path, EFI_FILE_MODE_READ|EFI_FILE_MODE_WRITE, 0ULL);
         if (EFI_ERROR(r))
                 return r;
 
@@ -1000,23 +1379,104 @@ static EFI_STATUS image_set_boot_count(EFI_FILE_HANDLE root_dir, ConfigEntry *en
                 return r;
 
         /* Update the stored loader path in the entry. */
-        file_path = PoolPrint(L"\\EFI\\org.bus1\\%s-boot%d.efi", entry->release, count);
+        SPrint(path, sizeof(path), L"\\EFI\\org.bus1\\%s-boot%d.efi", entry->release, count);
+        file_path = arena_strdup(&config->arena, path);
         if (!file_path)
                 return EFI_OUT_OF_RESOURCES;
 
-        FreePool(entry->file_path);
         entry->file_path = file_path;
 
         return 0;
 }
 
-static EFI_STATUS image_start(EFI_FILE_HANDLE root_dir, EFI_HANDLE parent_image, ConfigEntry *entry) {
+static VOID config_publish_times(Config *config, UINT64 time_load) {
+        CHAR16 *menu_shown;
+
+        timer_publish(L"BootTimeEntryUSec", config->time_entry);
+        timer_publish(L"BootTimeScanUSec", config->time_scan);
+        timer_publish(L"BootTimeSortUSec", config->time_sort);
+        timer_publish(L"BootTimeMenuUSec", config->time_menu);
+        timer_publish(L"BootTimeLoadImageUSec", time_load);
+        timer_publish(L"BootTimeStartImageUSec", timer_usec());
+
+        menu_shown = config->menu_shown ? L"yes" : L"no";
+        efivar_set(&boot_efi_guid, L"BootMenuShown", (CHAR8 *)menu_shown, (StrLen(menu_shown) + 1) * sizeof(CHAR16), FALSE);
+}
+
+/* What the stub would otherwise find out again, on its way to the kernel. */
+static VOID image_handoff_init(Config *config, ConfigEntry *entry, BootHandoff *handoff, UINT64 time_load) {
+        *handoff = (BootHandoff){
+                .version = BOOT_HANDOFF_VERSION,
+                .size = sizeof(BootHandoff),
+                .file_path = entry->file_path,
+                .boot_count = entry->boot_count > 0 ? entry->boot_count - 1 : entry->boot_count,
+                .timer_freq = timer_frequency(),
+                .time_entry = config->time_entry,
+                .time_scan = config->time_scan,
+                .time_sort = config->time_sort,
+                .time_menu = config->time_menu,
+                .time_load_image = time_load,
+        };
+
+        if (entry->flags & ENTRY_ADDONS)
+                handoff->flags |= BOOT_HANDOFF_ADDONS;
+
+        StrCpy(handoff->disk_uuid, volume_disk_uuid(entry->volume));
+}
+
+/*
+ * LoadImage() reads the whole file anyway; reading it here instead lets the
+ * stub find its trailing initrd in the same buffer, without a second read.
+ */
+static EFI_STATUS image_file_read(ConfigEntry *entry, VOID **bufferp, UINTN *sizep) {
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE handle = NULL;
+        _c_cleanup_(CFreePoolP) EFI_FILE_INFO *info = NULL;
+        _c_cleanup_(CFreePoolP) VOID *buffer = NULL;
+        UINTN size;
+        UINTN n;
+        EFI_STATUS r;
+
+        if (!entry->root)
+                return EFI_NOT_FOUND;
+
+        r = uefi_call_wrapper(entry->root->Open, 5, entry->root, &handle, entry->file_path, EFI_FILE_MODE_READ, 0ULL);
+        if (EFI_ERROR(r))
+                return r;
+
+        info = LibFileInfo(handle);
+        if (!info)
+                return EFI_LOAD_ERROR;
+        size = info->FileSize;
+
+        buffer = AllocatePool(size);
+        if (!buffer)
+                return EFI_OUT_OF_RESOURCES;
+
+        n = size;
+        r = uefi_call_wrapper(handle->Read, 3, handle, &n, buffer);
+        if (EFI_ERROR(r))
+                return r;
+        if (n != size)
+                return EFI_LOAD_ERROR;
+
+        *bufferp = buffer;
+        *sizep = size;
+        buffer = NULL;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS image_start(Config *config, EFI_HANDLE parent_image, ConfigEntry *entry) {
         _c_cleanup_(CFreePoolP) EFI_DEVICE_PATH *path = NULL;
+        _c_cleanup_(CFreePoolP) VOID *file_buffer = NULL;
+        UINTN file_size = 0;
+        BootHandoff handoff = {};
         EFI_HANDLE image;
+        UINT64 time_load;
         EFI_STATUS r;
 
         if (entry->boot_count > 0) {
-                r = image_set_boot_count(root_dir, entry, entry->boot_count - 1);
+                r = image_set_boot_count(config, entry, entry->boot_count - 1);
                 if (EFI_ERROR(r)) {
                         Print(L"Error updating boot count of %s: %r", entry->file_path, r);
                         uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
@@ -1032,12 +1492,17 @@ static EFI_STATUS image_start(EFI_FILE_HANDLE root_dir, EFI_HANDLE parent_image,
                 return EFI_INVALID_PARAMETER;
         }
 
-        r = uefi_call_wrapper(BS->LoadImage, 6, FALSE, parent_image, path, NULL, 0, &image);
+        /* if it cannot be read here, the firmware reads it from the path */
+        if (entry->flags & ENTRY_HANDOFF)
+                image_file_read(entry, &file_buffer, &file_size);
+
+        r = uefi_call_wrapper(BS->LoadImage, 6, FALSE, parent_image, path, file_buffer, file_size, &image);
         if (EFI_ERROR(r)) {
                 Print(L"Error loading %s: %r", entry->file_path, r);
                 uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
                 return r;
         }
+        time_load = timer_usec();
 
         if (entry->options_edit) {
                 EFI_LOADED_IMAGE *loaded_image;
@@ -1045,7 +1510,7 @@ static EFI_STATUS image_start(EFI_FILE_HANDLE root_dir, EFI_HANDLE parent_image,
                 r = uefi_call_wrapper(BS->OpenProtocol, 6, image, &LoadedImageProtocol, (VOID **)&loaded_image,
                                         parent_image, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
                 if (EFI_ERROR(r)) {
-                        Print(L"Error getting LoadedImageProtocol handle: %r", entry->file_path, r);
+                        Print(L"Error getting LoadedImageProtocol handle of %s: %r", entry->file_path, r);
                         uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
                         goto finish;
                 }
@@ -1054,8 +1519,26 @@ static EFI_STATUS image_start(EFI_FILE_HANDLE root_dir, EFI_HANDLE parent_image,
                 loaded_image->LoadOptionsSize = (StrLen(loaded_image->LoadOptions)+1) * sizeof(CHAR16);
         }
 
+        if (entry->flags & ENTRY_HANDOFF) {
+                image_handoff_init(config, entry, &handoff, time_load);
+                handoff.file_buffer = file_buffer;
+                handoff.file_size = file_size;
+                r = uefi_call_wrapper(BS->InstallProtocolInterface, 4, &image, (EFI_GUID *)&boot_handoff_guid,
+                                      EFI_NATIVE_INTERFACE, &handoff);
+                if (EFI_ERROR(r)) {
+                        Print(L"Error installing the boot handoff of %s: %r", entry->file_path, r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        goto finish;
+                }
+        }
+
+        config_publish_times(config, time_load);
+        handoff.time_start_image = timer_usec();
         r = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
 
+        if (entry->flags & ENTRY_HANDOFF)
+                uefi_call_wrapper(BS->UninstallProtocolInterface, 3, image, (EFI_GUID *)&boot_handoff_guid, &handoff);
+
 finish:
         uefi_call_wrapper(BS->UnloadImage, 1, image);
 
@@ -1063,17 +1546,11 @@ finish:
 }
 
 static EFI_STATUS reboot_into_firmware(VOID) {
-        CHAR8 *b;
-        UINTN size;
-        UINT64 osind;
+        UINT64 osind = 0;
         EFI_STATUS r;
 
-        osind = EFI_OS_INDICATIONS_BOOT_TO_FW_UI;
-
-        r = efivar_get(NULL, L"OsIndications", &b, &size);
-        if (!EFI_ERROR(r))
-                osind |= (UINT64)*b;
-        FreePool(b);
+        efivar_get_int(NULL, L"OsIndications", &osind);
+        osind |= EFI_OS_INDICATIONS_BOOT_TO_FW_UI;
 
         r = efivar_set(NULL, L"OsIndications", (CHAR8 *)&osind, sizeof(UINT64), TRUE);
         if (EFI_ERROR(r))
@@ -1085,24 +1562,72 @@ static EFI_STATUS reboot_into_firmware(VOID) {
         return r;
 }
 
+/* Releases everything found by a scan; the config can be filled again afterwards. */
 static VOID config_free(Config *config) {
         for (UINTN i = 0; i < config->n_entries; i++)
-                config_entry_free(config->entries[i]);
-        FreePool(config->entries);
+                FreePool(config->entries[i].options_edit);
+
+        arena_free(&config->arena);
+        config->entries = NULL;
+        config->n_entries = 0;
+        config->n_entries_allocated = 0;
+        config->idx_default = -1;
+        config->probed = FALSE;
+}
+
+/*
+ * Entries which are never selected by default: other loaders on any volume,
+ * org.bus1 images on additional ESPs, and firmware setup. Probing them may
+ * open the root of every filesystem, so this only runs when the menu is
+ * shown or a hotkey is looked up.
+ */
+static VOID config_add_well_known(Config *config) {
+        static const struct {
+                CHAR16 *release;
+                CHAR16 key;
+                CHAR16 *file_path;
+        } loaders[] = {
+                { L"windows", 'w', L"\\EFI\\Microsoft\\Boot\\bootmgfw.efi" },
+                { L"shell", 's', L"\\shell" EFI_MACHINE_TYPE_NAME ".efi" },
+                { L"osx", 'a', L"\\System\\Library\\CoreServices\\boot.efi" },
+        };
+        UINTN first;
+        UINT64 osind;
+
+        if (config->probed)
+                return;
+        config->probed = TRUE;
+
+        first = config->n_entries;
+        for (UINTN i = 1; i < config->volumes.n_volumes; i++)
+                config_entry_add_linux(config, &config->volumes.volumes[i], ENTRY_EDITOR, FALSE);
+        config_sort_entries(config, first);
+
+        /* add the first match of every loader to the end of the list */
+        for (UINTN i = 0; i < C_ARRAY_SIZE(loaders); i++)
+                for (UINTN k = 0; k < config->volumes.n_volumes; k++)
+                        if (config_entry_add_file(config, &config->volumes.volumes[k],
+                                                  loaders[i].release, loaders[i].key, loaders[i].file_path,
+                                                  NULL, -1, 0) == EFI_SUCCESS)
+                                break;
+
+        if (efivar_get_int(NULL, L"OsIndicationsSupported", &osind) == EFI_SUCCESS &&
+            (osind & EFI_OS_INDICATIONS_BOOT_TO_FW_UI))
+                config_entry_add_call(config, L"firmware", reboot_into_firmware);
 }
 
 EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
-        CHAR8 *b;
-        UINTN size;
-        _c_cleanup_(CCloseP) EFI_FILE_HANDLE root_dir = NULL;
         Config config = {
                 .idx_default = -1,
         };
+        _c_cleanup_(CFreePoolP) CHAR16 *fast_path = NULL;
         BOOLEAN menu = FALSE;
+        BOOLEAN key_pressed;
         UINT64 key;
         EFI_STATUS r;
 
         InitializeLib(image, sys_table);
+        config.time_entry = timer_usec();
         r = uefi_call_wrapper(BS->OpenProtocol, 6, image, &LoadedImageProtocol, (VOID **)&config.loaded_image,
                               image, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
         if (EFI_ERROR(r)) {
@@ -1111,35 +1636,63 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                 return r;
         }
 
-        root_dir = LibOpenRoot(config.loaded_image->DeviceHandle);
-        if (!root_dir) {
+        r = volumes_init(&config.volumes, config.loaded_image->DeviceHandle);
+        if (EFI_ERROR(r)) {
+                Print(L"Error listing filesystems: %r ", r);
+                uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                return r;
+        }
+
+        if (!volume_root(&config.volumes, &config.volumes.volumes[0])) {
+                r = EFI_LOAD_ERROR;
                 Print(L"Unable to open root directory: %r ", r);
                 uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
-                return EFI_LOAD_ERROR;
+                volumes_free(&config.volumes);
+                return r;
         }
 
+        /* nobody is watching, boot the newest entry without scanning and probing everything */
+        r = console_key_read(&key, FALSE);
+        if (EFI_ERROR(r)) {
+                r = config_entry_add_linux_fast(&config);
+                config.time_scan = timer_usec();
+                if (!EFI_ERROR(r)) {
+                        ConfigEntry *entry;
+
+                        config.time_menu = config.time_scan;
+                        config.menu_shown = FALSE;
+
+                        entry = &config.entries[config.idx_default];
+                        uefi_call_wrapper(BS->SetWatchdogTimer, 4, 60, 0x10000, 0, NULL);
+                        r = image_start(&config, image, entry);
+
+                        /* the image returned or failed, fall back to the full scan */
+                        fast_path = StrDuplicate(entry->file_path);
+                        graphics_mode(FALSE);
+                }
+
+                config_free(&config);
+
+                key_pressed = FALSE;
+        } else
+                key_pressed = TRUE;
+
         /* scan /EFI/org.bus1/ directory */
-        config_entry_add_linux(&config, root_dir);
+        config_entry_add_linux(&config, &config.volumes.volumes[0], ENTRY_EDITOR|ENTRY_AUTOSELECT, TRUE);
+        config.time_scan = timer_usec();
 
         /* sort entries by release string */
-        config_sort_entries(&config);
-
-        /* check for some well-known files, add them to the end of the list */
-        config_entry_add_file(&config, config.loaded_image->DeviceHandle, root_dir,
-                              L"windows", 'w', L"\\EFI\\Microsoft\\Boot\\bootmgfw.efi", NULL,
-                              -1, 0);
-        config_entry_add_file(&config, config.loaded_image->DeviceHandle, root_dir,
-                              L"shell", 's', L"\\shell" EFI_MACHINE_TYPE_NAME ".efi", NULL,
-                              -1, 0);
-        config_entry_add_osx(&config);
-
-        if (efivar_get(NULL, L"OsIndicationsSupported", &b, &size) == EFI_SUCCESS) {
-                UINT64 osind = (UINT64)*b;
-
-                if (osind & EFI_OS_INDICATIONS_BOOT_TO_FW_UI)
-                        config_entry_add_call(&config, L"firmware", reboot_into_firmware);
-                FreePool(b);
-        }
+        config_sort_entries(&config, 0);
+        config.time_sort = timer_usec();
+
+        config_default_entry_select(&config);
+
+        if (!key_pressed)
+                key_pressed = !EFI_ERROR(console_key_read(&key, FALSE));
+
+        /* other loaders are only needed if we cannot boot the default right away */
+        if (key_pressed || config.idx_default == -1)
+                config_add_well_known(&config);
 
         if (config.n_entries == 0) {
                 Print(L"No loader found on the system. Exiting.");
@@ -1147,10 +1700,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                 goto finish;
         }
 
-        config_default_entry_select(&config);
-
-        r = console_key_read(&key, FALSE);
-        if (!EFI_ERROR(r)) {
+        if (key_pressed) {
                 INT16 idx;
 
                 /* find matching key in config entries */
@@ -1166,10 +1716,20 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                 menu = TRUE;
         }
 
+        /* do not try the entry which just failed on the fast path a second time */
+        if (fast_path && config.entries[config.idx_default].file_path &&
+            StrCmp(config.entries[config.idx_default].file_path, fast_path) == 0)
+                menu = TRUE;
+
         for (;;) {
                 ConfigEntry *entry;
 
-                entry = config.entries[config.idx_default];
+                if (menu)
+                        config_add_well_known(&config);
+
+                entry = &config.entries[config.idx_default];
+                config.time_menu = timer_usec();
+                config.menu_shown = menu;
                 if (menu) {
                         if (!menu_run(&config, &entry))
                                 break;
@@ -1182,7 +1742,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                 }
 
                 uefi_call_wrapper(BS->SetWatchdogTimer, 4, 60, 0x10000, 0, NULL);
-                r = image_start(root_dir, image, entry);
+                r = image_start(&config, image, entry);
                 if (EFI_ERROR(r)) {
                         graphics_mode(FALSE);
                         Print(L"\nFailed to execute %s (%s): %r\n", entry->release, entry->file_path, r);
@@ -1198,6 +1758,7 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
 finish:
         uefi_call_wrapper(BS->CloseProtocol, 4, image, &LoadedImageProtocol, image, NULL);
         config_free(&config);
+        volumes_free(&config.volumes);
 
         return r;
 }
@@ -0,0 +1,85 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/disk.h"
+#include "shared/util.h"
+#include "volume.h"
+
+/*
+ * List all filesystems once, with the one we were loaded from first. Listing
+ * handles does not touch the media; roots are only opened when something is
+ * looked up on a volume.
+ */
+EFI_STATUS volumes_init(VolumeInventory *inventory, EFI_HANDLE boot_device) {
+        _c_cleanup_(CFreePoolP) EFI_HANDLE *handles = NULL;
+        UINTN n_handles = 0;
+        EFI_STATUS r;
+
+        ZeroMem(inventory, sizeof(VolumeInventory));
+
+        r = LibLocateHandle(ByProtocol, &FileSystemProtocol, NULL, &n_handles, &handles);
+        if (EFI_ERROR(r))
+                n_handles = 0;
+
+        inventory->volumes = AllocateZeroPool((n_handles + 1) * sizeof(Volume));
+        if (!inventory->volumes)
+                return EFI_OUT_OF_RESOURCES;
+
+        inventory->volumes[inventory->n_volumes++].device = boot_device;
+        for (UINTN i = 0; i < n_handles; i++) {
+                if (handles[i] == boot_device)
+                        continue;
+
+                inventory->volumes[inventory->n_volumes++].device = handles[i];
+        }
+
+        return EFI_SUCCESS;
+}
+
+/* The root is opened at the first call and kept open, a failure is remembered as well. */
+EFI_FILE_HANDLE volume_root(VolumeInventory *inventory, Volume *volume) {
+        if (!volume->root_opened) {
+                volume->root = LibOpenRoot(volume->device);
+                volume->root_opened = TRUE;
+                inventory->n_roots_opened++;
+        }
+
+        return volume->root;
+}
+
+/* The GPT disk GUID, read at the first call like the root; empty if there is none. */
+const CHAR16 *volume_disk_uuid(Volume *volume) {
+        if (!volume->disk_uuid_read) {
+                if (disk_get_disk_uuid(volume->device, volume->disk_uuid) != EFI_SUCCESS)
+                        volume->disk_uuid[0] = '\0';
+                volume->disk_uuid_read = TRUE;
+        }
+
+        return volume->disk_uuid;
+}
+
+VOID volumes_free(VolumeInventory *inventory) {
+        for (UINTN i = 0; i < inventory->n_volumes; i++)
+                CCloseP(&inventory->volumes[i].root);
+
+        FreePool(inventory->volumes);
+        ZeroMem(inventory, sizeof(VolumeInventory));
+}
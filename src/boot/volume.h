@@ -0,0 +1,36 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+typedef struct {
+        EFI_HANDLE device;
+        EFI_FILE_HANDLE root;
+        BOOLEAN root_opened;
+        CHAR16 disk_uuid[37];
+        BOOLEAN disk_uuid_read;
+} Volume;
+
+typedef struct {
+        Volume *volumes;
+        UINTN n_volumes;
+        UINTN n_roots_opened;
+} VolumeInventory;
+
+EFI_STATUS volumes_init(VolumeInventory *inventory, EFI_HANDLE boot_device);
+EFI_FILE_HANDLE volume_root(VolumeInventory *inventory, Volume *volume);
+const CHAR16 *volume_disk_uuid(Volume *volume);
+VOID volumes_free(VolumeInventory *inventory);
@@ -0,0 +1,59 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Facts the boot manager already knows about the image it starts. They are
+ * installed as a protocol on the image handle before StartImage() and stay
+ * valid until it returns. The stub uses them instead of finding them out
+ * again. Without the protocol, e.g. when the firmware started the image, it
+ * falls back to its own discovery. Later versions only append fields; a
+ * consumer checks the size against the fields it knows.
+ */
+#define BOOT_HANDOFF_PROTOCOL_GUID \
+        { 0xf1bb64c6, 0xec9c, 0x4441, { 0xb8, 0xc4, 0xd5, 0xb7, 0xde, 0xa7, 0x31, 0xed } }
+
+#define BOOT_HANDOFF_VERSION    1
+
+enum {
+        /* the directory of the image holds <release>.extra.d directories */
+        BOOT_HANDOFF_ADDONS     = 1ULL << 0,
+};
+
+typedef struct {
+        UINT32 version;
+        UINT32 size;
+        UINT64 flags;
+        /* path of the image on its volume, as it was loaded */
+        CHAR16 *file_path;
+        /* GUID of the disk with the image's partition, empty if unknown */
+        CHAR16 disk_uuid[37];
+        /* the -bootN suffix of the file name, -1 without */
+        INT64 boot_count;
+        /* calibrated tick rate of timer_usec(), 0 if unknown */
+        UINT64 timer_freq;
+        /* the boot manager's timeline in timer_usec() microseconds */
+        UINT64 time_entry;
+        UINT64 time_scan;
+        UINT64 time_sort;
+        UINT64 time_menu;
+        UINT64 time_load_image;
+        UINT64 time_start_image;
+        /* the image file, as read for LoadImage(); NULL if the firmware read it itself */
+        VOID *file_buffer;
+        UINT64 file_size;
+} BootHandoff;
@@ -0,0 +1,282 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/lz4.h"
+
+/*
+ * Decoder for the LZ4 frame format, as written by "lz4 --content-size".
+ * The content size is required, it is the size of the allocation the data
+ * is decompressed into. Checksums are skipped; the compressed data is part
+ * of the signed image.
+ */
+
+#define LZ4_FRAME_MAGIC         0x184D2204
+#define LZ4_FLG_VERSION_MASK    0xc0
+#define LZ4_FLG_VERSION         0x40
+#define LZ4_FLG_BLOCK_CHECKSUM  0x10
+#define LZ4_FLG_CONTENT_SIZE    0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID         0x01
+#define LZ4_BLOCK_UNCOMPRESSED  0x80000000U
+#define LZ4_MIN_MATCH           4
+
+typedef struct {
+        UINT8 flags;
+        UINT64 content_size;
+        UINTN header_size;
+} Lz4Frame;
+
+static UINT32 read_le32(const UINT8 *p) {
+        return (UINT32)p[0] | (UINT32)p[1] << 8 | (UINT32)p[2] << 16 | (UINT32)p[3] << 24;
+}
+
+static EFI_STATUS frame_parse(const UINT8 *src, UINTN src_size, Lz4Frame *frame) {
+        UINTN n = 4 + 2 + 1;                    /* magic, FLG, BD and the header checksum */
+
+        if (src_size < n || read_le32(src) != LZ4_FRAME_MAGIC)
+                return EFI_UNSUPPORTED;
+
+        frame->flags = src[4];
+        if ((frame->flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION)
+                return EFI_UNSUPPORTED;
+
+        if (!(frame->flags & LZ4_FLG_CONTENT_SIZE))
+                return EFI_UNSUPPORTED;
+
+        n += 8;
+        if (frame->flags & LZ4_FLG_DICT_ID)
+                n += 4;
+        if (src_size < n)
+                return EFI_LOAD_ERROR;
+
+        frame->content_size = read_le32(src + 6) | (UINT64)read_le32(src + 10) << 32;
+        frame->header_size = n;
+        return EFI_SUCCESS;
+}
+
+EFI_STATUS lz4_frame_size(const UINT8 *src, UINTN src_size, UINT64 *size) {
+        Lz4Frame frame;
+        EFI_STATUS r;
+
+        r = frame_parse(src, src_size, &frame);
+        if (EFI_ERROR(r))
+                return r;
+
+        *size = frame.content_size;
+        return EFI_SUCCESS;
+}
+
+static inline VOID copy8(UINT8 *dst, const UINT8 *src) {
+        __builtin_memcpy(dst, src, 8);
+}
+
+/*
+ * Decode one block; matches may reach back into earlier blocks of the same
+ * output. With partial, decoding stops when the output is full.
+ */
+static EFI_STATUS block_decompress(const UINT8 *ip, const UINT8 *iend,
+                                   UINT8 *dst, UINT8 **opp, UINT8 *oend, BOOLEAN partial) {
+        UINT8 *op = *opp;
+
+        while (ip < iend) {
+                UINTN token = *ip++;
+                UINTN len = token >> 4;
+                UINTN offset;
+                const UINT8 *match;
+
+                /*
+                 * Short literals followed by a short match are the common case; with
+                 * enough room on both sides copy them with fixed-size moves.
+                 */
+                if (len < 15 && (token & 15) < 15 &&
+                    (UINTN)(iend - ip) >= 16 + 2 && (UINTN)(oend - op) >= 16 + 24) {
+                        copy8(op, ip);
+                        copy8(op + 8, ip + 8);
+                        ip += len;
+                        op += len;
+
+                        offset = ip[0] | ip[1] << 8;
+                        match = op - offset;
+                        if (offset >= 8 && offset <= (UINTN)(op - dst)) {
+                                ip += 2;
+                                copy8(op, match);
+                                copy8(op + 8, match + 8);
+                                copy8(op + 16, match + 16);
+                                op += (token & 15) + LZ4_MIN_MATCH;
+                                continue;
+                        }
+
+                        /* fall back for short offsets, the literals are already in place */
+                        len = 0;
+                }
+
+                if (len == 15) {
+                        UINT8 b;
+
+                        do {
+                                if (ip == iend)
+                                        return EFI_LOAD_ERROR;
+                                b = *ip++;
+                                len += b;
+                        } while (b == 255);
+                }
+
+                if (len > (UINTN)(iend - ip))
+                        return EFI_LOAD_ERROR;
+
+                if (len > (UINTN)(oend - op)) {
+                        if (!partial)
+                                return EFI_LOAD_ERROR;
+
+                        CopyMem(op, (VOID *)ip, oend - op);
+                        op = oend;
+                        break;
+                }
+
+                /* copy in words as long as there is room to overshoot */
+                if ((UINTN)(iend - ip) >= 8 && len <= (UINTN)(iend - ip) - 8 &&
+                    (UINTN)(oend - op) >= 8 && len <= (UINTN)(oend - op) - 8) {
+                        for (UINTN i = 0; i < len; i += 8)
+                                copy8(op + i, ip + i);
+                } else
+                        CopyMem(op, (VOID *)ip, len);
+                ip += len;
+                op += len;
+
+                /* the last sequence has no match */
+                if (ip == iend)
+                        break;
+
+                if (iend - ip < 2)
+                        return EFI_LOAD_ERROR;
+                offset = ip[0] | ip[1] << 8;
+                ip += 2;
+                if (offset == 0 || offset > (UINTN)(op - dst))
+                        return EFI_LOAD_ERROR;
+
+                len = token & 15;
+                if (len == 15) {
+                        UINT8 b;
+
+                        do {
+                                if (ip == iend)
+                                        return EFI_LOAD_ERROR;
+                                b = *ip++;
+                                len += b;
+                        } while (b == 255);
+                }
+                len += LZ4_MIN_MATCH;
+
+                if (len > (UINTN)(oend - op)) {
+                        if (!partial)
+                                return EFI_LOAD_ERROR;
+                        len = oend - op;
+                }
+
+                match = op - offset;
+                if (offset >= 8 && (UINTN)(oend - op) >= 8 && len <= (UINTN)(oend - op) - 8) {
+                        for (UINTN i = 0; i < len; i += 8)
+                                copy8(op + i, match + i);
+                } else {
+                        /* overlapping matches repeat the last offset bytes */
+                        for (UINTN i = 0; i < len; i++)
+                                op[i] = match[i];
+                }
+                op += len;
+
+                if (partial && op == oend)
+                        break;
+        }
+
+        *opp = op;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS frame_decompress(const UINT8 *src, UINTN src_size, UINT8 *dst, UINTN dst_size, BOOLEAN partial) {
+        const UINT8 *ip, *iend = src + src_size;
+        UINT8 *op = dst, *oend = dst + dst_size;
+        Lz4Frame frame;
+        EFI_STATUS r;
+
+        r = frame_parse(src, src_size, &frame);
+        if (EFI_ERROR(r))
+                return r;
+
+        if (partial ? frame.content_size < dst_size : frame.content_size != dst_size)
+                return EFI_BUFFER_TOO_SMALL;
+
+        ip = src + frame.header_size;
+
+        for (;;) {
+                UINT32 block;
+                UINTN len;
+
+                if (iend - ip < 4)
+                        return EFI_LOAD_ERROR;
+                block = read_le32(ip);
+                ip += 4;
+
+                if (block == 0)
+                        break;
+
+                len = block & ~LZ4_BLOCK_UNCOMPRESSED;
+                if (len > (UINTN)(iend - ip))
+                        return EFI_LOAD_ERROR;
+
+                if (block & LZ4_BLOCK_UNCOMPRESSED) {
+                        UINTN n = len;
+
+                        if (n > (UINTN)(oend - op)) {
+                                if (!partial)
+                                        return EFI_LOAD_ERROR;
+                                n = oend - op;
+                        }
+                        CopyMem(op, (VOID *)ip, n);
+                        op += n;
+                } else {
+                        r = block_decompress(ip, ip + len, dst, &op, oend, partial);
+                        if (EFI_ERROR(r))
+                                return r;
+                }
+                ip += len;
+
+                if (partial && op == oend)
+                        return EFI_SUCCESS;
+
+                if (frame.flags & LZ4_FLG_BLOCK_CHECKSUM)
+                        ip += 4;
+                if (ip > iend)
+                        return EFI_LOAD_ERROR;
+        }
+
+        if (op != oend)
+                return EFI_LOAD_ERROR;
+
+        return EFI_SUCCESS;
+}
+
+EFI_STATUS lz4_frame_decompress(const UINT8 *src, UINTN src_size, UINT8 *dst, UINTN dst_size) {
+        return frame_decompress(src, src_size, dst, dst_size, FALSE);
+}
+
+/* Decompress only the first dst_size bytes, to look at a header before allocating. */
+EFI_STATUS lz4_frame_peek(const UINT8 *src, UINTN src_size, UINT8 *dst, UINTN dst_size) {
+        return frame_decompress(src, src_size, dst, dst_size, TRUE);
+}
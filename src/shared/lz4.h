@@ -0,0 +1,21 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+EFI_STATUS lz4_frame_size(const UINT8 *src, UINTN src_size, UINT64 *size);
+EFI_STATUS lz4_frame_decompress(const UINT8 *src, UINTN src_size, UINT8 *dst, UINTN dst_size);
+EFI_STATUS lz4_frame_peek(const UINT8 *src, UINTN src_size, UINT8 *dst, UINTN dst_size);
@@ -68,87 +68,170 @@ struct PeSectionHeader {
         UINT32  Characteristics;
 } __attribute__((packed));
 
-EFI_STATUS pefile_locate_sections(EFI_FILE_HANDLE handle,
-                                  CHAR8 **sections, UINTN n_sections,
-                                  UINTN *addrs, UINTN *offsets, UINTN *sizes) {
-        struct DosFileHeader dos;
-        uint8_t magic[4];
-        struct PeFileHeader pe;
+/* The headers of all images we care about fit into the first page. */
+#define PEFILE_HEADER_SIZE      4096
+#define PEFILE_SECTIONS_MAX     96
+
+static BOOLEAN section_name_match(const UINT8 name[8], const CHAR8 *section) {
         UINTN len;
-        EFI_STATUS r;
 
-        /* MS-DOS stub */
-        len = sizeof(dos);
-        r = uefi_call_wrapper(handle->Read, 3, handle, &len, &dos);
-        if (EFI_ERROR(r))
-                return r;
+        len = strlena(section);
+        if (len > 8)
+                return FALSE;
 
-        if (len != sizeof(dos))
-                return EFI_INVALID_PARAMETER;
+        if (CompareMem(name, section, len) != 0)
+                return FALSE;
 
-        if (CompareMem(dos.Magic, "MZ", 2) != 0)
-                return EFI_INVALID_PARAMETER;
+        /* Do not match ".linux" against ".linuxz"; names are NUL-padded. */
+        return len == 8 || name[len] == '\0';
+}
 
-        r = uefi_call_wrapper(handle->SetPosition, 2, handle, dos.ExeHeader);
-        if (EFI_ERROR(r))
-                return r;
+EFI_STATUS pefile_parse_sections(const UINT8 *buf, UINTN *len,
+                                 CHAR8 **sections, UINTN n_sections,
+                                 UINTN *addrs, UINTN *offsets, UINTN *sizes, UINTN *raw_sizes) {
+        const struct DosFileHeader *dos;
+        const struct PeFileHeader *pe;
+        const struct PeSectionHeader *sect;
+        UINTN pe_offset;
+        UINTN sect_offset;
+        UINTN needed;
 
-        /* PE header */
-        len = sizeof(magic);
-        r = uefi_call_wrapper(handle->Read, 3, handle, &len, &magic);
-        if (EFI_ERROR(r))
-                return r;
+        /* MS-DOS stub */
+        if (*len < sizeof(struct DosFileHeader))
+                return EFI_INVALID_PARAMETER;
 
-        if (len != sizeof(magic))
+        dos = (const struct DosFileHeader *)buf;
+        if (CompareMem(dos->Magic, "MZ", 2) != 0)
                 return EFI_INVALID_PARAMETER;
 
-        if (CompareMem(magic, "PE\0\0", 2) != 0)
+        if (dos->ExeHeader > 0x10000)
                 return EFI_INVALID_PARAMETER;
 
-        len = sizeof(pe);
-        r = uefi_call_wrapper(handle->Read, 3, handle, &len, &pe);
-        if (EFI_ERROR(r))
-                return r;
+        /* PE header; if we do not see it yet, ask for the largest possible header */
+        pe_offset = dos->ExeHeader + 4;
+        needed = pe_offset + sizeof(struct PeFileHeader);
+        if (*len < needed) {
+                *len = needed + 0xffff + PEFILE_SECTIONS_MAX * sizeof(struct PeSectionHeader);
+                return EFI_BUFFER_TOO_SMALL;
+        }
 
-        if (len != sizeof(pe))
+        if (CompareMem(buf + dos->ExeHeader, "PE\0\0", 4) != 0)
                 return EFI_INVALID_PARAMETER;
 
+        pe = (const struct PeFileHeader *)(buf + pe_offset);
+
         /* PE32+ Subsystem type */
-        if (pe.Machine != PE_HEADER_MACHINE_X64 &&
-            pe.Machine != PE_HEADER_MACHINE_I386)
+        if (pe->Machine != PE_HEADER_MACHINE_X64 &&
+            pe->Machine != PE_HEADER_MACHINE_I386)
                 return EFI_INVALID_PARAMETER;
 
-        if (pe.NumberOfSections > 96)
+        if (pe->NumberOfSections > PEFILE_SECTIONS_MAX)
                 return EFI_INVALID_PARAMETER;
 
         /* the sections start directly after the headers */
-        r = uefi_call_wrapper(handle->SetPosition, 2, handle, dos.ExeHeader + sizeof(magic) + sizeof(pe) + pe.SizeOfOptionalHeader);
-        if (EFI_ERROR(r))
-                return r;
-
-        for (UINTN i = 0; i < pe.NumberOfSections; i++) {
-                struct PeSectionHeader sect;
-
-                len = sizeof(sect);
-                r = uefi_call_wrapper(handle->Read, 3, handle, &len, &sect);
-                if (EFI_ERROR(r))
-                        return r;
-
-                if (len != sizeof(sect))
-                        return EFI_INVALID_PARAMETER;
+        sect_offset = pe_offset + sizeof(struct PeFileHeader) + pe->SizeOfOptionalHeader;
+        needed = sect_offset + pe->NumberOfSections * sizeof(struct PeSectionHeader);
+        if (*len < needed) {
+                *len = needed;
+                return EFI_BUFFER_TOO_SMALL;
+        }
 
+        sect = (const struct PeSectionHeader *)(buf + sect_offset);
+        for (UINTN i = 0; i < pe->NumberOfSections; i++, sect++) {
                 for (UINTN n = 0; n < n_sections; n++) {
-                        if (CompareMem(sect.Name, sections[n], strlena(sections[n])) != 0)
+                        if (!section_name_match(sect->Name, sections[n]))
                                 continue;
 
                         if (addrs)
-                                addrs[n] = (UINTN)sect.VirtualAddress;
+                                addrs[n] = (UINTN)sect->VirtualAddress;
                         if (offsets)
-                                offsets[n] = (UINTN)sect.PointerToRawData;
+                                offsets[n] = (UINTN)sect->PointerToRawData;
                         if (sizes)
-                                sizes[n] = (UINTN)sect.VirtualSize;
+                                sizes[n] = (UINTN)sect->VirtualSize;
+                        if (raw_sizes)
+                                raw_sizes[n] = (UINTN)sect->SizeOfRawData;
                 }
         }
 
-        return 0;
+        return EFI_SUCCESS;
+}
+
+EFI_STATUS pefile_locate_sections(EFI_FILE_HANDLE handle,
+                                  CHAR8 **sections, UINTN n_sections,
+                                  UINTN *addrs, UINTN *offsets, UINTN *sizes, UINTN *raw_sizes,
+                                  UINTN *n_reads) {
+        UINT8 header[PEFILE_HEADER_SIZE];
+        _c_cleanup_(CFreePoolP) UINT8 *buf = NULL;
+        UINTN len;
+        UINTN size;
+        UINTN reads = 0;
+        EFI_STATUS r;
+
+        /* one read for the DOS, PE and section headers of a regular image */
+        len = sizeof(header);
+        r = uefi_call_wrapper(handle->Read, 3, handle, &len, header);
+        reads++;
+        if (EFI_ERROR(r))
+                goto finish;
+
+        size = len;
+        r = pefile_parse_sections(header, &size, sections, n_sections, addrs, offsets, sizes, raw_sizes);
+        if (r != EFI_BUFFER_TOO_SMALL)
+                goto finish;
+
+        /* a short read means we already hit the end of the file */
+        if (len < sizeof(header)) {
+                r = EFI_INVALID_PARAMETER;
+                goto finish;
+        }
+
+        /* the section table does not fit; grow the buffer once and read the rest */
+        buf = AllocatePool(size);
+        if (!buf) {
+                r = EFI_OUT_OF_RESOURCES;
+                goto finish;
+        }
+
+        CopyMem(buf, header, len);
+        size -= len;
+        r = uefi_call_wrapper(handle->Read, 3, handle, &size, buf + len);
+        reads++;
+        if (EFI_ERROR(r))
+                goto finish;
+
+        len += size;
+        r = pefile_parse_sections(buf, &len, sections, n_sections, addrs, offsets, sizes, raw_sizes);
+        if (r == EFI_BUFFER_TOO_SMALL)
+                r = EFI_INVALID_PARAMETER;
+
+finish:
+        if (n_reads)
+                *n_reads += reads;
+
+        return r;
+}
+
+/* The firmware maps the headers and every section at the image base; nothing is read from the file. */
+EFI_STATUS pefile_image_sections(const VOID *base, UINTN size,
+                                 CHAR8 **sections, UINTN n_sections,
+                                 UINTN *addrs, UINTN *sizes) {
+        UINTN len = size;
+        EFI_STATUS r;
+
+        r = pefile_parse_sections(base, &len, sections, n_sections, addrs, NULL, sizes, NULL);
+        if (r == EFI_BUFFER_TOO_SMALL)
+                return EFI_INVALID_PARAMETER;
+        if (EFI_ERROR(r))
+                return r;
+
+        /* the callers dereference the sections in place */
+        for (UINTN n = 0; n < n_sections; n++) {
+                if (sizes[n] == 0)
+                        continue;
+
+                if (addrs[n] > size || sizes[n] > size - addrs[n])
+                        return EFI_INVALID_PARAMETER;
+        }
+
+        return EFI_SUCCESS;
 }
@@ -16,6 +16,13 @@
   along with bus1; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+EFI_STATUS pefile_parse_sections(const UINT8 *buf, UINTN *len,
+                                 CHAR8 **sections, UINTN n_sections,
+                                 UINTN *addrs, UINTN *offsets, UINTN *sizes, UINTN *raw_sizes);
 EFI_STATUS pefile_locate_sections(EFI_FILE_HANDLE handle,
                                   CHAR8 **sections, UINTN n_sections,
-                                  UINTN *addrs, UINTN *offsets, UINTN *sizes);
+                                  UINTN *addrs, UINTN *offsets, UINTN *sizes, UINTN *raw_sizes,
+                                  UINTN *n_reads);
+EFI_STATUS pefile_image_sections(const VOID *base, UINTN size,
+                                 CHAR8 **sections, UINTN n_sections,
+                                 UINTN *addrs, UINTN *sizes);
@@ -0,0 +1,147 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/sha256.h"
+
+/* FIPS 180-4 */
+static const UINT32 k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline UINT32 ror(UINT32 v, UINTN n) {
+        return (v >> n) | (v << (32 - n));
+}
+
+static VOID sha256_block(UINT32 state[8], const UINT8 *p) {
+        UINT32 w[64];
+        UINT32 a, b, c, d, e, f, g, h;
+
+        for (UINTN i = 0; i < 16; i++)
+                w[i] = (UINT32)p[i*4] << 24 | (UINT32)p[i*4+1] << 16 | (UINT32)p[i*4+2] << 8 | p[i*4+3];
+
+        for (UINTN i = 16; i < 64; i++) {
+                UINT32 s0 = ror(w[i-15], 7) ^ ror(w[i-15], 18) ^ (w[i-15] >> 3);
+                UINT32 s1 = ror(w[i-2], 17) ^ ror(w[i-2], 19) ^ (w[i-2] >> 10);
+
+                w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (UINTN i = 0; i < 64; i++) {
+                UINT32 t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                UINT32 t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+}
+
+VOID sha256_init(Sha256 *ctx) {
+        static const UINT32 init[8] = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+
+        CopyMem(ctx->state, init, sizeof(init));
+        ctx->length = 0;
+        ctx->n_buffer = 0;
+}
+
+VOID sha256_update(Sha256 *ctx, const VOID *data, UINTN size) {
+        const UINT8 *p = data;
+
+        ctx->length += size;
+
+        if (ctx->n_buffer > 0) {
+                UINTN n = sizeof(ctx->buffer) - ctx->n_buffer;
+
+                if (n > size)
+                        n = size;
+                CopyMem(ctx->buffer + ctx->n_buffer, p, n);
+                ctx->n_buffer += n;
+                p += n;
+                size -= n;
+
+                if (ctx->n_buffer < sizeof(ctx->buffer))
+                        return;
+
+                sha256_block(ctx->state, ctx->buffer);
+                ctx->n_buffer = 0;
+        }
+
+        /* hash whole blocks in place */
+        for (; size >= sizeof(ctx->buffer); p += sizeof(ctx->buffer), size -= sizeof(ctx->buffer))
+                sha256_block(ctx->state, p);
+
+        CopyMem(ctx->buffer, p, size);
+        ctx->n_buffer = size;
+}
+
+VOID sha256_final(Sha256 *ctx, UINT8 digest[SHA256_DIGEST_SIZE]) {
+        UINT64 bits = ctx->length * 8;
+
+        ctx->buffer[ctx->n_buffer++] = 0x80;
+        if (ctx->n_buffer > sizeof(ctx->buffer) - 8) {
+                ZeroMem(ctx->buffer + ctx->n_buffer, sizeof(ctx->buffer) - ctx->n_buffer);
+                sha256_block(ctx->state, ctx->buffer);
+                ctx->n_buffer = 0;
+        }
+
+        ZeroMem(ctx->buffer + ctx->n_buffer, sizeof(ctx->buffer) - 8 - ctx->n_buffer);
+        for (UINTN i = 0; i < 8; i++)
+                ctx->buffer[56 + i] = bits >> (56 - 8 * i);
+        sha256_block(ctx->state, ctx->buffer);
+
+        for (UINTN i = 0; i < 8; i++) {
+                digest[i*4] = ctx->state[i] >> 24;
+                digest[i*4+1] = ctx->state[i] >> 16;
+                digest[i*4+2] = ctx->state[i] >> 8;
+                digest[i*4+3] = ctx->state[i];
+        }
+}
@@ -0,0 +1,30 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct {
+        UINT32 state[8];
+        UINT64 length;
+        UINT8 buffer[64];
+        UINTN n_buffer;
+} Sha256;
+
+VOID sha256_init(Sha256 *ctx);
+VOID sha256_update(Sha256 *ctx, const VOID *data, UINTN size);
+VOID sha256_final(Sha256 *ctx, UINT8 digest[SHA256_DIGEST_SIZE]);
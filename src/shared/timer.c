@@ -0,0 +1,122 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/util.h"
+#include "shared/timer.h"
+
+static const EFI_GUID timer_guid = BOOT_EFI_VARIABLE_GUID;
+
+#if defined(__x86_64__) || defined(__i386__)
+static UINT64 ticks_read(VOID) {
+        UINT32 lo, hi;
+
+        asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+        return ((UINT64)hi << 32) | lo;
+}
+
+/*
+ * The TSC rate is not architecturally known, count it across a stall. A
+ * stall is only as exact as the firmware's delay loop and timer tick; over
+ * 10ms their error stays well below one percent.
+ */
+#define TICKS_CALIBRATE_USEC    (10 * 1000)
+
+static UINT64 ticks_freq(VOID) {
+        UINT64 ticks;
+
+        ticks = ticks_read();
+        uefi_call_wrapper(BS->Stall, 1, TICKS_CALIBRATE_USEC);
+        return (ticks_read() - ticks) * (1000 * 1000 / TICKS_CALIBRATE_USEC);
+}
+#elif defined(__aarch64__)
+static UINT64 ticks_read(VOID) {
+        UINT64 ticks;
+
+        asm volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+        return ticks;
+}
+
+static UINT64 ticks_freq(VOID) {
+        UINT64 freq;
+
+        asm volatile ("mrs %0, cntfrq_el0" : "=r" (freq));
+        return freq;
+}
+#else
+static UINT64 ticks_read(VOID) {
+        return 0;
+}
+
+static UINT64 ticks_freq(VOID) {
+        return 0;
+}
+#endif
+
+static UINT64 freq;
+
+/* The calibrated rate, or 0 if there is no usable counter. */
+UINT64 timer_frequency(VOID) {
+        if (freq == 0) {
+                if (efivar_get_int(&timer_guid, L"TimerFrequency", &freq) != EFI_SUCCESS || freq == 0) {
+                        freq = ticks_freq();
+                        if (freq == 0)
+                                return 0;
+
+                        efivar_set(&timer_guid, L"TimerFrequency", (CHAR8 *)&freq, sizeof(freq), FALSE);
+                }
+        }
+
+        return freq;
+}
+
+/* Take over a rate another image already calibrated. */
+VOID timer_frequency_set(UINT64 f) {
+        freq = f;
+}
+
+/*
+ * Microseconds since the counter was reset, which is close enough to the
+ * firmware handoff. Returns 0 if there is no usable counter. The calibrated
+ * rate is handed from the boot manager to the stub in a volatile variable,
+ * or with timer_frequency_set(), so only the first image pays for the
+ * calibration.
+ */
+UINT64 timer_usec(VOID) {
+        UINT64 ticks;
+
+        ticks = ticks_read();
+
+        if (timer_frequency() == 0)
+                return 0;
+
+        return (ticks / freq) * 1000 * 1000 + (ticks % freq) * 1000 * 1000 / freq;
+}
+
+/* Store a timestamp or a counter as a decimal string, readable by the OS at runtime. */
+EFI_STATUS timer_publish(CHAR16 *name, UINT64 usec) {
+        CHAR16 s[32];
+
+        if (usec == 0)
+                return EFI_NOT_FOUND;
+
+        SPrint(s, sizeof(s), L"%ld", usec);
+        return efivar_set(&timer_guid, name, (CHAR8 *)s, (StrLen(s) + 1) * sizeof(CHAR16), FALSE);
+}
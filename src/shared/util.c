@@ -22,7 +22,11 @@
 
 static const EFI_GUID EfiGlobalVariableGuid = EFI_GLOBAL_VARIABLE;
 
+/* Values which fit in here are read with a single call and no pool allocation. */
+#define EFIVAR_PROBE_SIZE       64
+
 EFI_STATUS efivar_get(const EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size) {
+        UINT8 probe[EFIVAR_PROBE_SIZE];
         CHAR8 *buf;
         UINTN l;
         EFI_STATUS r;
@@ -30,28 +34,113 @@ EFI_STATUS efivar_get(const EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer, UINT
         if (!vendor)
                 vendor = &EfiGlobalVariableGuid;
 
-        l = sizeof(CHAR16 *) * EFI_MAXIMUM_VARIABLE_SIZE;
-        buf = AllocatePool(l);
-        if (!buf)
-                return EFI_OUT_OF_RESOURCES;
+        l = sizeof(probe);
+        r = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, NULL, &l, probe);
+        if (r == EFI_BUFFER_TOO_SMALL) {
+                /* the firmware returned the size we need */
+                buf = AllocatePool(l);
+                if (!buf)
+                        return EFI_OUT_OF_RESOURCES;
+
+                r = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, NULL, &l, buf);
+                if (EFI_ERROR(r)) {
+                        FreePool(buf);
+                        return r;
+                }
+        } else if (!EFI_ERROR(r)) {
+                buf = AllocatePool(l ? l : 1);
+                if (!buf)
+                        return EFI_OUT_OF_RESOURCES;
+                CopyMem(buf, probe, l);
+        } else
+                return r;
+
+        *buffer = buf;
+        if (size)
+                *size = l;
+
+        return EFI_SUCCESS;
+}
+
+/*
+ * Integer variables like SecureBoot or OsIndicationsSupported are read many
+ * times during one boot; remember their values, and that a variable does
+ * not exist.
+ */
+typedef struct {
+        EFI_GUID vendor;
+        CHAR16 name[32];
+        EFI_STATUS status;
+        UINT64 value;
+} EfivarCacheEntry;
+
+static EfivarCacheEntry efivar_cache[16];
+static UINTN efivar_cache_n;
+
+static EfivarCacheEntry *efivar_cache_find(const EFI_GUID *vendor, CHAR16 *name) {
+        for (UINTN i = 0; i < efivar_cache_n; i++)
+                if (CompareMem(&efivar_cache[i].vendor, vendor, sizeof(EFI_GUID)) == 0 &&
+                    StrCmp(efivar_cache[i].name, name) == 0)
+                        return &efivar_cache[i];
+
+        return NULL;
+}
+
+/* Read a little-endian integer variable of 1 to 8 bytes. */
+EFI_STATUS efivar_get_int(const EFI_GUID *vendor, CHAR16 *name, UINT64 *value) {
+        EfivarCacheEntry *entry;
+        UINT8 buf[sizeof(UINT64)];
+        UINTN l = sizeof(buf);
+        UINT64 v = 0;
+        EFI_STATUS r;
+
+        if (!vendor)
+                vendor = &EfiGlobalVariableGuid;
+
+        entry = efivar_cache_find(vendor, name);
+        if (entry) {
+                if (!EFI_ERROR(entry->status))
+                        *value = entry->value;
+                return entry->status;
+        }
 
         r = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, NULL, &l, buf);
-        if (!EFI_ERROR(r)) {
-                *buffer = buf;
-                if (size)
-                        *size = l;
-        } else
-                FreePool(buf);
-        return r;
+        if (r == EFI_BUFFER_TOO_SMALL || (!EFI_ERROR(r) && l == 0))
+                r = EFI_INVALID_PARAMETER;
+
+        if (!EFI_ERROR(r))
+                for (UINTN i = 0; i < l; i++)
+                        v |= (UINT64)buf[i] << (i * 8);
+
+        /* other errors may be transient, or say nothing about the variable; ask again next time */
+        if ((!EFI_ERROR(r) || r == EFI_NOT_FOUND) &&
+            efivar_cache_n < C_ARRAY_SIZE(efivar_cache) && StrLen(name) < C_ARRAY_SIZE(efivar_cache[0].name)) {
+                entry = &efivar_cache[efivar_cache_n++];
+                CopyMem(&entry->vendor, vendor, sizeof(EFI_GUID));
+                StrCpy(entry->name, name);
+                entry->status = r;
+                entry->value = v;
+        }
+
+        if (EFI_ERROR(r))
+                return r;
 
+        *value = v;
+        return EFI_SUCCESS;
 }
 
 EFI_STATUS efivar_set(const EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size, BOOLEAN persistent) {
+        EfivarCacheEntry *entry;
         UINT32 flags;
 
         if (!vendor)
                 vendor = &EfiGlobalVariableGuid;
 
+        /* the next read goes to the firmware again */
+        entry = efivar_cache_find(vendor, name);
+        if (entry)
+                *entry = efivar_cache[--efivar_cache_n];
+
         flags = EFI_VARIABLE_BOOTSERVICE_ACCESS|EFI_VARIABLE_RUNTIME_ACCESS;
         if (persistent)
                 flags |= EFI_VARIABLE_NON_VOLATILE;
@@ -79,25 +168,20 @@ INTN StrniCmp(const CHAR16 *s1, const CHAR16 *s2, UINTN n) {
 }
 
 /* Validate file name to match the embedded release string */
-EFI_STATUS loader_filename_parse(EFI_FILE_HANDLE f, const CHAR16 *release, UINTN release_len, INTN *boot_countp) {
-        EFI_FILE_INFO *info;
+EFI_STATUS loader_filename_parse(const CHAR16 *name, const CHAR16 *release, UINTN release_len, INTN *boot_countp) {
         UINTN name_len;
         INTN boot_count = -1;
 
-        info = LibFileInfo(f);
-        if (!info)
-                return EFI_LOAD_ERROR;
-
-        name_len = StrLen(info->FileName);
+        name_len = StrLen(name);
         if (name_len < release_len + 4)
                 return EFI_INVALID_PARAMETER;
 
         /* Require .efi extension. */
-        if (StriCmp(info->FileName + name_len - 4, L".efi") != 0)
+        if (StriCmp(name + name_len - 4, L".efi") != 0)
                 return EFI_INVALID_PARAMETER;
 
         /* Require the file name to start with the release name. */
-        if (StrniCmp(info->FileName, release, release_len) != 0)
+        if (StrniCmp(name, release, release_len) != 0)
                 return EFI_INVALID_PARAMETER;
 
         /* Accept optional boot count extension. */
@@ -107,10 +191,10 @@ EFI_STATUS loader_filename_parse(EFI_FILE_HANDLE f, const CHAR16 *release, UINTN
                 if (name_len != release_len + 6 + 4)
                         return EFI_INVALID_PARAMETER;
 
-                if (StrniCmp(info->FileName + release_len, L"-boot", 5) != 0)
+                if (StrniCmp(name + release_len, L"-boot", 5) != 0)
                         return EFI_INVALID_PARAMETER;
 
-                c = info->FileName[release_len + 5];
+                c = name[release_len + 5];
                 if (c < '0' || c > '9')
                         return EFI_INVALID_PARAMETER;
 
@@ -123,43 +207,137 @@ EFI_STATUS loader_filename_parse(EFI_FILE_HANDLE f, const CHAR16 *release, UINTN
         return EFI_SUCCESS;
 }
 
-INTN file_read_str(EFI_FILE_HANDLE dir, CHAR16 *name, UINTN off, UINTN size, CHAR16 **str) {
-        EFI_FILE_HANDLE handle;
-        CHAR16 *buf;
-        UINTN buflen;
-        UINTN len;
-        EFI_STATUS r;
-
-        r = uefi_call_wrapper(dir->Open, 5, dir, &handle, name, EFI_FILE_MODE_READ, 0ULL);
-        if (EFI_ERROR(r))
-                return r;
+/*
+ * Fill all ranges from one open file, reading adjacent or overlapping ranges at once. Ranges
+ * are cut off at the end of the file; the callers zero their buffers, like the loader does
+ * for data past the end of a section.
+ */
+EFI_STATUS file_read_ranges(EFI_FILE_HANDLE handle, UINT64 file_size, FileRange *ranges, UINTN n_ranges,
+                            UINTN *n_reads) {
+        UINTN reads = 0;
+        EFI_STATUS r = EFI_SUCCESS;
+
+        /* a zero-length array is undefined */
+        if (n_ranges == 0)
+                return EFI_SUCCESS;
+
+        FileRange *sorted[n_ranges];
+        UINTN n_sorted = 0;
+
+        /* sort by offset; there are only a handful of ranges */
+        for (UINTN i = 0; i < n_ranges; i++) {
+                UINTN k;
+
+                if (ranges[i].offset >= file_size)
+                        ranges[i].size = 0;
+                else if (ranges[i].size > file_size - ranges[i].offset)
+                        ranges[i].size = file_size - ranges[i].offset;
+                if (ranges[i].size == 0)
+                        continue;
+
+                for (k = n_sorted; k > 0 && sorted[k-1]->offset > ranges[i].offset; k--)
+                        sorted[k] = sorted[k-1];
+                sorted[k] = &ranges[i];
+                n_sorted++;
+        }
 
-        if (size == 0) {
-                EFI_FILE_INFO *info;
+        for (UINTN i = 0; i < n_sorted;) {
+                UINTN start = sorted[i]->offset;
+                UINTN end = sorted[i]->offset + sorted[i]->size;
+                UINTN k;
+                _c_cleanup_(CFreePoolP) UINT8 *buf = NULL;
+                UINT8 *p;
+                UINTN len;
+
+                /* merge all ranges which touch or overlap the current span */
+                for (k = i + 1; k < n_sorted && sorted[k]->offset <= end; k++)
+                        if (end < sorted[k]->offset + sorted[k]->size)
+                                end = sorted[k]->offset + sorted[k]->size;
+
+                if (k == i + 1)
+                        p = sorted[i]->buf;
+                else {
+                        buf = AllocatePool(end - start);
+                        if (!buf)
+                                return EFI_OUT_OF_RESOURCES;
+                        p = buf;
+                }
 
-                info = LibFileInfo(handle);
-                buflen = info->FileSize;
-                FreePool(info);
-        } else
-                buflen = size ;
+                r = uefi_call_wrapper(handle->SetPosition, 2, handle, start);
+                if (EFI_ERROR(r))
+                        break;
 
-        if (off > 0) {
-                r = uefi_call_wrapper(handle->SetPosition, 2, handle, off);
+                len = end - start;
+                r = uefi_call_wrapper(handle->Read, 3, handle, &len, p);
+                reads++;
                 if (EFI_ERROR(r))
-                        return r;
+                        break;
+
+                /* everything up to the end of the file must be there */
+                if (len != end - start) {
+                        r = EFI_INVALID_PARAMETER;
+                        break;
+                }
+
+                if (buf)
+                        for (; i < k; i++)
+                                CopyMem(sorted[i]->buf, buf + (sorted[i]->offset - start), sorted[i]->size);
+
+                i = k;
+        }
+
+        if (n_reads)
+                *n_reads += reads;
+
+        return r;
+}
+
+VOID dir_iterator_init(DirIterator *iter, EFI_FILE_HANDLE handle) {
+        ZeroMem(iter, sizeof(DirIterator));
+        iter->handle = handle;
+}
+
+/*
+ * Return the next directory record in a buffer which is reused for the
+ * whole walk. A record which does not fit grows the buffer; the firmware
+ * does not advance the position in that case, so the read is retried.
+ */
+EFI_STATUS dir_iterator_next(DirIterator *iter, EFI_FILE_INFO **infop) {
+        UINTN size;
+        EFI_STATUS r;
+
+        if (!iter->info) {
+                iter->size = SIZE_OF_EFI_FILE_INFO + 256 * sizeof(CHAR16);
+                iter->info = AllocatePool(iter->size);
+                if (!iter->info)
+                        return EFI_OUT_OF_RESOURCES;
         }
 
-        buf = AllocatePool(buflen + sizeof(CHAR16));
-        r = uefi_call_wrapper(handle->Read, 3, handle, &buflen, buf);
-        if (!EFI_ERROR(r)) {
-                buf[buflen / sizeof(CHAR16)] = '\0';
-                *str = buf;
-                len = buflen / sizeof(CHAR16);
-        } else {
-                len = r;
-                FreePool(buf);
+        for (;;) {
+                size = iter->size;
+                r = uefi_call_wrapper(iter->handle->Read, 3, iter->handle, &size, iter->info);
+                if (r != EFI_BUFFER_TOO_SMALL)
+                        break;
+
+                FreePool(iter->info);
+                iter->size = size;
+                iter->info = AllocatePool(iter->size);
+                if (!iter->info)
+                        return EFI_OUT_OF_RESOURCES;
         }
 
-        uefi_call_wrapper(handle->Close, 1, handle);
-        return len;
+        if (EFI_ERROR(r))
+                return r;
+
+        /* a zero-sized read marks the end of the directory */
+        if (size == 0)
+                return EFI_NOT_FOUND;
+
+        *infop = iter->info;
+        return EFI_SUCCESS;
+}
+
+VOID dir_iterator_free(DirIterator *iter) {
+        FreePool(iter->info);
+        ZeroMem(iter, sizeof(DirIterator));
 }
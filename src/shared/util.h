@@ -19,6 +19,10 @@
 #include <efi.h>
 #include <efilib.h>
 
+/* vendor of all variables owned by boot-efi */
+#define BOOT_EFI_VARIABLE_GUID \
+        { 0x7e63102e, 0xb2f6, 0x4245, { 0x84, 0xf8, 0x52, 0x87, 0x81, 0xc1, 0xab, 0xe6 } }
+
 #define C_ARRAY_SIZE(x) (sizeof(x)/sizeof((x)[0]))
 #define _c_cleanup_(_x) __attribute__((__cleanup__(_x)))
 
@@ -41,10 +45,28 @@ static inline const CHAR16 *yes_no(BOOLEAN b) {
         return b ? L"yes" : L"no";
 }
 
+typedef struct {
+        UINTN offset;
+        UINTN size;
+        VOID *buf;
+} FileRange;
+
+typedef struct {
+        EFI_FILE_HANDLE handle;
+        EFI_FILE_INFO *info;
+        UINTN size;
+} DirIterator;
+
 EFI_STATUS efivar_set(const EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size, BOOLEAN persistent);
 EFI_STATUS efivar_get(const EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size);
+EFI_STATUS efivar_get_int(const EFI_GUID *vendor, CHAR16 *name, UINT64 *value);
 
 INTN StrniCmp(const CHAR16 *s1, const CHAR16 *s2, UINTN n);
 
-EFI_STATUS loader_filename_parse(EFI_FILE_HANDLE f, const CHAR16 *release, UINTN release_len, INTN *boot_countp);
-INTN file_read_str(EFI_FILE_HANDLE dir, CHAR16 *name, UINTN off, UINTN size, CHAR16 **str);
+EFI_STATUS loader_filename_parse(const CHAR16 *name, const CHAR16 *release, UINTN release_len, INTN *boot_countp);
+EFI_STATUS file_read_ranges(EFI_FILE_HANDLE handle, UINT64 file_size, FileRange *ranges, UINTN n_ranges,
+                            UINTN *n_reads);
+
+VOID dir_iterator_init(DirIterator *iter, EFI_FILE_HANDLE handle);
+EFI_STATUS dir_iterator_next(DirIterator *iter, EFI_FILE_INFO **infop);
+VOID dir_iterator_free(DirIterator *iter);
@@ -0,0 +1,403 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shared/util.h"
+#include "shared/sha256.h"
+#include "initrd.h"
+
+/* the synchronous fallback reads and hashes in chunks of this size */
+#define INITRD_READ_CHUNK       (16 * 1024 * 1024)
+
+static VOID initrd_stream_free(InitrdStream *stream) {
+        if (stream->token.Event)
+                uefi_call_wrapper(BS->CloseEvent, 1, stream->token.Event);
+
+        if (stream->addr)
+                uefi_call_wrapper(BS->FreePages, 2, stream->addr, EFI_SIZE_TO_PAGES(stream->size));
+
+        ZeroMem(stream, sizeof(*stream));
+}
+
+static EFI_STATUS initrd_header_check(const InitrdHeader *hdr, UINTN header_size, UINT64 file_size) {
+        if (header_size < sizeof(InitrdHeader) ||
+            CompareMem(hdr->magic, INITRD_HEADER_MAGIC, sizeof(INITRD_HEADER_MAGIC)) != 0 ||
+            hdr->version != INITRD_HEADER_VERSION)
+                return EFI_UNSUPPORTED;
+
+        if (hdr->size == 0 || hdr->offset > file_size || hdr->size > file_size - hdr->offset)
+                return EFI_LOAD_ERROR;
+
+        return EFI_SUCCESS;
+}
+
+/*
+ * The boot manager read the whole image file for LoadImage() and hands it to
+ * us; take the initrd from that copy instead of reading it a second time. It
+ * is passed to the kernel in place. With verify, it must match the digest in
+ * the signed header, the copy comes from the unsigned handoff.
+ */
+EFI_STATUS initrd_file_find(const VOID *header, UINTN header_size, const VOID *file, UINT64 file_size,
+                            BOOLEAN verify, UINTN *addr, UINTN *size) {
+        const InitrdHeader *hdr = header;
+        UINT8 digest[SHA256_DIGEST_SIZE];
+        const UINT8 *initrd;
+        Sha256 sha;
+        EFI_STATUS r;
+
+        r = initrd_header_check(hdr, header_size, file_size);
+        if (EFI_ERROR(r))
+                return r;
+
+        initrd = (const UINT8 *)file + hdr->offset;
+        if (verify) {
+                sha256_init(&sha);
+                sha256_update(&sha, initrd, hdr->size);
+                sha256_final(&sha, digest);
+                if (CompareMem(digest, hdr->sha256, sizeof(digest)) != 0)
+                        return EFI_SECURITY_VIOLATION;
+        }
+
+        *addr = (UINTN)initrd;
+        *size = hdr->size;
+        return EFI_SUCCESS;
+}
+
+/*
+ * Allocate the final location of the initrd below max_addr and start reading
+ * it. If the file system supports asynchronous reads, the read runs until
+ * initrd_stream_finish() is called. Returns EFI_UNSUPPORTED if the header
+ * section is not understood.
+ */
+EFI_STATUS initrd_stream_start(InitrdStream *stream, EFI_FILE_HANDLE handle, const VOID *header, UINTN header_size,
+                               UINT64 file_size, UINTN max_addr) {
+        const InitrdHeader *hdr = header;
+        EFI_STATUS r;
+
+        ZeroMem(stream, sizeof(*stream));
+
+        r = initrd_header_check(hdr, header_size, file_size);
+        if (EFI_ERROR(r))
+                return r;
+
+        if (hdr->size > max_addr)
+                return EFI_OUT_OF_RESOURCES;
+
+        stream->handle = handle;
+        stream->size = hdr->size;
+        CopyMem(stream->sha256, hdr->sha256, sizeof(stream->sha256));
+
+        stream->addr = max_addr;
+        r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData,
+                              EFI_SIZE_TO_PAGES(stream->size), &stream->addr);
+        if (EFI_ERROR(r)) {
+                stream->addr = 0;
+                return r;
+        }
+
+        r = uefi_call_wrapper(handle->SetPosition, 2, handle, hdr->offset);
+        if (EFI_ERROR(r)) {
+                initrd_stream_free(stream);
+                return r;
+        }
+
+        if (handle->Revision < EFI_FILE_PROTOCOL_REVISION2)
+                return EFI_SUCCESS;
+
+        r = uefi_call_wrapper(BS->CreateEvent, 5, 0, 0, NULL, NULL, &stream->token.Event);
+        if (EFI_ERROR(r)) {
+                stream->token.Event = NULL;
+                return EFI_SUCCESS;
+        }
+
+        stream->token.Buffer = (VOID *)(UINTN)stream->addr;
+        stream->token.BufferSize = stream->size;
+        r = uefi_call_wrapper(handle->ReadEx, 2, handle, &stream->token);
+        if (EFI_ERROR(r)) {
+                /* fall back to synchronous reads from the start */
+                uefi_call_wrapper(BS->CloseEvent, 1, stream->token.Event);
+                stream->token.Event = NULL;
+                return uefi_call_wrapper(handle->SetPosition, 2, handle, hdr->offset);
+        }
+
+        stream->pending = TRUE;
+        return EFI_SUCCESS;
+}
+
+/*
+ * Give up on a started read, on every error path before initrd_stream_finish().
+ * The file protocol cannot cancel a request, so a queued one is waited for;
+ * the firmware would otherwise complete it into a token on a stack that is
+ * long gone. Does nothing for a stream which was never started.
+ */
+VOID initrd_stream_abort(InitrdStream *stream) {
+        if (stream->pending) {
+                UINTN index;
+
+                uefi_call_wrapper(BS->WaitForEvent, 3, 1, &stream->token.Event, &index);
+                stream->pending = FALSE;
+        }
+
+        initrd_stream_free(stream);
+}
+
+/* Complete the read; with verify, the initrd must match the digest in the signed header. */
+EFI_STATUS initrd_stream_finish(InitrdStream *stream, BOOLEAN verify, UINTN *addr, UINTN *size) {
+        UINT8 *buf = (UINT8 *)(UINTN)stream->addr;
+        UINT8 digest[SHA256_DIGEST_SIZE];
+        Sha256 sha;
+        EFI_STATUS r;
+
+        sha256_init(&sha);
+
+        if (stream->pending) {
+                UINTN index;
+
+                r = uefi_call_wrapper(BS->WaitForEvent, 3, 1, &stream->token.Event, &index);
+                stream->pending = FALSE;
+                if (!EFI_ERROR(r))
+                        r = stream->token.Status;
+                if (!EFI_ERROR(r) && stream->token.BufferSize != stream->size)
+                        r = EFI_LOAD_ERROR;
+                if (EFI_ERROR(r))
+                        goto fail;
+
+                if (verify)
+                        sha256_update(&sha, buf, stream->size);
+        } else {
+                for (UINTN pos = 0; pos < stream->size;) {
+                        UINTN n = stream->size - pos;
+
+                        if (n > INITRD_READ_CHUNK)
+                                n = INITRD_READ_CHUNK;
+
+                        r = uefi_call_wrapper(stream->handle->Read, 3, stream->handle, &n, buf + pos);
+                        if (!EFI_ERROR(r) && n == 0)
+                                r = EFI_LOAD_ERROR;
+                        if (EFI_ERROR(r))
+                                goto fail;
+
+                        /* hash while the chunk is still in the cache */
+                        if (verify)
+                                sha256_update(&sha, buf + pos, n);
+                        pos += n;
+                }
+        }
+
+        if (verify) {
+                sha256_final(&sha, digest);
+                if (CompareMem(digest, stream->sha256, sizeof(digest)) != 0) {
+                        r = EFI_SECURITY_VIOLATION;
+                        goto fail;
+                }
+        }
+
+        if (stream->token.Event)
+                uefi_call_wrapper(BS->CloseEvent, 1, stream->token.Event);
+
+        *addr = stream->addr;
+        *size = stream->size;
+        return EFI_SUCCESS;
+
+fail:
+        initrd_stream_free(stream);
+        return r;
+}
+
+/* the kernel unpacks concatenated cpio archives which start at 4 byte boundaries */
+#define INITRD_ADDON_ALIGN(n)   (((n) + 3) & ~(UINT64)3)
+
+static const struct {
+        VENDOR_DEVICE_PATH vendor;
+        EFI_DEVICE_PATH end;
+} __attribute__((packed)) initrd_media_path = {
+        .vendor = {
+                .Header = { MEDIA_DEVICE_PATH, MEDIA_VENDOR_DP, { sizeof(VENDOR_DEVICE_PATH), 0 } },
+                .Guid = LINUX_EFI_INITRD_MEDIA_GUID,
+        },
+        .end = { END_DEVICE_PATH_TYPE, END_ENTIRE_DEVICE_PATH_SUBTYPE, { sizeof(EFI_DEVICE_PATH), 0 } },
+};
+
+static BOOLEAN addon_name_valid(const CHAR16 *name) {
+        UINTN len = StrLen(name);
+
+        return len > 5 && StriCmp((CHAR16 *)name + len - 5, L".cpio") == 0;
+}
+
+/*
+ * Open the cpio archives in the directory at path and keep the handles until
+ * the kernel asks for the initrd; they are sorted by name. A missing
+ * directory is not an error, the loader is left without add-ons.
+ */
+EFI_STATUS initrd_addons_open(InitrdLoader *loader, EFI_FILE_HANDLE root_dir, CHAR16 *path) {
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE dir = NULL;
+        DirIterator iter;
+        EFI_FILE_INFO *info;
+        EFI_STATUS r;
+
+        ZeroMem(loader, sizeof(*loader));
+
+        r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &dir, path, EFI_FILE_MODE_READ, 0ULL);
+        if (r == EFI_NOT_FOUND)
+                return EFI_SUCCESS;
+        if (EFI_ERROR(r))
+                return r;
+
+        dir_iterator_init(&iter, dir);
+        while ((r = dir_iterator_next(&iter, &info)) == EFI_SUCCESS) {
+                InitrdAddon addon;
+                UINTN i;
+
+                if (info->Attribute & EFI_FILE_DIRECTORY || info->FileSize == 0 || !addon_name_valid(info->FileName))
+                        continue;
+
+                if (loader->n_addons == INITRD_ADDONS_MAX) {
+                        r = EFI_OUT_OF_RESOURCES;
+                        break;
+                }
+
+                r = uefi_call_wrapper(dir->Open, 5, dir, &addon.handle, info->FileName, EFI_FILE_MODE_READ, 0ULL);
+                if (EFI_ERROR(r))
+                        break;
+
+                addon.name = StrDuplicate(info->FileName);
+                if (!addon.name) {
+                        uefi_call_wrapper(addon.handle->Close, 1, addon.handle);
+                        r = EFI_OUT_OF_RESOURCES;
+                        break;
+                }
+                addon.size = info->FileSize;
+
+                /* insert sorted, there are only a few */
+                for (i = loader->n_addons; i > 0 && StrCmp(loader->addons[i - 1].name, addon.name) > 0; i--)
+                        loader->addons[i] = loader->addons[i - 1];
+                loader->addons[i] = addon;
+                loader->n_addons++;
+        }
+        dir_iterator_free(&iter);
+
+        if (r != EFI_NOT_FOUND) {
+                initrd_loader_free(loader);
+                return r;
+        }
+
+        return EFI_SUCCESS;
+}
+
+static UINT64 initrd_loader_size(InitrdLoader *loader) {
+        UINT64 size = INITRD_ADDON_ALIGN(loader->initrd_size);
+
+        for (UINTN i = 0; i < loader->n_addons; i++)
+                size += INITRD_ADDON_ALIGN(loader->addons[i].size);
+
+        return size;
+}
+
+/* Called by the kernel with a buffer of the size returned by the first, empty call. */
+static EFI_STATUS EFIAPI initrd_load_file(INITRD_LOAD_FILE2_PROTOCOL *this, EFI_DEVICE_PATH *path, BOOLEAN boot_policy,
+                                          UINTN *size, VOID *buffer) {
+        InitrdLoader *loader = (InitrdLoader *)this;
+        UINT8 *buf = buffer;
+        UINT64 total;
+        UINTN pos;
+        EFI_STATUS r;
+
+        (VOID)path;
+
+        if (!this || !size)
+                return EFI_INVALID_PARAMETER;
+
+        if (boot_policy)
+                return EFI_UNSUPPORTED;
+
+        total = initrd_loader_size(loader);
+        if (total > (UINTN)-1)
+                return EFI_OUT_OF_RESOURCES;
+
+        if (!buf || *size < total) {
+                *size = total;
+                return EFI_BUFFER_TOO_SMALL;
+        }
+
+        CopyMem(buf, (VOID *)loader->initrd, loader->initrd_size);
+        pos = loader->initrd_size;
+        ZeroMem(buf + pos, INITRD_ADDON_ALIGN(pos) - pos);
+        pos = INITRD_ADDON_ALIGN(pos);
+
+        /* the archives are read straight into the kernel's buffer */
+        for (UINTN i = 0; i < loader->n_addons; i++) {
+                InitrdAddon *addon = &loader->addons[i];
+                UINTN end = pos + addon->size;
+
+                r = uefi_call_wrapper(addon->handle->SetPosition, 2, addon->handle, 0ULL);
+                if (EFI_ERROR(r))
+                        return r;
+
+                while (pos < end) {
+                        UINTN n = end - pos;
+
+                        r = uefi_call_wrapper(addon->handle->Read, 3, addon->handle, &n, buf + pos);
+                        if (EFI_ERROR(r))
+                                return r;
+
+                        /* the file shrank since it was opened */
+                        if (n == 0)
+                                return EFI_END_OF_FILE;
+
+                        pos += n;
+                }
+
+                ZeroMem(buf + pos, INITRD_ADDON_ALIGN(pos) - pos);
+                pos = INITRD_ADDON_ALIGN(pos);
+        }
+
+        *size = total;
+        return EFI_SUCCESS;
+}
+
+/* Install the device path and the LoadFile2 protocol the kernel looks for. */
+EFI_STATUS initrd_loader_install(InitrdLoader *loader, const VOID *initrd, UINTN initrd_size) {
+        EFI_GUID load_file2_guid = EFI_LOAD_FILE2_PROTOCOL_GUID;
+
+        loader->load_file.LoadFile = initrd_load_file;
+        loader->initrd = initrd;
+        loader->initrd_size = initrd_size;
+
+        return uefi_call_wrapper(BS->InstallMultipleProtocolInterfaces, 6, &loader->handle,
+                                 &DevicePathProtocol, &initrd_media_path,
+                                 &load_file2_guid, &loader->load_file,
+                                 NULL);
+}
+
+VOID initrd_loader_free(InitrdLoader *loader) {
+        EFI_GUID load_file2_guid = EFI_LOAD_FILE2_PROTOCOL_GUID;
+
+        if (loader->handle)
+                uefi_call_wrapper(BS->UninstallMultipleProtocolInterfaces, 6, loader->handle,
+                                  &DevicePathProtocol, &initrd_media_path,
+                                  &load_file2_guid, &loader->load_file,
+                                  NULL);
+
+        for (UINTN i = 0; i < loader->n_addons; i++) {
+                uefi_call_wrapper(loader->addons[i].handle->Close, 1, loader->addons[i].handle);
+                FreePool(loader->addons[i].name);
+        }
+
+        ZeroMem(loader, sizeof(*loader));
+}
@@ -0,0 +1,109 @@
+#pragma once
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "shared/sha256.h"
+
+/*
+ * Contents of the .initrdh section: the initrd is not a loaded section but
+ * trails the image file. LoadImage() reads it along with the rest of the
+ * file, to hash it, but does not copy it into the loaded image. Started by
+ * the boot manager, the stub finds it in the file buffer the boot manager
+ * passed to LoadImage(); otherwise it reads it from the file a second time,
+ * straight into the pages handed to the kernel.
+ */
+#define INITRD_HEADER_MAGIC     "bus1-rd"
+#define INITRD_HEADER_VERSION   1
+
+typedef struct {
+        CHAR8 magic[8];
+        UINT32 version;
+        UINT32 reserved;
+        UINT64 offset;                          /* file offset of the initrd */
+        UINT64 size;
+        UINT8 sha256[SHA256_DIGEST_SIZE];
+} __attribute__((packed)) InitrdHeader;
+
+typedef struct {
+        EFI_FILE_HANDLE handle;
+        EFI_FILE_IO_TOKEN token;
+        EFI_PHYSICAL_ADDRESS addr;
+        UINTN size;
+        UINT8 sha256[SHA256_DIGEST_SIZE];
+        BOOLEAN pending;
+        UINT64 time_start;
+} InitrdStream;
+
+EFI_STATUS initrd_file_find(const VOID *header, UINTN header_size, const VOID *file, UINT64 file_size,
+                            BOOLEAN verify, UINTN *addr, UINTN *size);
+EFI_STATUS initrd_stream_start(InitrdStream *stream, EFI_FILE_HANDLE handle, const VOID *header, UINTN header_size,
+                               UINT64 file_size, UINTN max_addr);
+EFI_STATUS initrd_stream_finish(InitrdStream *stream, BOOLEAN verify, UINTN *addr, UINTN *size);
+VOID initrd_stream_abort(InitrdStream *stream);
+
+/*
+ * The kernel's EFI stub looks for a LoadFile2 protocol on a vendor media
+ * device path with this GUID and lets it fill a buffer it allocates itself.
+ * It supersedes the ramdisk passed in the boot parameters, older kernels
+ * ignore it.
+ */
+#ifndef LINUX_EFI_INITRD_MEDIA_GUID
+#define LINUX_EFI_INITRD_MEDIA_GUID \
+        { 0x5568e427, 0x68fc, 0x4f3d, { 0xac, 0x74, 0xca, 0x55, 0x52, 0x31, 0xcc, 0x68 } }
+#endif
+
+/* only recent gnu-efi versions know it */
+#ifndef EFI_LOAD_FILE2_PROTOCOL_GUID
+#define EFI_LOAD_FILE2_PROTOCOL_GUID \
+        { 0x4006c0c1, 0xfcb3, 0x403e, { 0x99, 0x6d, 0x4a, 0x6c, 0x87, 0x24, 0xe0, 0x6d } }
+#endif
+
+#define INITRD_ADDONS_MAX       32
+
+struct _INITRD_LOAD_FILE2_PROTOCOL;
+
+typedef EFI_STATUS (EFIAPI *INITRD_LOAD_FILE2)(
+        struct _INITRD_LOAD_FILE2_PROTOCOL *This,
+        EFI_DEVICE_PATH *FilePath,
+        BOOLEAN BootPolicy,
+        UINTN *BufferSize,
+        VOID *Buffer
+);
+
+typedef struct _INITRD_LOAD_FILE2_PROTOCOL {
+        INITRD_LOAD_FILE2 LoadFile;
+} INITRD_LOAD_FILE2_PROTOCOL;
+
+typedef struct {
+        EFI_FILE_HANDLE handle;
+        CHAR16 *name;
+        UINT64 size;
+} InitrdAddon;
+
+/* The embedded initrd followed by cpio archives from the ESP, concatenated on demand. */
+typedef struct {
+        INITRD_LOAD_FILE2_PROTOCOL load_file;   /* first, the protocol is cast back to the loader */
+        EFI_HANDLE handle;
+        const UINT8 *initrd;
+        UINTN initrd_size;
+        InitrdAddon addons[INITRD_ADDONS_MAX];
+        UINTN n_addons;
+} InitrdLoader;
+
+EFI_STATUS initrd_addons_open(InitrdLoader *loader, EFI_FILE_HANDLE root_dir, CHAR16 *path);
+EFI_STATUS initrd_loader_install(InitrdLoader *loader, const VOID *initrd, UINTN initrd_size);
+VOID initrd_loader_free(InitrdLoader *loader);
@@ -22,8 +22,16 @@
 #include "linux.h"
 
 #define SETUP_MAGIC             0x53726448      /* "HdrS" */
+#define XLF_KERNEL_64                   (1 << 0)
+#define XLF_CAN_BE_LOADED_ABOVE_4G      (1 << 1)
+
+/* The boot_params "zero page", the image carries only the header part starting at setup_secs. */
 struct SetupHeader {
-        UINT8 boot_sector[0x01f1];
+        UINT8 boot_params[0x00c0];
+        UINT32 ext_ramdisk_image;
+        UINT32 ext_ramdisk_size;
+        UINT32 ext_cmd_line_ptr;
+        UINT8 boot_params_reserved[0x01f1 - 0x00cc];
         UINT8 setup_secs;
         UINT16 root_flags;
         UINT32 sys_size;
@@ -84,6 +92,125 @@ static inline VOID linux_efi_handover(EFI_HANDLE image, struct SetupHeader *setu
 }
 #endif
 
+/* The real-mode part in front of the protected-mode code; 0 setup sectors mean 4. */
+static UINTN linux_setup_size(const struct SetupHeader *setup) {
+        return ((UINTN)(setup->setup_secs ?: 4) + 1) * 512;
+}
+
+/*
+ * The 64-bit entry of a kernel with XLF_CAN_BE_LOADED_ABOVE_4G takes the
+ * boot parameters, the command line and the initrd at any address.
+ */
+static BOOLEAN linux_above_4g(struct SetupHeader *setup) {
+#ifdef __x86_64__
+        return setup->header == SETUP_MAGIC && setup->version >= 0x20c &&
+               (setup->xloadflags & (XLF_KERNEL_64|XLF_CAN_BE_LOADED_ABOVE_4G)) == (XLF_KERNEL_64|XLF_CAN_BE_LOADED_ABOVE_4G);
+#else
+        (VOID)setup;
+        return FALSE;
+#endif
+}
+
+/* The highest address the kernel accepts for the initrd. */
+UINTN linux_initrd_max(UINTN linux_addr) {
+        struct SetupHeader *setup = (struct SetupHeader *)linux_addr;
+
+        if (linux_above_4g(setup))
+                return ~(UINTN)0;
+
+        if (setup->header != SETUP_MAGIC || setup->version < 0x203 || setup->ramdisk_max == 0)
+                return 0x37ffffff;
+
+        return setup->ramdisk_max;
+}
+
+/*
+ * Allocate the location the bzImage with the given header is copied or
+ * decompressed to: the protected-mode code at pref_address with init_size
+ * bytes of room, so the kernel does not have to move itself out of the way
+ * of what follows it. If that address is taken, the code is aligned to
+ * kernel_alignment anywhere below 4G. Returns the address of the setup
+ * sectors, the protected-mode code follows them.
+ */
+EFI_STATUS linux_alloc(const VOID *header, UINTN image_size, UINTN *linux_addr) {
+        const struct SetupHeader *setup = header;
+        UINTN setup_size;
+        UINTN setup_pages;
+        UINTN code_size;
+        UINTN code_pages;
+        UINTN align;
+        UINTN pages;
+        EFI_PHYSICAL_ADDRESS base;
+        EFI_PHYSICAL_ADDRESS code;
+        EFI_PHYSICAL_ADDRESS start;
+        EFI_PHYSICAL_ADDRESS end;
+        EFI_STATUS r;
+
+        if (setup->signature != 0xAA55 || setup->header != SETUP_MAGIC ||
+            setup->version < 0x20b || !setup->relocatable_kernel)
+                return EFI_UNSUPPORTED;
+
+        setup_size = linux_setup_size(setup);
+        if (image_size <= setup_size)
+                return EFI_LOAD_ERROR;
+
+        code_size = image_size - setup_size;
+        if (code_size < setup->init_size)
+                code_size = setup->init_size;
+
+        /* the setup sectors go into the pages right below the code */
+        setup_pages = EFI_SIZE_TO_PAGES(setup_size);
+        code_pages = EFI_SIZE_TO_PAGES(code_size);
+
+        code = setup->pref_address;
+        if (code >= setup_pages * EFI_PAGE_SIZE && code + code_size <= 0xffffffff && (code & (EFI_PAGE_SIZE - 1)) == 0) {
+                base = code - setup_pages * EFI_PAGE_SIZE;
+                r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAddress, EfiLoaderData,
+                                        setup_pages + code_pages, &base);
+                if (!EFI_ERROR(r)) {
+                        *linux_addr = code - setup_size;
+                        return EFI_SUCCESS;
+                }
+        }
+
+        align = setup->kernel_alignment;
+        if (align < EFI_PAGE_SIZE || (align & (align - 1)) != 0)
+                align = EFI_PAGE_SIZE;
+
+        /* over-allocate by the alignment and return the pages around the aligned part */
+        pages = setup_pages + code_pages + align / EFI_PAGE_SIZE;
+        base = 0xffffffff;
+        r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData, pages, &base);
+        if (EFI_ERROR(r))
+                return r;
+
+        code = (base + setup_pages * EFI_PAGE_SIZE + align - 1) & ~((EFI_PHYSICAL_ADDRESS)align - 1);
+        start = code - setup_pages * EFI_PAGE_SIZE;
+        end = code + code_pages * EFI_PAGE_SIZE;
+        if (start > base)
+                uefi_call_wrapper(BS->FreePages, 2, base, (start - base) / EFI_PAGE_SIZE);
+        if (base + pages * EFI_PAGE_SIZE > end)
+                uefi_call_wrapper(BS->FreePages, 2, end, (base + pages * EFI_PAGE_SIZE - end) / EFI_PAGE_SIZE);
+
+        *linux_addr = code - setup_size;
+        return EFI_SUCCESS;
+}
+
+/* Pages below max for data which is not where the kernel can reach it. */
+static EFI_STATUS linux_copy_below(const VOID *data, UINTN size, UINTN max, UINTN *addr) {
+        EFI_PHYSICAL_ADDRESS pages = max;
+        EFI_STATUS r;
+
+        r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData,
+                                EFI_SIZE_TO_PAGES(size), &pages);
+        if (EFI_ERROR(r))
+                return r;
+
+        CopyMem((VOID *)(UINTN)pages, (VOID *)data, size);
+        *addr = pages;
+        return EFI_SUCCESS;
+}
+
 EFI_STATUS linux_exec(EFI_HANDLE *image,
                       CHAR8 *cmdline, UINTN cmdline_len,
                       UINTN linux_addr,
@@ -91,6 +218,9 @@ EFI_STATUS linux_exec(EFI_HANDLE *image,
         struct SetupHeader *image_setup;
         struct SetupHeader *boot_setup;
         EFI_PHYSICAL_ADDRESS addr;
+        UINTN cmdline_addr;
+        UINTN initrd_max;
+        BOOLEAN above_4g;
         EFI_STATUS r;
 
         image_setup = (struct SetupHeader *)(linux_addr);
@@ -100,31 +230,53 @@ EFI_STATUS linux_exec(EFI_HANDLE *image,
         if (image_setup->version < 0x20b || !image_setup->relocatable_kernel)
                 return EFI_LOAD_ERROR;
 
-        addr = 0x3fffffff;
+        /* code32_start is a 32-bit field, the kernel itself must be below 4G */
+        if ((UINT64)linux_addr > 0xffffffff)
+                return EFI_LOAD_ERROR;
+
+        above_4g = linux_above_4g(image_setup);
+
+        /* low memory is scarce, only kernels without the 64-bit entry need it */
+        addr = above_4g ? ~(EFI_PHYSICAL_ADDRESS)0 : 0x3fffffff;
         r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData,
                                 EFI_SIZE_TO_PAGES(0x4000), &addr);
         if (EFI_ERROR(r))
                 return r;
         boot_setup = (struct SetupHeader *)(UINTN)addr;
         ZeroMem(boot_setup, 0x4000);
-        CopyMem(boot_setup, image_setup, sizeof(struct SetupHeader));
+
+        /* only the setup header is taken from the image, the rest of the boot sector is not boot_params */
+        CopyMem(&boot_setup->setup_secs, &image_setup->setup_secs,
+                sizeof(struct SetupHeader) - __builtin_offsetof(struct SetupHeader, setup_secs));
         boot_setup->loader_id = 0xff;
 
-        boot_setup->code32_start = (UINT32)linux_addr + (image_setup->setup_secs+1) * 512;
+        boot_setup->code32_start = (UINT32)linux_addr + linux_setup_size(image_setup);
 
+        /* the command line is passed in place when the kernel can reach it */
         if (cmdline) {
-                addr = 0xA0000;
-                r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData,
-                                        EFI_SIZE_TO_PAGES(cmdline_len + 1), &addr);
+                cmdline_addr = (UINTN)cmdline;
+                if (!above_4g && (UINT64)cmdline_addr + cmdline_len > 0xffffffff) {
+                        r = linux_copy_below(cmdline, cmdline_len + 1, 0xffffffff, &cmdline_addr);
+                        if (EFI_ERROR(r))
+                                return r;
+                }
+
+                boot_setup->cmd_line_ptr = (UINT32)cmdline_addr;
+                boot_setup->ext_cmd_line_ptr = (UINT64)cmdline_addr >> 32;
+        }
+
+        /* same for the initrd; an initrd above the limit of older kernels is moved down */
+        initrd_max = linux_initrd_max(linux_addr);
+        if (initrd_size > 0 && initrd_addr + initrd_size - 1 > initrd_max) {
+                r = linux_copy_below((VOID *)initrd_addr, initrd_size, initrd_max, &initrd_addr);
                 if (EFI_ERROR(r))
                         return r;
-                CopyMem((VOID *)(UINTN)addr, cmdline, cmdline_len);
-                ((CHAR8 *)addr)[cmdline_len] = 0;
-                boot_setup->cmd_line_ptr = (UINT32)addr;
         }
 
         boot_setup->ramdisk_start = (UINT32)initrd_addr;
         boot_setup->ramdisk_len = (UINT32)initrd_size;
+        boot_setup->ext_ramdisk_image = (UINT64)initrd_addr >> 32;
+        boot_setup->ext_ramdisk_size = (UINT64)initrd_size >> 32;
 
         linux_efi_handover(image, boot_setup);
         return EFI_LOAD_ERROR;
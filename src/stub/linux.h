@@ -16,6 +16,12 @@
   along with bus1; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+/* The first sectors of a bzImage, they hold the setup header. */
+#define LINUX_HEADER_SIZE       0x400
+
+UINTN linux_initrd_max(UINTN linux_addr);
+EFI_STATUS linux_alloc(const VOID *header, UINTN image_size, UINTN *linux_addr);
+/* The command line must be NUL-terminated after cmdline_size bytes. */
 EFI_STATUS linux_exec(EFI_HANDLE *image,
                       CHAR8 *cmdline, UINTN cmdline_size,
                       UINTN linux_addr,
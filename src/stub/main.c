@@ -21,78 +21,222 @@
 #include "shared/util.h"
 #include "shared/disk.h"
 #include "shared/pefile.h"
+#include "shared/timer.h"
 #include "shared/graphics.h"
+#include "shared/lz4.h"
+#include "shared/handoff.h"
+#include "initrd.h"
 #include "splash.h"
 #include "linux.h"
 
 static const EFI_GUID global_guid = EFI_GLOBAL_VARIABLE;
+static const EFI_GUID boot_handoff_guid = BOOT_HANDOFF_PROTOCOL_GUID;
+
+/* Decompress an LZ4 section straight into newly allocated pages below max_addr. */
+static EFI_STATUS section_decompress(const UINT8 *src, UINTN src_size, UINTN max_addr, UINTN *addr, UINTN *size) {
+        EFI_PHYSICAL_ADDRESS pages = max_addr;
+        UINT64 len;
+        EFI_STATUS r;
+
+        r = lz4_frame_size(src, src_size, &len);
+        if (EFI_ERROR(r))
+                return r;
+
+        if (len == 0 || len > max_addr)
+                return EFI_LOAD_ERROR;
+
+        r = uefi_call_wrapper(BS->AllocatePages, 4, AllocateMaxAddress, EfiLoaderData, EFI_SIZE_TO_PAGES(len), &pages);
+        if (EFI_ERROR(r))
+                return r;
+
+        r = lz4_frame_decompress(src, src_size, (UINT8 *)(UINTN)pages, len);
+        if (EFI_ERROR(r)) {
+                uefi_call_wrapper(BS->FreePages, 2, pages, EFI_SIZE_TO_PAGES(len));
+                return r;
+        }
+
+        *addr = pages;
+        *size = len;
+        return EFI_SUCCESS;
+}
+
+/* Decompress the kernel straight to where it runs, so neither the stub nor the kernel moves it. */
+static EFI_STATUS linux_decompress(const UINT8 *src, UINTN src_size, UINTN *addr, UINTN *size) {
+        UINT8 header[LINUX_HEADER_SIZE];
+        UINT64 len;
+        EFI_STATUS r;
+
+        r = lz4_frame_size(src, src_size, &len);
+        if (EFI_ERROR(r))
+                return r;
+
+        if (len < sizeof(header) || len > 0xffffffff)
+                return EFI_LOAD_ERROR;
+
+        r = lz4_frame_peek(src, src_size, header, sizeof(header));
+        if (EFI_ERROR(r))
+                return r;
+
+        r = linux_alloc(header, len, addr);
+        if (r == EFI_UNSUPPORTED)
+                return section_decompress(src, src_size, 0xffffffff, addr, size);
+        if (EFI_ERROR(r))
+                return r;
+
+        r = lz4_frame_decompress(src, src_size, (UINT8 *)*addr, len);
+        if (EFI_ERROR(r))
+                return r;
+
+        *size = len;
+        return EFI_SUCCESS;
+}
+
+/* The initrd add-ons of a release: <directory of the image>\<release>.extra.d */
+static CHAR16 *addons_path(const CHAR16 *image_path, const CHAR16 *release, UINTN release_len) {
+        UINTN dir_len = 0;
+        CHAR16 *path;
+
+        while (release_len > 0 && release[release_len - 1] == '\0')
+                release_len--;
+
+        for (UINTN i = 0; image_path[i]; i++)
+                if (image_path[i] == '\\')
+                        dir_len = i + 1;
+
+        path = AllocatePool((dir_len + release_len + 9) * sizeof(CHAR16));
+        if (!path)
+                return NULL;
+
+        CopyMem(path, (VOID *)image_path, dir_len * sizeof(CHAR16));
+        CopyMem(path + dir_len, (VOID *)release, release_len * sizeof(CHAR16));
+        CopyMem(path + dir_len + release_len, L".extra.d", 9 * sizeof(CHAR16));
+        return path;
+}
+
+/* a GPT disk GUID as the boot manager formats it, nothing else may end up after disk= */
+static BOOLEAN disk_uuid_valid(const CHAR16 *uuid) {
+        for (UINTN i = 0; i < 36; i++) {
+                CHAR16 c = uuid[i];
+
+                if (i == 8 || i == 13 || i == 18 || i == 23) {
+                        if (c != '-')
+                                return FALSE;
+                } else if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+                        return FALSE;
+        }
+
+        return uuid[36] == '\0';
+}
 
 EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
         EFI_LOADED_IMAGE *loaded_image;
-        EFI_FILE_HANDLE root_dir;
+        BootHandoff *handoff = NULL;
+        _c_cleanup_(CCloseP) EFI_FILE_HANDLE root_dir = NULL;
         _c_cleanup_(CFreePoolP) CHAR16 *loaded_image_path = NULL;
+        CHAR16 *file_name;
         _c_cleanup_(CCloseP) EFI_FILE_HANDLE f = NULL;
+        _c_cleanup_(CFreePoolP) EFI_FILE_INFO *info = NULL;
+        _c_cleanup_(CFreePoolP) CHAR16 *addons_dir = NULL;
         CHAR16 uuid[37] = {};
-        CHAR8 *b;
-        UINTN size;
+        UINT64 value;
         BOOLEAN secure = FALSE;
         enum {
                 SECTION_INITRD,
+                SECTION_INITRD_HEADER,
+                SECTION_INITRD_LZ4,
                 SECTION_LINUX,
+                SECTION_LINUX_LZ4,
                 SECTION_OPTIONS,
                 SECTION_RELEASE,
                 SECTION_SPLASH,
         };
         CHAR8 *sections[] = {
                 [SECTION_INITRD] = (UINT8 *)".initrd",
+                [SECTION_INITRD_HEADER] = (UINT8 *)".initrdh",
+                [SECTION_INITRD_LZ4] = (UINT8 *)".zinitrd",
                 [SECTION_LINUX] = (UINT8 *)".linux",
+                [SECTION_LINUX_LZ4] = (UINT8 *)".zlinux",
                 [SECTION_OPTIONS] = (UINT8 *)".options",
                 [SECTION_RELEASE] = (UINT8 *)".release",
                 [SECTION_SPLASH] = (UINT8 *)".splash",
         };
         UINTN addrs[C_ARRAY_SIZE(sections)] = {};
-        UINTN offs[C_ARRAY_SIZE(sections)] = {};
         UINTN szs[C_ARRAY_SIZE(sections)] = {};
+        InitrdStream initrd_stream = {};
+        BOOLEAN initrd_streamed = FALSE;
+        BOOLEAN initrd_file;
+        InitrdLoader initrd_loader = {};
+        BOOLEAN addons;
+        UINTN linux_addr;
+        UINTN linux_size;
+        UINTN linux_moved = 0;
+        UINTN compressed_size = 0;
+        UINTN decompressed_size = 0;
+        UINTN initrd_addr;
+        UINTN initrd_size;
         CHAR16 *options = NULL;
         UINTN options_len = 0;
         CHAR8 *cmdline;
         UINTN cmdline_len;
         CHAR8 *s;
+        UINT64 time_entry;
+        UINT64 time_sections;
+        UINT64 time_disk;
+        UINT64 time_splash = 0;
+        UINT64 time_initrd = 0;
+        UINT64 time_decompress = 0;
+        UINT64 time_linux = 0;
         EFI_STATUS r;
 
         InitializeLib(image, sys_table);
 
+        /* facts the boot manager already knows; absent if the firmware or another loader started us */
+        r = uefi_call_wrapper(BS->OpenProtocol, 6, image, (EFI_GUID *)&boot_handoff_guid, (VOID **)&handoff,
+                                image, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+        if (EFI_ERROR(r) || handoff->version < BOOT_HANDOFF_VERSION || handoff->size < sizeof(BootHandoff) ||
+            !handoff->file_path)
+                handoff = NULL;
+        else if (handoff->timer_freq > 0)
+                timer_frequency_set(handoff->timer_freq);
+
+        time_entry = timer_usec();
+
         r = uefi_call_wrapper(BS->OpenProtocol, 6, image, &LoadedImageProtocol, (VOID **)&loaded_image,
                                 image, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
         if (EFI_ERROR(r))
                 return r;
 
-        root_dir = LibOpenRoot(loaded_image->DeviceHandle);
-        if (!root_dir)
-                return EFI_LOAD_ERROR;
-
-        if (efivar_get(&global_guid, L"SecureBoot", &b, &size) == EFI_SUCCESS) {
-                if (*b > 0)
-                        secure = TRUE;
-                FreePool(b);
-        }
+        if (efivar_get_int(&global_guid, L"SecureBoot", &value) == EFI_SUCCESS && value > 0)
+                secure = TRUE;
 
-        loaded_image_path = DevicePathToStr(loaded_image->FilePath);
+        /*
+         * Any image which can load the signed stub can also install the handoff protocol on
+         * its handle. Under Secure Boot, nothing from it may reach the kernel command line;
+         * the path and the disk UUID are looked up again.
+         */
+        if (handoff && !secure)
+                loaded_image_path = StrDuplicate(handoff->file_path);
+        else
+                loaded_image_path = DevicePathToStr(loaded_image->FilePath);
         if (!loaded_image_path)
                 return EFI_LOAD_ERROR;
 
-        r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &f, loaded_image_path, EFI_FILE_MODE_READ, 0ULL);
-        if (EFI_ERROR(r))
-                return r;
-
-        r = pefile_locate_sections(f, sections, C_ARRAY_SIZE(sections), addrs, offs, szs);
+        /* the firmware already mapped the whole image, parse the section table in place */
+        r = pefile_image_sections(loaded_image->ImageBase, loaded_image->ImageSize,
+                                  sections, C_ARRAY_SIZE(sections), addrs, szs);
         if (EFI_ERROR(r)) {
                 Print(L"Unable to locate embedded PE/COFF sections: %r\n", r);
                 uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
                 return r;
         }
+        time_sections = timer_usec();
 
-        r = loader_filename_parse(f, loaded_image->ImageBase + addrs[SECTION_RELEASE], szs[SECTION_RELEASE] / sizeof(CHAR16), NULL);
+        file_name = loaded_image_path;
+        for (UINTN i = 0; loaded_image_path[i]; i++)
+                if (loaded_image_path[i] == '\\')
+                        file_name = loaded_image_path + i + 1;
+
+        r = loader_filename_parse(file_name, loaded_image->ImageBase + addrs[SECTION_RELEASE], szs[SECTION_RELEASE] / sizeof(CHAR16), NULL);
         if (EFI_ERROR(r)) {
                 Print(L"Filename and release do not match: %r.\n", r);
                 uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
@@ -112,16 +256,147 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                 options_len = szs[SECTION_OPTIONS] / sizeof(CHAR16);
         }
 
-        r = disk_get_disk_uuid(loaded_image->DeviceHandle, uuid);
-        if (EFI_ERROR(r))
-                return r;
+        if (handoff && !secure && disk_uuid_valid(handoff->disk_uuid))
+                CopyMem(uuid, handoff->disk_uuid, sizeof(uuid));
+        else {
+                r = disk_get_disk_uuid(loaded_image->DeviceHandle, uuid);
+                if (EFI_ERROR(r))
+                        return r;
+        }
+        time_disk = timer_usec();
+
+        /* compressed sections trade firmware reads for decompression into the final pages */
+        linux_addr = (UINTN)loaded_image->ImageBase + addrs[SECTION_LINUX];
+        initrd_addr = (UINTN)loaded_image->ImageBase + addrs[SECTION_INITRD];
+        initrd_size = szs[SECTION_INITRD];
+        if (szs[SECTION_LINUX_LZ4] > 0) {
+                r = linux_decompress(loaded_image->ImageBase + addrs[SECTION_LINUX_LZ4], szs[SECTION_LINUX_LZ4],
+                                     &linux_addr, &linux_size);
+                if (EFI_ERROR(r)) {
+                        Print(L"Unable to decompress the kernel: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+                compressed_size += szs[SECTION_LINUX_LZ4];
+                decompressed_size += linux_size;
+        }
+
+        if (szs[SECTION_INITRD_LZ4] > 0 && szs[SECTION_INITRD_HEADER] == 0) {
+                r = section_decompress(loaded_image->ImageBase + addrs[SECTION_INITRD_LZ4], szs[SECTION_INITRD_LZ4],
+                                       linux_initrd_max(linux_addr), &initrd_addr, &initrd_size);
+                if (EFI_ERROR(r)) {
+                        Print(L"Unable to decompress the initrd: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+                compressed_size += szs[SECTION_INITRD_LZ4];
+                decompressed_size += initrd_size;
+        }
+
+        if (decompressed_size > 0)
+                time_decompress = timer_usec();
+
+        /*
+         * An uncompressed kernel runs where the firmware loaded it; if it needs more room
+         * there, it relocates itself faster than a copy here would. It is only moved when
+         * it is out of reach of the 32-bit code32_start.
+         */
+        if (szs[SECTION_LINUX_LZ4] == 0 && szs[SECTION_LINUX] >= LINUX_HEADER_SIZE &&
+            (UINT64)linux_addr > 0xffffffff) {
+                UINTN addr;
+
+                r = linux_alloc((VOID *)linux_addr, szs[SECTION_LINUX], &addr);
+                if (r == EFI_SUCCESS) {
+                        CopyMem((VOID *)addr, (VOID *)linux_addr, szs[SECTION_LINUX]);
+                        linux_addr = addr;
+                        linux_moved = szs[SECTION_LINUX];
+                        time_linux = timer_usec();
+                } else if (r != EFI_UNSUPPORTED) {
+                        Print(L"Unable to allocate memory for the kernel: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+        }
+
+        /*
+         * Everything up to here came from the loaded image; add-ons, and a trailing initrd the
+         * boot manager did not hand over, need the ESP. Add-ons are not covered by the
+         * signature, under Secure Boot they are not even looked for.
+         */
+        addons = !secure && (!handoff || (handoff->flags & BOOT_HANDOFF_ADDONS));
+        initrd_file = szs[SECTION_INITRD_HEADER] > 0 && handoff && handoff->file_buffer;
+        if (addons || (szs[SECTION_INITRD_HEADER] > 0 && !initrd_file)) {
+                root_dir = LibOpenRoot(loaded_image->DeviceHandle);
+                if (!root_dir)
+                        return EFI_LOAD_ERROR;
+        }
+
+        /*
+         * A trailing initrd is still in the file the boot manager read for LoadImage(). Without
+         * it, the initrd is read into its final pages while the splash is drawn.
+         */
+        if (initrd_file) {
+                r = initrd_file_find(loaded_image->ImageBase + addrs[SECTION_INITRD_HEADER], szs[SECTION_INITRD_HEADER],
+                                     handoff->file_buffer, handoff->file_size, secure,
+                                     &initrd_addr, &initrd_size);
+                if (EFI_ERROR(r)) {
+                        Print(L"Unable to find the initrd: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+                time_initrd = timer_usec();
+        } else if (szs[SECTION_INITRD_HEADER] > 0) {
+                r = uefi_call_wrapper(root_dir->Open, 5, root_dir, &f, loaded_image_path, EFI_FILE_MODE_READ, 0ULL);
+                if (EFI_ERROR(r))
+                        return r;
+
+                info = LibFileInfo(f);
+                if (!info)
+                        return EFI_LOAD_ERROR;
+
+                r = initrd_stream_start(&initrd_stream, f,
+                                        loaded_image->ImageBase + addrs[SECTION_INITRD_HEADER], szs[SECTION_INITRD_HEADER],
+                                        info->FileSize,
+                                        linux_initrd_max(linux_addr));
+                if (EFI_ERROR(r)) {
+                        Print(L"Unable to read the initrd: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+                initrd_streamed = TRUE;
+        }
+
+        /*
+         * Small cpio archives next to the image are appended to the initrd by the kernel's
+         * LoadFile2 call. They are optional; the release still boots without them.
+         */
+        if (addons) {
+                addons_dir = addons_path(loaded_image_path, loaded_image->ImageBase + addrs[SECTION_RELEASE],
+                                         szs[SECTION_RELEASE] / sizeof(CHAR16));
+                if (addons_dir)
+                        r = initrd_addons_open(&initrd_loader, root_dir, addons_dir);
+                else
+                        r = EFI_OUT_OF_RESOURCES;
+                if (EFI_ERROR(r)) {
+                        Print(L"Unable to open the initrd add-ons, ignoring them: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                }
+        }
 
+        /* the initrd stream and the add-ons hold handles of their own */
+        CCloseP(&root_dir);
+        root_dir = NULL;
 
         cmdline_len = 5 + 36;                                   /* disk=<UUID> */
         cmdline_len += 1 + 7 + StrLen(loaded_image_path);       /* loader=<file path> */
         if (options_len > 0)
                 cmdline_len += 1 + options_len;
-        cmdline = AllocatePool(cmdline_len);
+        cmdline = AllocatePool(cmdline_len + 1);
+        if (!cmdline) {
+                initrd_loader_free(&initrd_loader);
+                initrd_stream_abort(&initrd_stream);
+                return EFI_OUT_OF_RESOURCES;
+        }
 
         s = cmdline;
         CopyMem(s, "disk=", 5);
@@ -159,14 +434,51 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                         s++;
                 }
         }
+        *s = '\0';
 
-        if (szs[SECTION_SPLASH] > 0)
+        if (szs[SECTION_SPLASH] > 0) {
                 graphics_splash((UINT8 *)((UINTN)loaded_image->ImageBase + addrs[SECTION_SPLASH]), szs[SECTION_SPLASH]);
+                time_splash = timer_usec();
+        }
+
+        if (initrd_streamed) {
+                r = initrd_stream_finish(&initrd_stream, secure, &initrd_addr, &initrd_size);
+                if (EFI_ERROR(r)) {
+                        graphics_mode(FALSE);
+                        Print(L"Unable to read the initrd: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+                time_initrd = timer_usec();
+        }
+
+        if (initrd_loader.n_addons > 0) {
+                r = initrd_loader_install(&initrd_loader, (VOID *)initrd_addr, initrd_size);
+                if (EFI_ERROR(r)) {
+                        graphics_mode(FALSE);
+                        Print(L"Unable to install the initrd loader: %r\n", r);
+                        uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+                        return r;
+                }
+        }
+
+        timer_publish(L"StubTimeEntryUSec", time_entry);
+        timer_publish(L"StubTimeSectionsUSec", time_sections);
+        timer_publish(L"StubTimeDiskUUIDUSec", time_disk);
+        timer_publish(L"StubTimeDecompressUSec", time_decompress);
+        timer_publish(L"StubDecompressInBytes", compressed_size);
+        timer_publish(L"StubDecompressOutBytes", decompressed_size);
+        timer_publish(L"StubTimeLinuxUSec", time_linux);
+        timer_publish(L"StubLinuxMovedBytes", linux_moved);
+        timer_publish(L"StubTimeSplashUSec", time_splash);
+        timer_publish(L"StubTimeInitrdUSec", time_initrd);
+        timer_publish(L"StubTimeHandoverUSec", timer_usec());
 
         r = linux_exec(image, cmdline, cmdline_len,
-                       (UINTN)loaded_image->ImageBase + addrs[SECTION_LINUX],
-                       (UINTN)loaded_image->ImageBase + addrs[SECTION_INITRD], szs[SECTION_INITRD]);
+                       linux_addr,
+                       initrd_addr, initrd_size);
 
+        initrd_loader_free(&initrd_loader);
         graphics_mode(FALSE);
         Print(L"Execution of embedded linux image failed: %r\n", r);
         uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
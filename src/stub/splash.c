@@ -52,6 +52,11 @@ struct bmp_map {
         UINT8 reserved;
 } __attribute__((packed));
 
+/* BI_RLE8 and BI_RLE4 */
+static BOOLEAN bmp_rle(const struct bmp_dib *dib) {
+        return dib->compression == 1 || dib->compression == 2;
+}
+
 EFI_STATUS bmp_parse_header(UINT8 *bmp, UINTN size, struct bmp_dib **ret_dib,
                             struct bmp_map **ret_map, UINT8 **pixmap) {
         struct bmp_file *file;
@@ -78,14 +83,24 @@ EFI_STATUS bmp_parse_header(UINT8 *bmp, UINTN size, struct bmp_dib **ret_dib,
 
         switch (dib->depth) {
         case 1:
-        case 4:
-        case 8:
         case 24:
                 if (dib->compression != 0)
                         return EFI_UNSUPPORTED;
 
                 break;
 
+        case 4:
+                if (dib->compression != 0 && dib->compression != 2)
+                        return EFI_UNSUPPORTED;
+
+                break;
+
+        case 8:
+                if (dib->compression != 0 && dib->compression != 1)
+                        return EFI_UNSUPPORTED;
+
+                break;
+
         case 16:
         case 32:
                 if (dib->compression != 0 && dib->compression != 3)
@@ -98,7 +113,13 @@ EFI_STATUS bmp_parse_header(UINT8 *bmp, UINTN size, struct bmp_dib **ret_dib,
         }
 
         row_size = ((UINTN) dib->depth * dib->x + 31) / 32 * 4;
-        if (file->size - file->offset <  dib->y * row_size)
+        if (bmp_rle(dib)) {
+                /* the runs are checked while decoding, only their size is known */
+                if (dib->image_size == 0 || file->size - file->offset < dib->image_size)
+                        return EFI_INVALID_PARAMETER;
+                if ((UINT64)dib->x * dib->y * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) > 64 * 1024 * 1024)
+                        return EFI_INVALID_PARAMETER;
+        } else if (file->size - file->offset <  dib->y * row_size)
                 return EFI_INVALID_PARAMETER;
         if (row_size * dib->y > 64 * 1024 * 1024)
                 return EFI_INVALID_PARAMETER;
@@ -140,159 +161,603 @@ EFI_STATUS bmp_parse_header(UINT8 *bmp, UINTN size, struct bmp_dib **ret_dib,
         return EFI_SUCCESS;
 }
 
-static VOID pixel_blend(UINT32 *dst, const UINT32 source) {
-        UINT32 alpha, src, src_rb, src_g, dst_rb, dst_g, rb, g;
+/*
+ * Blend a 0x00RRGGBB pixel with straight alpha over an opaque 0x00RRGGBB
+ * background. R and B are blended in two 16-bit lanes of one word, G in
+ * another; (t + (t >> 8)) >> 8 divides every lane exactly by 255.
+ */
+static UINT32 pixel_blend(UINT32 background, UINT32 source, UINT32 alpha) {
+        UINT32 rb, g;
+
+        if (alpha == 0xff)
+                return source;
+        if (alpha == 0)
+                return background;
+
+        rb = (source & 0xff00ff) * alpha + (background & 0xff00ff) * (0xff - alpha) + 0x800080;
+        g  = (source & 0x00ff00) * alpha + (background & 0x00ff00) * (0xff - alpha) + 0x008000;
 
-        alpha = (source & 0xff);
+        rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+        g  = ((g  + ((g  >> 8) & 0x00ff00)) >> 8) & 0x00ff00;
 
-        /* convert src from RGBA to XRGB */
-        src = source >> 8;
+        return rb | g;
+}
 
-        /* decompose into RB and G components */
-        src_rb = (src & 0xff00ff);
-        src_g  = (src & 0x00ff00);
+/*
+ * One row of pixels for every supported depth; the kernel is chosen once per
+ * image. Colour tables are expanded to BLT pixels beforehand, so every pixel
+ * is a single 32-bit store. All EFI architectures are little-endian.
+ */
+typedef struct {
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL palette[256];
+        /* what transparent pixels are blended over, as 0x00RRGGBB */
+        UINT32 background;
+        /* position of the 8-bit channels of a 32-bit pixel */
+        UINT8 shift_red;
+        UINT8 shift_green;
+        UINT8 shift_blue;
+        UINT8 shift_alpha;
+} BmpRowContext;
+
+typedef VOID (*BmpRowFunc)(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                           const BmpRowContext *ctx);
+
+static inline UINT32 load32(const UINT8 *p) {
+        UINT32 v;
+
+        __builtin_memcpy(&v, p, sizeof(v));
+        return v;
+}
 
-        dst_rb = (*dst & 0xff00ff);
-        dst_g  = (*dst & 0x00ff00);
+static inline VOID store32(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, UINT32 xrgb) {
+        __builtin_memcpy(out, &xrgb, sizeof(xrgb));
+}
 
-        /* blend */
-        rb = ((((src_rb - dst_rb) * alpha + 0x800080) >> 8) + dst_rb) & 0xff00ff;
-        g  = ((((src_g  -  dst_g) * alpha + 0x008000) >> 8) +  dst_g) & 0x00ff00;
+static VOID bmp_row_1(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                      const BmpRowContext *ctx) {
+        UINTN x = 0;
+
+        for (; x + 8 <= n; x += 8, in++) {
+                UINT8 b = *in;
+
+                out[x + 0] = ctx->palette[(b >> 7) & 1];
+                out[x + 1] = ctx->palette[(b >> 6) & 1];
+                out[x + 2] = ctx->palette[(b >> 5) & 1];
+                out[x + 3] = ctx->palette[(b >> 4) & 1];
+                out[x + 4] = ctx->palette[(b >> 3) & 1];
+                out[x + 5] = ctx->palette[(b >> 2) & 1];
+                out[x + 6] = ctx->palette[(b >> 1) & 1];
+                out[x + 7] = ctx->palette[b & 1];
+        }
 
-        *dst = (rb | g);
+        for (UINTN i = 7; x < n; x++, i--)
+                out[x] = ctx->palette[(*in >> i) & 1];
 }
 
-EFI_STATUS bmp_to_blt(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf,
-                      struct bmp_dib *dib, struct bmp_map *map,
-                      UINT8 *pixmap) {
-        UINT8 *in;
+static VOID bmp_row_4(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                      const BmpRowContext *ctx) {
+        UINTN x = 0;
+
+        for (; x + 2 <= n; x += 2, in++) {
+                out[x] = ctx->palette[*in >> 4];
+                out[x + 1] = ctx->palette[*in & 0x0f];
+        }
+
+        if (x < n)
+                out[x] = ctx->palette[*in >> 4];
+}
+
+static VOID bmp_row_8(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                      const BmpRowContext *ctx) {
+        for (UINTN x = 0; x < n; x++)
+                out[x] = ctx->palette[in[x]];
+}
+
+/* X1R5G5B5; bitfield masks are not honoured */
+static VOID bmp_row_16(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                       const BmpRowContext *ctx) {
+        (VOID)ctx;
+
+        for (UINTN x = 0; x < n; x++, in += 2) {
+                UINT32 i = in[0] | in[1] << 8;
+
+                store32(&out[x], (i & 0x7c00) << 9 | (i & 0x3e0) << 6 | (i & 0x1f) << 3);
+        }
+}
+
+/* BGR triplets are BLT pixels without the reserved byte; four pixels are three words */
+static VOID bmp_row_24(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                       const BmpRowContext *ctx) {
+        UINTN x = 0;
+
+        (VOID)ctx;
+
+        for (; x + 4 <= n; x += 4, in += 12) {
+                UINT32 w0 = load32(in);
+                UINT32 w1 = load32(in + 4);
+                UINT32 w2 = load32(in + 8);
+
+                store32(&out[x + 0], w0 & 0xffffff);
+                store32(&out[x + 1], (w0 >> 24) | (w1 & 0xffff) << 8);
+                store32(&out[x + 2], (w1 >> 16) | (w2 & 0xff) << 16);
+                store32(&out[x + 3], w2 >> 8);
+        }
+
+        for (; x < n; x++, in += 3)
+                store32(&out[x], in[0] | in[1] << 8 | in[2] << 16);
+}
+
+static inline UINT32 bmp_pixel_32(UINT32 v, const BmpRowContext *ctx) {
+        return ((v >> ctx->shift_red) & 0xff) << 16 |
+               ((v >> ctx->shift_green) & 0xff) << 8 |
+               ((v >> ctx->shift_blue) & 0xff);
+}
+
+static inline UINT32 bmp_blend_32(const UINT8 *in, const BmpRowContext *ctx) {
+        UINT32 v = load32(in);
+
+        return pixel_blend(ctx->background, bmp_pixel_32(v, ctx), (v >> ctx->shift_alpha) & 0xff);
+}
+
+/* straight alpha, blended over the known background instead of the framebuffer */
+static VOID bmp_row_32(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                       const BmpRowContext *ctx) {
+        UINTN x = 0;
 
-        /* transform and copy pixels */
-        in = pixmap;
-        for (UINTN y = 0; y < dib->y; y++) {
+        for (; x + 4 <= n; x += 4, in += 16) {
+                store32(&out[x + 0], bmp_blend_32(in, ctx));
+                store32(&out[x + 1], bmp_blend_32(in + 4, ctx));
+                store32(&out[x + 2], bmp_blend_32(in + 8, ctx));
+                store32(&out[x + 3], bmp_blend_32(in + 12, ctx));
+        }
+
+        for (; x < n; x++, in += 4)
+                store32(&out[x], bmp_blend_32(in, ctx));
+}
+
+/* no alpha channel, the remaining byte is padding */
+static VOID bmp_row_32_opaque(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out, const UINT8 *in, UINTN n,
+                              const BmpRowContext *ctx) {
+        UINTN x = 0;
+
+        for (; x + 4 <= n; x += 4, in += 16) {
+                store32(&out[x + 0], bmp_pixel_32(load32(in), ctx));
+                store32(&out[x + 1], bmp_pixel_32(load32(in + 4), ctx));
+                store32(&out[x + 2], bmp_pixel_32(load32(in + 8), ctx));
+                store32(&out[x + 3], bmp_pixel_32(load32(in + 12), ctx));
+        }
+
+        for (; x < n; x++, in += 4)
+                store32(&out[x], bmp_pixel_32(load32(in), ctx));
+}
+
+static BOOLEAN bmp_mask_shift(UINT32 mask, UINT8 *shift) {
+        for (UINT8 s = 0; s < 32; s += 8) {
+                if (mask == 0xffU << s) {
+                        *shift = s;
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/*
+ * Channel layout of a 32-bit image. Without masks in the header it is the
+ * one the splash always used: alpha in the low byte, then blue, green and
+ * red. Declared masks must cover one whole byte each, and there is alpha
+ * only if a V3 or later header declares an alpha mask.
+ */
+static EFI_STATUS bmp_masks_32(const struct bmp_dib *dib, BmpRowContext *ctx, BOOLEAN *alpha) {
+        UINT32 masks[4] = {};
+
+        ctx->shift_red = 24;
+        ctx->shift_green = 16;
+        ctx->shift_blue = 8;
+        ctx->shift_alpha = 0;
+        *alpha = TRUE;
+
+        if (dib->compression != 3 || dib->size < 52)
+                return EFI_SUCCESS;
+
+        *alpha = FALSE;
+
+        CopyMem(masks, (UINT8 *)dib + 40, dib->size < 56 ? 12 : 16);
+
+        if (!bmp_mask_shift(masks[0], &ctx->shift_red) ||
+            !bmp_mask_shift(masks[1], &ctx->shift_green) ||
+            !bmp_mask_shift(masks[2], &ctx->shift_blue))
+                return EFI_UNSUPPORTED;
+
+        if (masks[3] == 0)
+                return EFI_SUCCESS;
+
+        if (!bmp_mask_shift(masks[3], &ctx->shift_alpha))
+                return EFI_UNSUPPORTED;
+
+        *alpha = TRUE;
+        return EFI_SUCCESS;
+}
+
+/* Pixels skipped by a run-length encoded image are left in the background colour. */
+static VOID bmp_rle_skip(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf, const struct bmp_dib *dib,
+                         UINTN x, UINTN y, UINTN x_to, UINTN y_to, EFI_GRAPHICS_OUTPUT_BLT_PIXEL pixel) {
+        for (; y < y_to || (y == y_to && x < x_to); y++, x = 0) {
+                EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out = &buf[(dib->y - y - 1) * dib->x];
+                UINTN end = y < y_to ? dib->x : x_to;
+
+                for (; x < end; x++)
+                        out[x] = pixel;
+        }
+}
+
+/*
+ * BI_RLE8 and BI_RLE4 in one pass: a run is a count and a colour index (two
+ * alternating ones for RLE4), a zero count starts an escape: end of line,
+ * end of bitmap, a delta or a word-aligned literal run. Every run is checked
+ * against the row and the compressed data before it is written.
+ */
+static EFI_STATUS bmp_rle_to_blt(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf, const struct bmp_dib *dib,
+                                 const BmpRowContext *ctx, const UINT8 *pixmap,
+                                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL background) {
+        const UINT8 *in = pixmap;
+        const UINT8 *end = pixmap + dib->image_size;
+        BOOLEAN rle4 = dib->compression == 2;
+        UINTN x = 0, y = 0;
+
+        while (end - in >= 2) {
+                UINTN n = in[0];
+                UINT8 c = in[1];
                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *out;
-                UINTN row_size;
 
-                out = &buf[(dib->y - y - 1) * dib->x];
-                for (UINTN x = 0; x < dib->x; x++, in++, out++) {
-                        switch (dib->depth) {
-                        case 1:
-                                for (UINTN i = 0; i < 8 && x < dib->x; i++) {
-                                        out->Red = map[((*in) >> (7 - i)) & 1].red;
-                                        out->Green = map[((*in) >> (7 - i)) & 1].green;
-                                        out->Blue = map[((*in) >> (7 - i)) & 1].blue;
-                                        out++;
-                                        x++;
-                                }
-                                out--;
-                                x--;
-                                break;
+                in += 2;
 
-                        case 4: {
-                                UINTN i;
-
-                                i = (*in) >> 4;
-                                out->Red = map[i].red;
-                                out->Green = map[i].green;
-                                out->Blue = map[i].blue;
-                                if (x < (dib->x - 1)) {
-                                        out++;
-                                        x++;
-                                        i = (*in) & 0x0f;
-                                        out->Red = map[i].red;
-                                        out->Green = map[i].green;
-                                        out->Blue = map[i].blue;
-                                }
-                                break;
-                        }
+                if (n > 0) {
+                        if (y >= dib->y || n > dib->x - x)
+                                return EFI_INVALID_PARAMETER;
 
-                        case 8:
-                                out->Red = map[*in].red;
-                                out->Green = map[*in].green;
-                                out->Blue = map[*in].blue;
-                                break;
+                        out = &buf[(dib->y - y - 1) * dib->x + x];
+                        if (rle4) {
+                                UINT32 p[2];
 
-                        case 16: {
-                                UINT16 i = *(UINT16 *) in;
+                                __builtin_memcpy(&p[0], &ctx->palette[c >> 4], sizeof(p[0]));
+                                __builtin_memcpy(&p[1], &ctx->palette[c & 0x0f], sizeof(p[1]));
+                                for (UINTN i = 0; i < n; i++)
+                                        store32(&out[i], p[i & 1]);
+                        } else {
+                                UINT32 p;
 
-                                out->Red = (i & 0x7c00) >> 7;
-                                out->Green = (i & 0x3e0) >> 2;
-                                out->Blue = (i & 0x1f) << 3;
-                                in += 1;
-                                break;
+                                __builtin_memcpy(&p, &ctx->palette[c], sizeof(p));
+                                for (UINTN i = 0; i < n; i++)
+                                        store32(&out[i], p);
                         }
 
-                        case 24:
-                                out->Red = in[2];
-                                out->Green = in[1];
-                                out->Blue = in[0];
-                                in += 2;
-                                break;
+                        x += n;
+                        continue;
+                }
 
-                        case 32: {
-                                UINT32 i = *(UINT32 *) in;
+                switch (c) {
+                case 0:
+                        /* end of line */
+                        if (y >= dib->y)
+                                return EFI_INVALID_PARAMETER;
 
-                                pixel_blend((UINT32 *)out, i);
+                        bmp_rle_skip(buf, dib, x, y, 0, y + 1, background);
+                        x = 0;
+                        y++;
+                        break;
 
-                                in += 3;
-                                break;
-                        }
-                        }
+                case 1:
+                        /* end of bitmap */
+                        bmp_rle_skip(buf, dib, x, y, 0, dib->y, background);
+                        return EFI_SUCCESS;
+
+                case 2: {
+                        UINTN dx, dy;
+
+                        if (end - in < 2)
+                                return EFI_INVALID_PARAMETER;
+
+                        dx = in[0];
+                        dy = in[1];
+                        in += 2;
+
+                        if (x + dx > dib->x || y + dy > dib->y ||
+                            (y + dy == dib->y && x + dx > 0))
+                                return EFI_INVALID_PARAMETER;
+
+                        bmp_rle_skip(buf, dib, x, y, x + dx, y + dy, background);
+                        x += dx;
+                        y += dy;
+                        break;
+                }
+
+                default: {
+                        /* literal run, padded to 16 bits */
+                        UINTN size = rle4 ? (c + 1) / 2 : c;
+
+                        if (y >= dib->y || c > dib->x - x || (UINTN)(end - in) < size)
+                                return EFI_INVALID_PARAMETER;
+
+                        out = &buf[(dib->y - y - 1) * dib->x + x];
+                        if (rle4)
+                                bmp_row_4(out, in, c, ctx);
+                        else
+                                bmp_row_8(out, in, c, ctx);
+
+                        x += c;
+                        in += size;
+                        if (size & 1 && in < end)
+                                in++;
+                        break;
+                }
+                }
+        }
+
+        /* a missing end-of-bitmap marker is tolerated */
+        if (y < dib->y)
+                bmp_rle_skip(buf, dib, x, y, 0, dib->y, background);
+
+        return EFI_SUCCESS;
+}
+
+EFI_STATUS bmp_to_blt(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf,
+                      struct bmp_dib *dib, struct bmp_map *map,
+                      UINT8 *pixmap, EFI_GRAPHICS_OUTPUT_BLT_PIXEL background) {
+        BmpRowContext ctx = {};
+        BmpRowFunc row;
+        UINTN row_size;
+        BOOLEAN alpha;
+        EFI_STATUS r;
+
+        switch (dib->depth) {
+        case 1:
+                row = bmp_row_1;
+                break;
+        case 4:
+                row = bmp_row_4;
+                break;
+        case 8:
+                row = bmp_row_8;
+                break;
+        case 16:
+                row = bmp_row_16;
+                break;
+        case 24:
+                row = bmp_row_24;
+                break;
+        case 32:
+                r = bmp_masks_32(dib, &ctx, &alpha);
+                if (EFI_ERROR(r))
+                        return r;
+
+                row = alpha ? bmp_row_32 : bmp_row_32_opaque;
+                break;
+        default:
+                return EFI_UNSUPPORTED;
+        }
+
+        __builtin_memcpy(&ctx.background, &background, sizeof(ctx.background));
+        ctx.background &= 0xffffff;
+
+        /* indices beyond the colour table stay black */
+        if (dib->depth <= 8) {
+                UINTN n_colors;
+
+                n_colors = dib->colors_used ? dib->colors_used : 1U << dib->depth;
+                if (n_colors > 1U << dib->depth)
+                        n_colors = 1U << dib->depth;
+                if (n_colors > (UINTN)(pixmap - (UINT8 *)map) / sizeof(struct bmp_map))
+                        n_colors = (UINTN)(pixmap - (UINT8 *)map) / sizeof(struct bmp_map);
+
+                for (UINTN i = 0; i < n_colors; i++)
+                        ctx.palette[i] = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL){
+                                .Blue = map[i].blue,
+                                .Green = map[i].green,
+                                .Red = map[i].red,
+                        };
+        }
+
+        if (bmp_rle(dib))
+                return bmp_rle_to_blt(buf, dib, &ctx, pixmap, background);
+
+        /* rows are stored bottom-up, each padded to 32 bits */
+        row_size = ((UINTN)dib->depth * dib->x + 31) / 32 * 4;
+        for (UINTN y = 0; y < dib->y; y++)
+                row(&buf[(dib->y - y - 1) * dib->x], pixmap + y * row_size, dib->x, &ctx);
+
+        return EFI_SUCCESS;
+}
+
+/* Fill the screen around the image, so the image itself is the only buffer upload. */
+static EFI_STATUS splash_fill_border(EFI_GRAPHICS_OUTPUT_PROTOCOL *GraphicsOutput,
+                                     EFI_GRAPHICS_OUTPUT_BLT_PIXEL *pixel,
+                                     UINTN x_pos, UINTN y_pos, UINTN x, UINTN y) {
+        UINTN x_max = GraphicsOutput->Mode->Info->HorizontalResolution;
+        UINTN y_max = GraphicsOutput->Mode->Info->VerticalResolution;
+        struct {
+                UINTN x, y, width, height;
+        } rects[] = {
+                { 0, 0, x_max, y_pos },                                 /* top */
+                { 0, y_pos + y, x_max, y_max - y_pos - y },             /* bottom */
+                { 0, y_pos, x_pos, y },                                 /* left */
+                { x_pos + x, y_pos, x_max - x_pos - x, y },             /* right */
+        };
+        EFI_STATUS r;
+
+        for (UINTN i = 0; i < C_ARRAY_SIZE(rects); i++) {
+                if (rects[i].width == 0 || rects[i].height == 0)
+                        continue;
+
+                r = uefi_call_wrapper(GraphicsOutput->Blt, 10, GraphicsOutput,
+                                      pixel, EfiBltVideoFill, 0, 0, rects[i].x, rects[i].y,
+                                      rects[i].width, rects[i].height, 0);
+                if (EFI_ERROR(r))
+                        return r;
+        }
+
+        return EFI_SUCCESS;
+}
+
+/* EFI_NOT_FOUND if the content is not a pre-converted splash */
+static EFI_STATUS splash_parse_header(UINT8 *content, UINTN len, SplashHeader **ret_header) {
+        SplashHeader *header = (SplashHeader *)content;
+
+        if (len < sizeof(SplashHeader) ||
+            CompareMem(header->magic, SPLASH_HEADER_MAGIC, sizeof(SPLASH_HEADER_MAGIC)) != 0)
+                return EFI_NOT_FOUND;
+
+        if (header->version != SPLASH_HEADER_VERSION)
+                return EFI_UNSUPPORTED;
+
+        if (header->x == 0 || header->y == 0)
+                return EFI_INVALID_PARAMETER;
+        if (header->flags & SPLASH_HEADER_RLE) {
+                /* the runs are checked while decoding */
+                if ((UINT64)header->x * header->y * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) > 64 * 1024 * 1024)
+                        return EFI_INVALID_PARAMETER;
+        } else if ((UINT64)header->x * header->y > (len - sizeof(SplashHeader)) / sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL))
+                return EFI_INVALID_PARAMETER;
+
+        *ret_header = header;
+        return EFI_SUCCESS;
+}
+
+/* Every run is checked against the pixels left and the section before it is written. */
+static EFI_STATUS splash_rle_to_blt(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf, const SplashHeader *header, UINTN len) {
+        const UINT8 *in = (const UINT8 *)(header + 1);
+        const UINT8 *end = (const UINT8 *)header + len;
+        UINTN n_pixels = (UINTN)header->x * header->y;
+        UINTN pos = 0;
+
+        while (pos < n_pixels) {
+                UINT32 run;
+                UINTN n;
+
+                if (end - in < 4)
+                        return EFI_INVALID_PARAMETER;
+
+                run = load32(in);
+                in += 4;
+
+                n = run & ~SPLASH_RUN_LITERAL;
+                if (n == 0 || n > n_pixels - pos)
+                        return EFI_INVALID_PARAMETER;
+
+                if (run & SPLASH_RUN_LITERAL) {
+                        if ((UINTN)(end - in) / sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL) < n)
+                                return EFI_INVALID_PARAMETER;
+
+                        CopyMem(&buf[pos], in, n * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                        in += n * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+                } else {
+                        UINT32 pixel;
+
+                        if (end - in < 4)
+                                return EFI_INVALID_PARAMETER;
+
+                        pixel = load32(in);
+                        in += 4;
+
+                        for (UINTN i = 0; i < n; i++)
+                                store32(&buf[pos + i], pixel);
                 }
 
-                /* add row padding; new lines always start at 32 bit boundary */
-                row_size = in - pixmap;
-                in += ((row_size + 3) & ~3) - row_size;
+                pos += n;
         }
 
         return EFI_SUCCESS;
 }
 
+/* BGRA is the 32-bit BMP layout with an alpha mask in the high byte; in may be buf */
+static VOID splash_blend(EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf, const UINT8 *in, const SplashHeader *header) {
+        BmpRowContext ctx = {
+                .shift_red = 16,
+                .shift_green = 8,
+                .shift_blue = 0,
+                .shift_alpha = 24,
+        };
+
+        __builtin_memcpy(&ctx.background, &header->fill, sizeof(ctx.background));
+        ctx.background &= 0xffffff;
+
+        bmp_row_32(buf, in, (UINTN)header->x * header->y, &ctx);
+}
+
 EFI_STATUS graphics_splash(UINT8 *content, UINTN len) {
         EFI_GRAPHICS_OUTPUT_BLT_PIXEL pixel = {};
         EFI_GUID GraphicsOutputProtocolGuid = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
         EFI_GRAPHICS_OUTPUT_PROTOCOL *GraphicsOutput = NULL;
-        struct bmp_dib *dib;
+        SplashHeader *header = NULL;
+        struct bmp_dib *dib = NULL;
         struct bmp_map *map;
         UINT8 *pixmap;
-        UINT64 blt_size;
-        VOID *blt = NULL;
-        UINTN x_pos = 0;
-        UINTN y_pos = 0;
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+        VOID *buf = NULL;
+        UINTN x, y;
+        UINTN x_pos;
+        UINTN y_pos;
         EFI_STATUS r;
 
         r = LibLocateProtocol(&GraphicsOutputProtocolGuid, (VOID **)&GraphicsOutput);
         if (EFI_ERROR(r))
                 return r;
 
-        r = bmp_parse_header(content, len, &dib, &map, &pixmap);
+        r = splash_parse_header(content, len, &header);
+        if (r == EFI_NOT_FOUND)
+                r = bmp_parse_header(content, len, &dib, &map, &pixmap);
         if (EFI_ERROR(r))
-                goto fail;
+                return r;
 
-        if(dib->x < GraphicsOutput->Mode->Info->HorizontalResolution)
-                x_pos = (GraphicsOutput->Mode->Info->HorizontalResolution - dib->x) / 2;
-        if(dib->y < GraphicsOutput->Mode->Info->VerticalResolution)
-                y_pos = (GraphicsOutput->Mode->Info->VerticalResolution - dib->y) / 2;
+        if (header) {
+                x = header->x;
+                y = header->y;
+                pixel = header->fill;
+                pixel.Reserved = 0;
+        } else {
+                x = dib->x;
+                y = dib->y;
+        }
 
-        uefi_call_wrapper(GraphicsOutput->Blt, 10, GraphicsOutput,
-                          &pixel,
-                          EfiBltVideoFill, 0, 0, 0, 0,
-                          GraphicsOutput->Mode->Info->HorizontalResolution,
-                          GraphicsOutput->Mode->Info->VerticalResolution, 0);
+        /* Blt() would reject an image larger than the screen anyway */
+        if (x > GraphicsOutput->Mode->Info->HorizontalResolution ||
+            y > GraphicsOutput->Mode->Info->VerticalResolution)
+                return EFI_UNSUPPORTED;
 
-        /* EFI buffer */
-        blt_size = dib->x * dib->y * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
-        blt = AllocatePool(blt_size);
-        if (!blt)
-                return EFI_OUT_OF_RESOURCES;
+        x_pos = (GraphicsOutput->Mode->Info->HorizontalResolution - x) / 2;
+        y_pos = (GraphicsOutput->Mode->Info->VerticalResolution - y) / 2;
 
-        r = uefi_call_wrapper(GraphicsOutput->Blt, 10, GraphicsOutput,
-                                blt, EfiBltVideoToBltBuffer, x_pos, y_pos, 0, 0,
-                                dib->x, dib->y, 0);
-        if (EFI_ERROR(r))
-                goto fail;
+        if (header && !(header->flags & (SPLASH_HEADER_ALPHA | SPLASH_HEADER_RLE))) {
+                /* already in BLT order; uploaded straight from the loaded image */
+                blt = (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)(header + 1);
+        } else {
+                /* EFI buffer; the image is blended over the fill colour, video memory is never read */
+                buf = AllocatePool(x * y * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                if (!buf)
+                        return EFI_OUT_OF_RESOURCES;
+
+                blt = buf;
+                if (header) {
+                        const UINT8 *pixels = (const UINT8 *)(header + 1);
+
+                        if (header->flags & SPLASH_HEADER_RLE) {
+                                r = splash_rle_to_blt(blt, header, len);
+                                if (EFI_ERROR(r))
+                                        goto fail;
+
+                                pixels = (const UINT8 *)blt;
+                        }
+
+                        if (header->flags & SPLASH_HEADER_ALPHA)
+                                splash_blend(blt, pixels, header);
+                } else {
+                        r = bmp_to_blt(blt, dib, map, pixmap, pixel);
+                        if (EFI_ERROR(r))
+                                goto fail;
+                }
+        }
 
-        r = bmp_to_blt(blt, dib, map, pixmap);
+        r = splash_fill_border(GraphicsOutput, &pixel, x_pos, y_pos, x, y);
         if (EFI_ERROR(r))
                 goto fail;
 
@@ -302,8 +767,9 @@ EFI_STATUS graphics_splash(UINT8 *content, UINTN len) {
 
         r = uefi_call_wrapper(GraphicsOutput->Blt, 10, GraphicsOutput,
                                 blt, EfiBltBufferToVideo, 0, 0, x_pos, y_pos,
-                                dib->x, dib->y, 0);
+                                x, y, 0);
 fail:
-        FreePool(blt);
+        if (buf)
+                FreePool(buf);
         return r;
 }
@@ -16,4 +16,33 @@
   along with bus1; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+/*
+ * Contents of a pre-converted .splash section, written by
+ * test/convert-splash.py: the header, then width * height BLT pixels, top
+ * row first, which are handed to Blt() straight from the loaded image.
+ * With SPLASH_HEADER_ALPHA the reserved byte of every pixel is its straight
+ * alpha and the pixels are blended over the fill colour first. With
+ * SPLASH_HEADER_RLE the pixels are runs instead, each a 32-bit count and
+ * one pixel to repeat, or with SPLASH_RUN_LITERAL in the count, that many
+ * pixels to copy; runs continue across rows. A section without the magic
+ * is read as BMP.
+ */
+#define SPLASH_HEADER_MAGIC     "bus1-sp"
+#define SPLASH_HEADER_VERSION   1
+
+#define SPLASH_HEADER_ALPHA     (1 << 0)
+#define SPLASH_HEADER_RLE       (1 << 1)
+
+#define SPLASH_RUN_LITERAL      (1U << 31)
+
+typedef struct {
+        CHAR8 magic[8];
+        UINT32 version;
+        UINT32 flags;
+        UINT32 x;
+        UINT32 y;
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL fill;     /* the screen around the image */
+        UINT32 reserved;
+} __attribute__((packed)) SplashHeader;
+
 EFI_STATUS graphics_splash(UINT8 *content, UINTN len);
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#
+# Append an initrd to a stub image as a trailing, non-loaded payload. A
+# .initrdh section with the offset, size and SHA-256 of the initrd is added
+# with objcopy, the initrd itself follows the last byte of the image. The
+# firmware reads it with the file but does not load it; the stub takes it
+# from the file buffer the boot manager handed over, or reads it again
+# straight into the pages it hands to the kernel. Sign the image after
+# adding the initrd.
+#
+#   test/add-initrd.py bus1-0815.efi initrd
+#
+
+import argparse
+import hashlib
+import os
+import struct
+import subprocess
+import tempfile
+
+MAGIC = b'bus1-rd\0'
+VERSION = 1
+HEADER = struct.Struct('<8sIIQQ32s')
+FILE_ALIGNMENT = 0x200
+SECTION_ALIGNMENT = 0x1000
+
+
+def align(v, a):
+    return (v + a - 1) // a * a
+
+
+def sections(image):
+    """Yield (name, virtual address, virtual size, raw offset) of every section."""
+    pe, = struct.unpack_from('<I', image, 0x3c)
+    if image[pe:pe + 4] != b'PE\0\0':
+        raise SystemExit('Not a PE image')
+
+    n_sections, = struct.unpack_from('<H', image, pe + 6)
+    opt_size, = struct.unpack_from('<H', image, pe + 20)
+    table = pe + 24 + opt_size
+    for i in range(n_sections):
+        entry = table + i * 40
+        name = image[entry:entry + 8].rstrip(b'\0').decode()
+        vsize, va, _, raw = struct.unpack_from('<IIII', image, entry + 8)
+        yield name, va, vsize, raw
+
+
+def image_base(image):
+    pe, = struct.unpack_from('<I', image, 0x3c)
+    magic, = struct.unpack_from('<H', image, pe + 24)
+    if magic == 0x20b:
+        return struct.unpack_from('<Q', image, pe + 24 + 24)[0]
+    return struct.unpack_from('<I', image, pe + 24 + 28)[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Append a streamed initrd to a stub image.')
+    parser.add_argument('image', help='stub image, modified in place')
+    parser.add_argument('initrd', help='initrd to append')
+    args = parser.parse_args()
+
+    objcopy = os.environ.get('OBJCOPY', 'objcopy')
+
+    with open(args.image, 'rb') as f:
+        image = f.read()
+
+    if any(name in ('.initrd', '.initrdh') for name, _, _, _ in sections(image)):
+        raise SystemExit('The image already carries an initrd')
+
+    # map the header after the last section
+    end = max(va + vsize for _, va, vsize, _ in sections(image))
+    vma = image_base(image) + align(end, SECTION_ALIGNMENT)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        placeholder = os.path.join(tmp, 'initrdh')
+        with open(placeholder, 'wb') as f:
+            f.write(bytes(HEADER.size))
+
+        output = os.path.join(tmp, 'image')
+        subprocess.run([objcopy,
+                        '--add-section', '.initrdh=' + placeholder,
+                        '--change-section-vma', '.initrdh=0x%x' % vma,
+                        args.image, output], check=True)
+
+        with open(output, 'rb') as f:
+            image = bytearray(f.read())
+
+    with open(args.initrd, 'rb') as f:
+        initrd = f.read()
+
+    offset = align(len(image), FILE_ALIGNMENT)
+    raw = next(raw for name, _, _, raw in sections(image) if name == '.initrdh')
+    image[raw:raw + HEADER.size] = HEADER.pack(MAGIC, VERSION, 0, offset, len(initrd),
+                                               hashlib.sha256(initrd).digest())
+
+    with open(args.image, 'wb') as f:
+        f.write(image.ljust(offset, b'\0'))
+        f.write(initrd)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Compare the compressors the stub could use for the kernel and the initrd.
+# Every file is compressed with each available codec at its default and its
+# highest level, then decompressed from the page cache a few times; the
+# ratio and the best decompression throughput are printed as one JSON
+# object per line:
+#
+#   {"codec":"lz4","level":"-9","file":"linux","size":11534336,"ratio":2.01,"decompress_mb_s":2841.2}
+#
+# Only the lz4 frame format is understood by the stub; the others are
+# measured for comparison. The throughput includes the process startup of
+# the command line tools, use files of several megabytes.
+#
+#   test/bench-codecs.sh /boot/vmlinuz /boot/initrd.img
+#
+
+set -e
+
+RUNS=${RUNS:-5}
+
+if [ $# -eq 0 ]; then
+        echo "Usage: $0 FILE..." >&2
+        exit 1
+fi
+
+TMP=$(mktemp -d /tmp/bench-codecs-XXX)
+trap 'rm -rf $TMP' EXIT
+
+# codec, level, compress command, decompress command
+CODECS=(
+        "lz4     -1  lz4 -q -c --content-size -1           lz4 -q -d -c"
+        "lz4     -9  lz4 -q -c --content-size -9           lz4 -q -d -c"
+        "zstd    -3  zstd -q -c -3                         zstd -q -d -c"
+        "zstd    -19 zstd -q -c -19                        zstd -q -d -c"
+        "gzip    -6  gzip -c -6                            gzip -d -c"
+        "gzip    -9  gzip -c -9                            gzip -d -c"
+        "xz      -6  xz -c -6 --check=crc32                xz -d -c"
+)
+
+now() {
+        date +%s%N
+}
+
+for file in "$@"; do
+        # decompressing from memory into memory, like the stub does
+        cp "$file" $TMP/input
+        size=$(stat -c %s $TMP/input)
+
+        for line in "${CODECS[@]}"; do
+                read -r codec level rest <<< "$line"
+                command -v $codec > /dev/null || continue
+
+                compress=${rest%% $codec *}
+                decompress=$codec${rest#* $codec}
+
+                $compress < $TMP/input > $TMP/compressed
+                compressed=$(stat -c %s $TMP/compressed)
+
+                best=
+                for ((i = 0; i < RUNS; i++)); do
+                        start=$(now)
+                        $decompress < $TMP/compressed > /dev/null
+                        nsec=$(( $(now) - start ))
+                        [ -z "$best" ] || [ $nsec -lt $best ] && best=$nsec
+                done
+
+                awk -v codec=$codec -v level=$level -v file="$(basename "$file")" \
+                    -v size=$size -v compressed=$compressed -v nsec=$best 'BEGIN {
+                        printf "{\"codec\":\"%s\",\"level\":\"%s\",\"file\":\"%s\",\"size\":%d,\"ratio\":%.2f,\"decompress_mb_s\":%.1f}\n",
+                               codec, level, file, size, size / compressed, size / 1e6 / (nsec / 1e9)
+                }'
+        done
+done
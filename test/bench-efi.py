@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+#
+# Boot latency benchmark in QEMU with OVMF. A GPT disk with an ESP holding
+# the boot manager and one stub entry is generated with test/create-esp.py;
+# the stub carries test/payload.c instead of a kernel, which prints the
+# timestamps published by both binaries to the serial console and powers
+# off. Every run boots the same, unmodified disk; KVM is used if available,
+# TCG otherwise. The median and 95th percentile of every phase are printed
+# as one JSON object per line:
+#
+#   {"phase":"handover","variable":"StubTimeHandoverUSec","runs":10,"median_usec":412345,"p95_usec":420012}
+#
+
+import argparse
+import json
+import math
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+# the reported phases and the variable which marks their end
+PHASES = (
+    ('entry', 'BootTimeEntryUSec'),
+    ('menu', 'BootTimeMenuUSec'),
+    ('loadimage', 'BootTimeLoadImageUSec'),
+    ('stub', 'StubTimeEntryUSec'),
+    ('decompress', 'StubTimeDecompressUSec'),
+    ('linux', 'StubTimeLinuxUSec'),
+    ('initrd', 'StubTimeInitrdUSec'),
+    ('handover', 'StubTimeHandoverUSec'),
+    ('kernel', 'PayloadTimeEntryUSec'),
+)
+
+RELEASE = 'bus1-99999'          # sorts after all synthetic entries
+SETUP_SECTS = 1
+LINE = re.compile(r'bus1-bench: (\w+)(?:=(\d+))?')
+
+
+class BenchError(Exception):
+    pass
+
+
+def tool(name, default):
+    return os.environ.get(name, default)
+
+
+def bzimage(payload):
+    """Wrap the flat payload in a setup header with an EFI handover entry."""
+    with tempfile.TemporaryDirectory() as tmp:
+        flat = os.path.join(tmp, 'payload.bin')
+        subprocess.run([tool('OBJCOPY', 'objcopy'), '-O', 'binary', '-j', '.text', '-j', '.rodata',
+                        payload, flat], check=True)
+        with open(flat, 'rb') as f:
+            code = f.read()
+
+    nm = subprocess.run([tool('NM', 'nm'), payload], check=True, capture_output=True, text=True).stdout
+    entry = next(int(l.split()[0], 16) for l in nm.splitlines() if l.endswith(' payload_handover'))
+
+    # the 64-bit handover entry is at code32_start + 512 + handover_offset
+    pm = bytes(512) + code
+    init_size = (len(pm) + 0xfff) & ~0xfff
+
+    setup = bytearray((SETUP_SECTS + 1) * 512)
+    setup[0x1f1] = SETUP_SECTS
+    setup[0x1fe:0x200] = b'\x55\xaa'
+    setup[0x200:0x202] = b'\xeb\x66'
+    setup[0x202:0x206] = b'HdrS'
+    struct.pack_into('<H', setup, 0x206, 0x20f)                 # version
+    struct.pack_into('<I', setup, 0x230, 0x200000)              # kernel_alignment
+    setup[0x234] = 1                                            # relocatable_kernel
+    struct.pack_into('<H', setup, 0x236, (1 << 0) | (1 << 3))   # XLF_KERNEL_64, XLF_EFI_HANDOVER_64
+    struct.pack_into('<Q', setup, 0x258, 0x1000000)             # pref_address
+    struct.pack_into('<I', setup, 0x260, init_size)
+    struct.pack_into('<I', setup, 0x264, entry)                 # handover_offset
+    return bytes(setup) + pm
+
+
+def lz4(data):
+    """An LZ4 frame with the content size, as the stub expects it; lz4 needs a file for the size."""
+    with tempfile.NamedTemporaryFile() as f:
+        f.write(data)
+        f.flush()
+        return subprocess.run([tool('LZ4', 'lz4'), '-q', '-9', '--content-size', '-c', f.name],
+                              check=True, capture_output=True).stdout
+
+
+def stub_entry(args, tmp):
+    """The stub with the payload as .linux, like test/create-efi-disk.sh builds it."""
+    files = {
+        'release': RELEASE.encode('utf-16-le'),
+        'options': 'quiet'.encode('utf-16-le'),
+        'linux': bzimage(args.payload),
+    }
+    if not args.stream_initrd:
+        files['initrd'] = bytes(args.initrd_size)
+    if args.compress:
+        for name in ('linux', 'initrd'):
+            if name in files:
+                files['z' + name] = lz4(files.pop(name))
+    for name, data in files.items():
+        with open(os.path.join(tmp, name), 'wb') as f:
+            f.write(data)
+
+    path = os.path.join(tmp, RELEASE + '.efi')
+    cmd = [tool('OBJCOPY', 'objcopy')]
+    vma = {'release': 0x20000, 'options': 0x30000, 'splash': 0x40000,
+           'linux': 0x2000000, 'initrd': 0x3000000, 'zlinux': 0x2000000, 'zinitrd': 0x3000000}
+    splash = args.splash
+    if splash and args.raw_splash:
+        splash = os.path.join(tmp, 'splash.raw')
+        srcdir = os.path.dirname(os.path.abspath(__file__))
+        subprocess.run([sys.executable, os.path.join(srcdir, 'convert-splash.py'), args.splash, splash], check=True)
+
+    sections = list(files) + (['splash'] if splash else [])
+    for name in sections:
+        data = splash if name == 'splash' else os.path.join(tmp, name)
+        cmd += ['--add-section', '.%s=%s' % (name, data),
+                '--change-section-vma', '.%s=0x%x' % (name, vma[name])]
+    subprocess.run(cmd + [args.stub, path], check=True)
+
+    if args.stream_initrd:
+        initrd = os.path.join(tmp, 'initrd')
+        with open(initrd, 'wb') as f:
+            f.write(bytes(args.initrd_size))
+        srcdir = os.path.dirname(os.path.abspath(__file__))
+        subprocess.run([sys.executable, os.path.join(srcdir, 'add-initrd.py'), path, initrd], check=True)
+
+    return path
+
+
+def percentile(values, p):
+    """Nearest-rank percentile."""
+    values = sorted(values)
+    return values[max(math.ceil(p / 100 * len(values)) - 1, 0)]
+
+
+def run(args, disk, log):
+    cmd = [args.qemu,
+           '-machine', 'q35,accel=kvm:tcg',
+           '-m', '512',
+           '-nodefaults',
+           '-vga', 'std',
+           '-display', 'none',
+           '-no-reboot',
+           '-bios', args.bios,
+           '-drive', 'format=raw,snapshot=on,file=' + disk,
+           '-serial', 'file:' + log]
+
+    start = time.monotonic()
+    try:
+        subprocess.run(cmd, check=True, timeout=args.timeout,
+                       stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    except subprocess.TimeoutExpired:
+        raise BenchError('Run timed out after %ds, see %s' % (args.timeout, log))
+    except subprocess.CalledProcessError as e:
+        raise BenchError('QEMU failed: %s' % e.stderr.decode(errors='replace').strip())
+    wall = time.monotonic() - start
+
+    values = {}
+    done = False
+    with open(log, encoding='utf-8', errors='replace') as f:
+        for name, value in LINE.findall(f.read()):
+            if name == 'done':
+                done = True
+            elif value:
+                values[name] = int(value)
+
+    if not done:
+        raise BenchError('The payload was not reached, see %s' % log)
+
+    values['wall'] = int(wall * 1000 * 1000)
+    return values
+
+
+def main():
+    srcdir = os.path.dirname(os.path.abspath(__file__))
+
+    parser = argparse.ArgumentParser(description='Measure boot latency in QEMU with OVMF.')
+    parser.add_argument('--qemu', default='qemu-system-x86_64', help='QEMU binary')
+    parser.add_argument('--bios', required=True, help='OVMF firmware image')
+    parser.add_argument('--boot', required=True, help='boot manager, bootx64.efi')
+    parser.add_argument('--stub', required=True, help='stub, stubx64.efi')
+    parser.add_argument('--payload', required=True, help='payload ELF built from test/payload.c')
+    parser.add_argument('--splash', help='splash image to embed into the stub')
+    parser.add_argument('--raw-splash', action='store_true', help='embed the splash pre-converted to BLT pixels')
+    parser.add_argument('--initrd-size', type=int, default=4096, help='size of the initrd in bytes')
+    parser.add_argument('--stream-initrd', action='store_true', help='append the initrd instead of embedding it')
+    parser.add_argument('--compress', action='store_true', help='embed the kernel and the initrd as LZ4 frames')
+    parser.add_argument('--runs', type=int, default=10, help='number of boots')
+    parser.add_argument('--entries', type=int, default=0, help='number of additional synthetic entries')
+    parser.add_argument('--timeout', type=int, default=120, help='timeout of a single boot in seconds')
+    parser.add_argument('--keep', help='keep the disk image and serial logs in this directory')
+    args = parser.parse_args()
+
+    if args.runs < 1:
+        parser.error('--runs must be at least 1')
+
+    tmp = args.keep or tempfile.mkdtemp(prefix='bench-efi-')
+    os.makedirs(tmp, exist_ok=True)
+    try:
+        disk = os.path.join(tmp, 'disk.img')
+        subprocess.run([sys.executable, os.path.join(srcdir, 'create-esp.py'),
+                        '--directory', os.path.join(tmp, 'esp'), '--image', disk, '--gpt',
+                        '--entries', str(args.entries), '--entry', stub_entry(args, tmp),
+                        '--boot', args.boot], check=True)
+
+        results = []
+        for i in range(args.runs):
+            results.append(run(args, disk, os.path.join(tmp, 'serial-%d.log' % i)))
+
+        for phase, variable in PHASES + (('wall', 'wall'),):
+            values = [r[variable] for r in results if variable in r]
+            if not values:
+                continue
+
+            print(json.dumps({
+                'phase': phase,
+                'variable': variable,
+                'runs': len(values),
+                'median_usec': percentile(values, 50),
+                'p95_usec': percentile(values, 95),
+            }, separators=(',', ':')))
+    except BenchError as e:
+        sys.exit(str(e))
+
+    if not args.keep:
+        shutil.rmtree(tmp)
+
+
+if __name__ == '__main__':
+    main()
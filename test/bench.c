@@ -0,0 +1,774 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Microbenchmarks of the routines on the boot path which do not need
+ * firmware. The EFI sources are built for Linux userspace against the
+ * shim in test/host/. Every result is printed as one JSON object per line:
+ *
+ *   {"bench":"config_sort_entries","param":"entries=1000","iterations":4096,"ns_per_op":81234.5,"allocs_per_op":1.00}
+ *
+ * An optional argument restricts the run to benchmarks whose name contains it.
+ * BENCH_FILES, a colon-separated list of files, adds real kernels and initrds
+ * to the lz4_frame_decompress benchmark.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+/* most routines and formats under test are private; include their translation units */
+#include "boot/main.c"
+#include "shared/pefile.c"
+#include "stub/splash.c"
+
+#include "shared/lz4.h"
+
+#define BENCH_MIN_NSEC          (200ULL * 1000 * 1000)
+
+typedef VOID (*BenchFunc)(VOID *ctx, UINT64 n);
+
+static const char *bench_filter;
+static VOID *volatile bench_sink;
+static UINT64 bench_paused_at;
+static UINT64 bench_paused_nsec;
+static UINT64 bench_paused_allocs;
+
+static UINT64 now_nsec(VOID) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (UINT64)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+/* exclude per-iteration setup from the measurement */
+static VOID bench_pause(VOID) {
+        bench_paused_at = now_nsec();
+        bench_paused_allocs -= host_n_allocs;
+}
+
+static VOID bench_resume(VOID) {
+        bench_paused_nsec += now_nsec() - bench_paused_at;
+        bench_paused_allocs += host_n_allocs;
+}
+
+static BOOLEAN bench_enabled(const char *name) {
+        return !bench_filter || strstr(name, bench_filter);
+}
+
+static VOID bench_run(const char *name, const char *param, BenchFunc func, VOID *ctx) {
+        UINT64 n = 1;
+        UINT64 nsec;
+        UINT64 allocs;
+
+        /* double the iterations until a run takes long enough to be meaningful */
+        for (;;) {
+                UINT64 start, allocs_start;
+
+                bench_paused_nsec = 0;
+                bench_paused_allocs = 0;
+                allocs_start = host_n_allocs;
+                start = now_nsec();
+                func(ctx, n);
+                nsec = now_nsec() - start - bench_paused_nsec;
+                allocs = host_n_allocs - allocs_start - bench_paused_allocs;
+
+                if (nsec >= BENCH_MIN_NSEC || n >= (1ULL << 32))
+                        break;
+
+                /* aim slightly above the minimum, but never grow by more than 100x at once */
+                if (nsec == 0)
+                        n *= 100;
+                else {
+                        UINT64 next = n * BENCH_MIN_NSEC / nsec * 6 / 5 + 1;
+
+                        n = next < n * 2 ? n * 2 : next > n * 100 ? n * 100 : next;
+                }
+        }
+
+        printf("{\"bench\":\"%s\",\"param\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n",
+               name, param, (unsigned long long)n, (double)nsec / n, (double)allocs / n);
+        fflush(stdout);
+}
+
+/* deterministic input data */
+static UINT32 random_state = 0x9e3779b9;
+
+static UINT32 random_u32(VOID) {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state;
+}
+
+/* str_verscmp() */
+static CHAR16 *verscmp_pairs[][2] = {
+        { L"\\EFI\\org.bus1\\bus1-4.10.0-1.fc26.x86_64.efi", L"\\EFI\\org.bus1\\bus1-4.9.12-1.fc26.x86_64.efi" },
+        { L"\\EFI\\org.bus1\\bus1-4.10.0-1.fc26.x86_64.efi", L"\\EFI\\org.bus1\\bus1-4.10.0-1.fc26.x86_64.efi" },
+        { L"\\EFI\\org.bus1\\bus1-4.10.0-rc1.efi", L"\\EFI\\org.bus1\\bus1-4.10.0.efi" },
+        { L"\\EFI\\org.bus1\\bus1-20170101.efi", L"\\EFI\\org.bus1\\bus1-20161231.efi" },
+};
+
+static VOID bench_str_verscmp(VOID *ctx, UINT64 n) {
+        UINTN i = *(UINTN *)ctx;
+        volatile INTN sum = 0;
+
+        for (UINT64 k = 0; k < n; k++)
+                sum += str_verscmp(verscmp_pairs[i][0], verscmp_pairs[i][1]);
+}
+
+/* config_entry_add(), config_sort_entries() */
+typedef struct {
+        Config config;
+        ConfigEntry *shuffled;
+        UINTN n_entries;
+} SortBench;
+
+static VOID config_fill(Config *config, UINTN n_entries) {
+        Volume volume = {};
+
+        for (UINTN i = 0; i < n_entries; i++) {
+                CHAR16 release[64];
+                CHAR16 path[LOADER_PATH_MAX];
+                UINT32 v = random_u32();
+
+                SPrint(release, sizeof(release), L"bus1-%d.%d.%d-%d.fc26.x86_64",
+                       2 + v % 3, (v >> 2) % 20, (v >> 7) % 30, i);
+                SPrint(path, sizeof(path), L"\\EFI\\org.bus1\\%s.efi", release);
+                config_entry_add(config, &volume, release, 0, path,
+                                 L"root=/dev/sda1 rw quiet", -1, ENTRY_EDITOR|ENTRY_AUTOSELECT);
+        }
+}
+
+static VOID bench_config_build(VOID *ctx, UINT64 n) {
+        SortBench *b = ctx;
+
+        for (UINT64 k = 0; k < n; k++) {
+                config_fill(&b->config, b->n_entries);
+                config_free(&b->config);
+        }
+}
+
+static VOID bench_config_sort_entries(VOID *ctx, UINT64 n) {
+        SortBench *b = ctx;
+
+        for (UINT64 k = 0; k < n; k++) {
+                bench_pause();
+                CopyMem(b->config.entries, b->shuffled, b->n_entries * sizeof(ConfigEntry));
+                bench_resume();
+                config_sort_entries(&b->config, 0);
+        }
+}
+
+/* bmp_parse_header(), bmp_to_blt() */
+typedef struct {
+        UINT8 *bmp;
+        UINTN size;
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL *blt;
+} SplashBench;
+
+static UINT8 *bmp_new(UINTN x, UINTN y, UINTN depth, UINTN *ret_size) {
+        struct bmp_file *file;
+        struct bmp_dib *dib;
+        UINTN map_size = depth <= 8 ? sizeof(struct bmp_map) << depth : 0;
+        UINTN row_size = (depth * x + 31) / 32 * 4;
+        UINTN offset = sizeof(struct bmp_file) + sizeof(struct bmp_dib) + map_size;
+        UINTN size = offset + row_size * y;
+        UINT8 *bmp;
+
+        bmp = malloc(size);
+        file = (struct bmp_file *)bmp;
+        *file = (struct bmp_file){
+                .signature = { 'B', 'M' },
+                .size = size,
+                .offset = offset,
+        };
+
+        dib = (struct bmp_dib *)(bmp + sizeof(struct bmp_file));
+        *dib = (struct bmp_dib){
+                .size = sizeof(struct bmp_dib),
+                .x = x,
+                .y = y,
+                .planes = 1,
+                .depth = depth,
+                .image_size = row_size * y,
+        };
+
+        for (UINTN i = sizeof(struct bmp_file) + sizeof(struct bmp_dib); i < size; i++)
+                bmp[i] = random_u32();
+
+        *ret_size = size;
+        return bmp;
+}
+
+/* flat runs of up to 64 pixels, as a mostly flat splash compresses */
+static UINT8 *bmp_new_rle(UINTN x, UINTN y, UINTN depth, UINTN *ret_size) {
+        UINTN header_size = sizeof(struct bmp_file) + sizeof(struct bmp_dib) + (sizeof(struct bmp_map) << depth);
+        UINTN max_size = header_size + (x * 2 + 2) * y + 2;
+        struct bmp_file *file;
+        struct bmp_dib *dib;
+        UINT8 *bmp, *p;
+
+        bmp = malloc(max_size);
+        p = bmp + header_size;
+        for (UINTN row = 0; row < y; row++) {
+                for (UINTN i = 0; i < x;) {
+                        UINTN n = 1 + random_u32() % 64;
+
+                        if (n > x - i)
+                                n = x - i;
+
+                        *p++ = n;
+                        *p++ = random_u32();
+                        i += n;
+                }
+
+                *p++ = 0;
+                *p++ = 0;
+        }
+
+        *p++ = 0;
+        *p++ = 1;
+
+        for (UINTN i = sizeof(struct bmp_file) + sizeof(struct bmp_dib); i < header_size; i++)
+                bmp[i] = random_u32();
+
+        file = (struct bmp_file *)bmp;
+        *file = (struct bmp_file){
+                .signature = { 'B', 'M' },
+                .size = p - bmp,
+                .offset = header_size,
+        };
+
+        dib = (struct bmp_dib *)(bmp + sizeof(struct bmp_file));
+        *dib = (struct bmp_dib){
+                .size = sizeof(struct bmp_dib),
+                .x = x,
+                .y = y,
+                .planes = 1,
+                .depth = depth,
+                .compression = depth == 8 ? 1 : 2,
+                .image_size = p - bmp - header_size,
+        };
+
+        *ret_size = p - bmp;
+        return bmp;
+}
+
+static VOID bench_bmp_parse_header(VOID *ctx, UINT64 n) {
+        SplashBench *b = ctx;
+
+        for (UINT64 k = 0; k < n; k++) {
+                struct bmp_dib *dib;
+                struct bmp_map *map;
+                UINT8 *pixmap = NULL;
+
+                bmp_parse_header(b->bmp, b->size, &dib, &map, &pixmap);
+                bench_sink = pixmap;
+        }
+}
+
+static VOID bench_bmp_to_blt(VOID *ctx, UINT64 n) {
+        SplashBench *b = ctx;
+        struct bmp_dib *dib;
+        struct bmp_map *map;
+        UINT8 *pixmap;
+
+        bmp_parse_header(b->bmp, b->size, &dib, &map, &pixmap);
+        for (UINT64 k = 0; k < n; k++)
+                bmp_to_blt(b->blt, dib, map, pixmap, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL){});
+}
+
+/* pixel_blend() */
+#define BLEND_PIXELS 4096
+
+static VOID bench_pixel_blend(VOID *ctx, UINT64 n) {
+        UINT32 *src = ctx;
+        UINT32 dst[BLEND_PIXELS] = {};
+
+        for (UINT64 k = 0; k < n; k++) {
+                UINT32 s = src[k % BLEND_PIXELS];
+
+                dst[k % BLEND_PIXELS] = pixel_blend(dst[k % BLEND_PIXELS], s & 0xffffff, s >> 24);
+        }
+
+        __asm__ volatile("" : : "r"(dst) : "memory");
+}
+
+/* pefile_parse_sections(), pefile_locate_sections() */
+typedef struct {
+        EFI_FILE file;
+        UINT8 *pe;
+        UINTN size;
+        UINTN pos;
+} PeBench;
+
+static CHAR8 *pe_sections[] = {
+        (CHAR8 *)".release",
+        (CHAR8 *)".options",
+        (CHAR8 *)".linux",
+        (CHAR8 *)".initrd",
+};
+
+static UINT8 *pe_new(UINTN n_sections, UINTN *ret_size) {
+        struct DosFileHeader *dos;
+        struct PeFileHeader *pe;
+        struct PeSectionHeader *sect;
+        UINTN pe_offset = 0x80;
+        UINTN opt_size = 240;
+        UINTN size = pe_offset + 4 + sizeof(struct PeFileHeader) + opt_size +
+                     n_sections * sizeof(struct PeSectionHeader);
+        UINT8 *buf;
+
+        buf = calloc(1, size);
+        dos = (struct DosFileHeader *)buf;
+        CopyMem(dos->Magic, "MZ", 2);
+        dos->ExeHeader = pe_offset;
+
+        CopyMem(buf + pe_offset, "PE\0\0", 4);
+        pe = (struct PeFileHeader *)(buf + pe_offset + 4);
+        pe->Machine = PE_HEADER_MACHINE_X64;
+        pe->NumberOfSections = n_sections;
+        pe->SizeOfOptionalHeader = opt_size;
+
+        /* the sections we look for come last, after the regular ones */
+        sect = (struct PeSectionHeader *)(buf + pe_offset + 4 + sizeof(struct PeFileHeader) + opt_size);
+        for (UINTN i = 0; i < n_sections; i++, sect++) {
+                UINTN k = n_sections - i;
+
+                if (k <= C_ARRAY_SIZE(pe_sections))
+                        CopyMem(sect->Name, pe_sections[k - 1], strlena(pe_sections[k - 1]));
+                else
+                        snprintf((char *)sect->Name, sizeof(sect->Name), ".s%u", (unsigned)i);
+
+                sect->VirtualAddress = 0x1000 * (i + 1);
+                sect->VirtualSize = 0x1000;
+                sect->PointerToRawData = 0x1000 * (i + 1);
+                sect->SizeOfRawData = 0x1000;
+        }
+
+        *ret_size = size;
+        return buf;
+}
+
+static EFI_STATUS pe_file_read(EFI_FILE *file, UINTN *size, VOID *buf) {
+        PeBench *b = (PeBench *)file;
+
+        if (*size > b->size - b->pos)
+                *size = b->size - b->pos;
+
+        CopyMem(buf, b->pe + b->pos, *size);
+        b->pos += *size;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS pe_file_set_position(EFI_FILE *file, UINT64 pos) {
+        PeBench *b = (PeBench *)file;
+
+        if (pos > b->size)
+                return EFI_UNSUPPORTED;
+
+        b->pos = pos;
+        return EFI_SUCCESS;
+}
+
+static VOID bench_pefile_parse_sections(VOID *ctx, UINT64 n) {
+        PeBench *b = ctx;
+
+        for (UINT64 k = 0; k < n; k++) {
+                UINTN offsets[C_ARRAY_SIZE(pe_sections)];
+                UINTN size = b->size;
+
+                pefile_parse_sections(b->pe, &size, pe_sections, C_ARRAY_SIZE(pe_sections),
+                                      NULL, offsets, NULL, NULL);
+                bench_sink = (VOID *)offsets[0];
+        }
+}
+
+static VOID bench_pefile_locate_sections(VOID *ctx, UINT64 n) {
+        PeBench *b = ctx;
+
+        for (UINT64 k = 0; k < n; k++) {
+                UINTN offsets[C_ARRAY_SIZE(pe_sections)];
+                UINTN n_reads = 0;
+
+                b->pos = 0;
+                pefile_locate_sections(&b->file, pe_sections, C_ARRAY_SIZE(pe_sections),
+                                       NULL, offsets, NULL, NULL, &n_reads);
+        }
+}
+
+/* StrniCmp(), loader_filename_parse() */
+typedef struct {
+        CHAR16 *name;
+        CHAR16 *release;
+} FilenameBench;
+
+static VOID bench_StrniCmp(VOID *ctx, UINT64 n) {
+        FilenameBench *b = ctx;
+        UINTN len = StrLen(b->release);
+        volatile INTN sum = 0;
+
+        for (UINT64 k = 0; k < n; k++)
+                sum += StrniCmp(b->name, b->release, len);
+}
+
+static VOID bench_loader_filename_parse(VOID *ctx, UINT64 n) {
+        FilenameBench *b = ctx;
+        UINTN len = StrLen(b->release);
+
+        for (UINT64 k = 0; k < n; k++) {
+                INTN boot_count;
+
+                loader_filename_parse(b->name, b->release, len, &boot_count);
+        }
+}
+
+/* lz4_frame_decompress() */
+typedef struct {
+        UINT8 *lz4;
+        UINTN lz4_size;
+        UINT8 *data;
+        UINTN size;
+} Lz4Bench;
+
+#define LZ4_HASH_BITS 16
+
+static UINT32 lz4_hash(const UINT8 *p) {
+        UINT32 v;
+
+        CopyMem(&v, p, sizeof(v));
+        return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static UINT8 *lz4_length(UINT8 *op, UINTN len) {
+        for (; len >= 255; len -= 255)
+                *op++ = 255;
+        *op++ = len;
+        return op;
+}
+
+/* greedy single-probe LZ4 block; the decoder does not care about the ratio */
+static UINTN lz4_block_compress(const UINT8 *src, UINTN size, UINT8 *dst) {
+        static UINT32 table[1 << LZ4_HASH_BITS];
+        const UINT8 *anchor = src;
+        UINT8 *op = dst;
+        UINTN i = 0;
+
+        memset(table, 0xff, sizeof(table));
+
+        /* the last match must start 12 bytes before the end, the last 5 bytes are literals */
+        while (size >= 13 && i < size - 12) {
+                UINT32 h = lz4_hash(src + i);
+                UINT32 ref = table[h];
+                UINTN lit, len = 0;
+                UINT8 *token;
+
+                table[h] = i;
+                if (ref == 0xffffffff || i - ref > 0xffff || memcmp(src + ref, src + i, 4) != 0) {
+                        i++;
+                        continue;
+                }
+
+                while (i + 4 + len < size - 5 && src[ref + 4 + len] == src[i + 4 + len])
+                        len++;
+
+                lit = src + i - anchor;
+                token = op++;
+                *token = (lit < 15 ? lit : 15) << 4 | (len < 15 ? len : 15);
+                if (lit >= 15)
+                        op = lz4_length(op, lit - 15);
+                CopyMem(op, anchor, lit);
+                op += lit;
+                *op++ = (i - ref) & 0xff;
+                *op++ = (i - ref) >> 8;
+                if (len >= 15)
+                        op = lz4_length(op, len - 15);
+
+                i += 4 + len;
+                anchor = src + i;
+        }
+
+        i = src + size - anchor;
+        *op++ = (i < 15 ? i : 15) << 4;
+        if (i >= 15)
+                op = lz4_length(op, i - 15);
+        CopyMem(op, anchor, i);
+        return op + i - dst;
+}
+
+/* a frame with the content size and independent 4 MiB blocks, no checksums */
+static UINT8 *lz4_frame_new(const UINT8 *src, UINTN size, UINTN *ret_size) {
+        static const UINTN block_max = 4 << 20;
+        UINT8 *frame, *op;
+
+        frame = malloc(15 + size + size / 255 + 16 * (size / block_max + 1) + 4);
+        op = frame;
+        CopyMem(op, "\x04\x22\x4d\x18\x68\x70", 6);
+        for (UINTN i = 0; i < 8; i++)
+                op[6 + i] = (UINT64)size >> (8 * i);
+        op[14] = 0;
+        op += 15;
+
+        for (UINTN pos = 0; pos < size; pos += block_max) {
+                UINTN n = size - pos < block_max ? size - pos : block_max;
+                UINT32 len;
+
+                len = lz4_block_compress(src + pos, n, op + 4);
+                CopyMem(op, &len, sizeof(len));
+                op += 4 + len;
+        }
+
+        CopyMem(op, "\0\0\0\0", 4);
+        op += 4;
+
+        *ret_size = op - frame;
+        return frame;
+}
+
+/* text-like data: short runs of a small vocabulary, with some noise */
+static UINT8 *lz4_data_new(UINTN size) {
+        static const char *words[] = {
+                "mov", "%rax", "%rdi", "call", "0x0", "ret", "push", "pop", "lea", "(%rsp)",
+                "jmp", "cmp", "test", "xor", "%eax", "nop", ",", " ", "\n", "\t",
+        };
+        UINT8 *data;
+        UINTN i = 0;
+
+        data = malloc(size);
+        while (i < size) {
+                UINT32 v = random_u32();
+
+                if (v % 8 == 0) {
+                        data[i++] = v >> 8;
+                        continue;
+                }
+
+                for (const char *w = words[(v >> 3) % C_ARRAY_SIZE(words)]; *w && i < size; w++)
+                        data[i++] = *w;
+        }
+
+        return data;
+}
+
+static UINT8 *lz4_file_new(const char *path, UINTN *ret_size) {
+        UINT8 *data = NULL;
+        UINTN size = 0;
+        FILE *f;
+
+        f = fopen(path, "rb");
+        if (!f)
+                return NULL;
+
+        for (;;) {
+                data = realloc(data, size + (1 << 20));
+                UINTN n = fread(data + size, 1, 1 << 20, f);
+
+                size += n;
+                if (n == 0)
+                        break;
+        }
+
+        fclose(f);
+        *ret_size = size;
+        return data;
+}
+
+static VOID bench_lz4_frame_decompress(VOID *ctx, UINT64 n) {
+        Lz4Bench *b = ctx;
+        UINT8 *dst;
+
+        dst = malloc(b->size);
+        for (UINT64 k = 0; k < n; k++)
+                if (EFI_ERROR(lz4_frame_decompress(b->lz4, b->lz4_size, dst, b->size)))
+                        abort();
+
+        if (memcmp(dst, b->data, b->size) != 0)
+                abort();
+        free(dst);
+}
+
+static VOID lz4_bench_run(const char *name, UINT8 *data, UINTN size) {
+        Lz4Bench b = { .data = data, .size = size };
+        char param[256];
+
+        b.lz4 = lz4_frame_new(data, size, &b.lz4_size);
+        snprintf(param, sizeof(param), "input=%s,size=%u,ratio=%.2f",
+                 name, (unsigned)size, (double)size / b.lz4_size);
+        bench_run("lz4_frame_decompress", param, bench_lz4_frame_decompress, &b);
+        free(b.lz4);
+}
+
+int main(int argc, char **argv) {
+        char param[64];
+
+        if (argc > 1)
+                bench_filter = argv[1];
+
+        host_init();
+
+        if (bench_enabled("str_verscmp"))
+                for (UINTN i = 0; i < C_ARRAY_SIZE(verscmp_pairs); i++) {
+                        snprintf(param, sizeof(param), "pair=%u", (unsigned)i);
+                        bench_run("str_verscmp", param, bench_str_verscmp, &i);
+                }
+
+        for (UINTN n_entries = 10; n_entries <= 10000; n_entries *= 10) {
+                SortBench b = { .n_entries = n_entries };
+
+                snprintf(param, sizeof(param), "entries=%u", (unsigned)n_entries);
+
+                if (bench_enabled("config_build"))
+                        bench_run("config_build", param, bench_config_build, &b);
+
+                if (!bench_enabled("config_sort_entries"))
+                        continue;
+
+                config_fill(&b.config, n_entries);
+                b.shuffled = malloc(n_entries * sizeof(ConfigEntry));
+                CopyMem(b.shuffled, b.config.entries, n_entries * sizeof(ConfigEntry));
+                bench_run("config_sort_entries", param, bench_config_sort_entries, &b);
+                free(b.shuffled);
+                config_free(&b.config);
+        }
+
+        if (bench_enabled("bmp_parse_header") || bench_enabled("bmp_to_blt")) {
+                static const UINTN sizes[][2] = { { 640, 480 }, { 1920, 1080 }, { 3840, 2160 } };
+                static const UINTN depths[] = { 1, 4, 8, 16, 24, 32 };
+
+                for (UINTN s = 0; s < C_ARRAY_SIZE(sizes); s++)
+                        for (UINTN d = 0; d < C_ARRAY_SIZE(depths); d++) {
+                                SplashBench b;
+
+                                b.bmp = bmp_new(sizes[s][0], sizes[s][1], depths[d], &b.size);
+                                b.blt = malloc(sizes[s][0] * sizes[s][1] * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                                snprintf(param, sizeof(param), "%ux%u@%u",
+                                         (unsigned)sizes[s][0], (unsigned)sizes[s][1], (unsigned)depths[d]);
+
+                                if (bench_enabled("bmp_parse_header"))
+                                        bench_run("bmp_parse_header", param, bench_bmp_parse_header, &b);
+                                if (bench_enabled("bmp_to_blt"))
+                                        bench_run("bmp_to_blt", param, bench_bmp_to_blt, &b);
+
+                                free(b.blt);
+                                free(b.bmp);
+                        }
+
+                for (UINTN s = 0; s < C_ARRAY_SIZE(sizes); s++)
+                        for (UINTN d = 4; d <= 8; d += 4) {
+                                SplashBench b;
+
+                                if (!bench_enabled("bmp_to_blt"))
+                                        break;
+
+                                b.bmp = bmp_new_rle(sizes[s][0], sizes[s][1], d, &b.size);
+                                b.blt = malloc(sizes[s][0] * sizes[s][1] * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+                                snprintf(param, sizeof(param), "%ux%u@rle%u",
+                                         (unsigned)sizes[s][0], (unsigned)sizes[s][1], (unsigned)d);
+                                bench_run("bmp_to_blt", param, bench_bmp_to_blt, &b);
+
+                                free(b.blt);
+                                free(b.bmp);
+                        }
+        }
+
+        if (bench_enabled("pixel_blend")) {
+                UINT32 src[BLEND_PIXELS];
+
+                for (UINTN i = 0; i < BLEND_PIXELS; i++)
+                        src[i] = random_u32();
+
+                bench_run("pixel_blend", "pixels=1", bench_pixel_blend, src);
+        }
+
+        if (bench_enabled("pefile_parse_sections") || bench_enabled("pefile_locate_sections")) {
+                static const UINTN n_sections[] = { 4, 16, 48, 96 };
+
+                for (UINTN i = 0; i < C_ARRAY_SIZE(n_sections); i++) {
+                        PeBench b = {
+                                .file.Read = pe_file_read,
+                                .file.SetPosition = pe_file_set_position,
+                        };
+
+                        b.pe = pe_new(n_sections[i], &b.size);
+                        snprintf(param, sizeof(param), "sections=%u", (unsigned)n_sections[i]);
+
+                        if (bench_enabled("pefile_parse_sections"))
+                                bench_run("pefile_parse_sections", param, bench_pefile_parse_sections, &b);
+                        if (bench_enabled("pefile_locate_sections"))
+                                bench_run("pefile_locate_sections", param, bench_pefile_locate_sections, &b);
+
+                        free(b.pe);
+                }
+        }
+
+        if (bench_enabled("StrniCmp") || bench_enabled("loader_filename_parse")) {
+                static FilenameBench names[] = {
+                        { L"bus1-4.10.0-1.fc26.x86_64.efi", L"bus1-4.10.0-1.fc26.x86_64" },
+                        { L"BUS1-4.10.0-1.FC26.X86_64-boot3.efi", L"bus1-4.10.0-1.fc26.x86_64" },
+                        { L"bus1-4.10.0-1.fc26.x86_64.efi", L"bus1-4.9.0-1.fc26.x86_64" },
+                };
+                static const char *kinds[] = { "plain", "boot-count", "mismatch" };
+
+                for (UINTN i = 0; i < C_ARRAY_SIZE(names); i++) {
+                        snprintf(param, sizeof(param), "name=%s", kinds[i]);
+
+                        if (bench_enabled("StrniCmp"))
+                                bench_run("StrniCmp", param, bench_StrniCmp, &names[i]);
+                        if (bench_enabled("loader_filename_parse"))
+                                bench_run("loader_filename_parse", param, bench_loader_filename_parse, &names[i]);
+                }
+        }
+
+        if (bench_enabled("lz4_frame_decompress")) {
+                static const UINTN sizes[] = { 64 << 10, 4 << 20, 32 << 20 };
+                const char *files = getenv("BENCH_FILES");
+
+                for (UINTN i = 0; i < C_ARRAY_SIZE(sizes); i++) {
+                        UINT8 *data = lz4_data_new(sizes[i]);
+
+                        lz4_bench_run("synthetic", data, sizes[i]);
+                        free(data);
+                }
+
+                for (const char *f = files; f && *f;) {
+                        const char *end = strchr(f, ':') ?: f + strlen(f);
+                        char path[4096];
+                        UINT8 *data;
+                        UINTN size;
+
+                        snprintf(path, sizeof(path), "%.*s", (int)(end - f), f);
+                        f = *end ? end + 1 : end;
+
+                        data = lz4_file_new(path, &size);
+                        if (!data || size == 0) {
+                                fprintf(stderr, "Unable to read %s\n", path);
+                                free(data);
+                                continue;
+                        }
+
+                        lz4_bench_run(path, data, size);
+                        free(data);
+                }
+        }
+
+        return 0;
+}
@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+#
+# Convert a BMP or PNG image to the pre-converted splash format of the stub
+# (src/stub/splash.h): a 32-byte header with the size and the fill colour of
+# the screen, then the pixels in BLT order (blue, green, red, reserved), top
+# row first. The stub hands them to Blt() straight from the loaded image.
+# Transparent pixels are blended over the fill colour here, unless --alpha
+# keeps the alpha channel for the stub to blend. With --rle the pixels are
+# stored as runs, which the stub expands into a buffer; flat images shrink
+# to a few kilobytes.
+#
+#   test/convert-splash.py --fill=102030 --rle test/bus1.bmp splash.raw
+#   objcopy --add-section .splash=splash.raw --change-section-vma .splash=0x40000 ...
+#
+
+import argparse
+import struct
+import zlib
+
+MAGIC = b'bus1-sp\0'
+VERSION = 1
+FLAG_ALPHA = 1 << 0
+FLAG_RLE = 1 << 1
+RUN_LITERAL = 1 << 31
+HEADER = struct.Struct('<8sIIII4sI')
+
+
+class ImageError(Exception):
+    pass
+
+
+def mask_channel(value, mask):
+    """Extract the bits of mask from value, scaled to 8 bits."""
+    if not mask:
+        return 0xff
+    shift = (mask & -mask).bit_length() - 1
+    bits = (mask >> shift).bit_length()
+    v = (value & mask) >> shift
+    return (v * 255 + ((1 << bits) - 1) // 2) // ((1 << bits) - 1)
+
+
+def read_bmp(data):
+    """Return (width, height, rows of (r, g, b, a) tuples, top row first)."""
+    if len(data) < 54 or data[0:2] != b'BM':
+        raise ImageError('Not a BMP file')
+
+    offset, = struct.unpack_from('<I', data, 10)
+    dib_size, width, height, planes, depth, compression = struct.unpack_from('<IiiHHI', data, 14)
+    colors_used, = struct.unpack_from('<I', data, 46)
+    if dib_size < 40:
+        raise ImageError('BMP header too old')
+
+    top_down = height < 0
+    height = abs(height)
+
+    if compression == 3:
+        # in the header since V2, after a BITMAPINFOHEADER otherwise
+        masks = list(struct.unpack_from('<III', data, 54)) + [0]
+        if dib_size >= 56:
+            masks[3], = struct.unpack_from('<I', data, 54 + 12)
+    elif compression == 0:
+        # 32 bits are alpha in the low byte, then blue, green and red, as the stub reads them
+        masks = {16: [0x7c00, 0x3e0, 0x1f, 0], 32: [0xff000000, 0xff0000, 0xff00, 0xff]}.get(depth)
+    elif (compression, depth) not in ((1, 8), (2, 4)):
+        raise ImageError('Unsupported BMP compression %d' % compression)
+
+    palette = []
+    if depth <= 8:
+        n = colors_used or 1 << depth
+        table = 14 + dib_size
+        for i in range(n):
+            b, g, r = data[table + 4 * i:table + 4 * i + 3]
+            palette.append((r, g, b, 0xff))
+    elif depth not in (16, 24, 32):
+        raise ImageError('Unsupported BMP depth %d' % depth)
+
+    if compression in (1, 2):
+        rows = read_bmp_rle(data[offset:], width, height, depth, palette)
+        return width, height, rows if top_down else rows[::-1]
+
+    row_size = (depth * width + 31) // 32 * 4
+    if offset + row_size * height > len(data):
+        raise ImageError('BMP file truncated')
+
+    rows = []
+    for y in range(height):
+        row = data[offset + y * row_size:offset + (y + 1) * row_size]
+        pixels = []
+        for x in range(width):
+            if depth <= 8:
+                bit = x * depth
+                index = (row[bit // 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1)
+                pixels.append(palette[index] if index < len(palette) else (0, 0, 0, 0xff))
+            elif depth == 24:
+                b, g, r = row[3 * x:3 * x + 3]
+                pixels.append((r, g, b, 0xff))
+            else:
+                v = int.from_bytes(row[x * depth // 8:(x + 1) * depth // 8], 'little')
+                pixels.append(tuple(mask_channel(v, m) for m in masks))
+        rows.append(pixels)
+
+    if not top_down:
+        rows.reverse()
+    return width, height, rows
+
+
+def read_bmp_rle(data, width, height, depth, palette):
+    """BI_RLE8 and BI_RLE4, bottom row first; skipped pixels are transparent."""
+    rows = [[(0, 0, 0, 0)] * width for _ in range(height)]
+    color = lambda i: palette[i] if i < len(palette) else (0, 0, 0, 0xff)
+    x = y = pos = 0
+    while pos + 2 <= len(data):
+        n, c = data[pos], data[pos + 1]
+        pos += 2
+        if n:
+            indices = [c >> 4 if i % 2 == 0 else c & 0x0f for i in range(n)] if depth == 4 else [c] * n
+        elif c == 0:
+            x, y = 0, y + 1
+            continue
+        elif c == 1:
+            break
+        elif c == 2:
+            x, y = x + data[pos], y + data[pos + 1]
+            pos += 2
+            continue
+        else:
+            size = (c + 1) // 2 if depth == 4 else c
+            literal = data[pos:pos + size]
+            pos += size + size % 2
+            indices = [literal[i // 2] >> 4 if i % 2 == 0 else literal[i // 2] & 0x0f
+                       for i in range(c)] if depth == 4 else list(literal)
+
+        if y >= height or x + len(indices) > width:
+            raise ImageError('BMP run outside of the image')
+        for i in indices:
+            rows[y][x] = color(i)
+            x += 1
+
+    return rows
+
+
+def png_unfilter(raw, height, stride, bpp):
+    rows = []
+    prev = bytearray(stride)
+    pos = 0
+    for _ in range(height):
+        kind = raw[pos]
+        line = bytearray(raw[pos + 1:pos + 1 + stride])
+        pos += 1 + stride
+        for i in range(stride):
+            a = line[i - bpp] if i >= bpp else 0
+            b = prev[i]
+            c = prev[i - bpp] if i >= bpp else 0
+            if kind == 1:
+                line[i] = (line[i] + a) & 0xff
+            elif kind == 2:
+                line[i] = (line[i] + b) & 0xff
+            elif kind == 3:
+                line[i] = (line[i] + (a + b) // 2) & 0xff
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                line[i] = (line[i] + (a if pa <= pb and pa <= pc else b if pb <= pc else c)) & 0xff
+            elif kind != 0:
+                raise ImageError('Invalid PNG filter %d' % kind)
+        rows.append(line)
+        prev = line
+    return rows
+
+
+def read_png(data):
+    """Return (width, height, rows of (r, g, b, a) tuples, top row first)."""
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise ImageError('Not a PNG file')
+
+    pos = 8
+    idat = b''
+    palette = []
+    trns = b''
+    while pos < len(data):
+        size, kind = struct.unpack_from('>I4s', data, pos)
+        chunk = data[pos + 8:pos + 8 + size]
+        pos += 12 + size
+        if kind == b'IHDR':
+            width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif kind == b'PLTE':
+            palette = [tuple(chunk[i:i + 3]) for i in range(0, len(chunk), 3)]
+        elif kind == b'tRNS':
+            trns = chunk
+        elif kind == b'IDAT':
+            idat += chunk
+        elif kind == b'IEND':
+            break
+
+    if interlace:
+        raise ImageError('Interlaced PNG files are not supported')
+
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(color)
+    if channels is None:
+        raise ImageError('Invalid PNG color type %d' % color)
+
+    bits = depth * channels
+    lines = png_unfilter(zlib.decompress(idat), height, (width * bits + 7) // 8, max(bits // 8, 1))
+
+    rows = []
+    for line in lines:
+        pixels = []
+        for x in range(width):
+            if depth < 8:
+                bit = x * depth
+                s = [(line[bit // 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1)]
+            else:
+                n = depth // 8
+                s = [int.from_bytes(line[(x * channels + c) * n:(x * channels + c + 1) * n], 'big')
+                     for c in range(channels)]
+
+            if color == 3:
+                r, g, b = palette[s[0]]
+                a = trns[s[0]] if s[0] < len(trns) else 0xff
+                pixels.append((r, g, b, a))
+                continue
+
+            # scale to 8 bits; gray is replicated to all channels
+            s = [v * 255 // ((1 << depth) - 1) for v in s]
+            if color in (0, 4):
+                s = [s[0], s[0], s[0]] + s[1:]
+            pixels.append(tuple(s) + ((0xff,) if color in (0, 2) else ()))
+        rows.append(pixels)
+
+    return width, height, rows
+
+
+def blend(source, alpha, background):
+    """The stub's blend: straight alpha, rounded division by 255."""
+    t = source * alpha + background * (0xff - alpha) + 0x80
+    return (t + (t >> 8)) >> 8
+
+
+def rle(pixels):
+    """Runs of four-byte pixels: a count and one pixel, or a literal count and the pixels."""
+    words = [pixels[i:i + 4] for i in range(0, len(pixels), 4)]
+    out = bytearray()
+    literal = []
+
+    def flush():
+        if literal:
+            out.extend(struct.pack('<I', RUN_LITERAL | len(literal)) + b''.join(literal))
+            literal.clear()
+
+    i = 0
+    while i < len(words):
+        n = 1
+        while i + n < len(words) and words[i + n] == words[i]:
+            n += 1
+        # a run of two does not pay for ending a literal one
+        if n >= 3:
+            flush()
+            out.extend(struct.pack('<I', n) + words[i])
+        else:
+            literal.extend(words[i:i + n])
+        i += n
+    flush()
+    return bytes(out)
+
+
+def parse_color(s):
+    try:
+        v = int(s.lstrip('#'), 16)
+    except ValueError:
+        raise argparse.ArgumentTypeError('invalid colour: ' + s)
+    if len(s.lstrip('#')) != 6:
+        raise argparse.ArgumentTypeError('colour must be RRGGBB: ' + s)
+    return (v >> 16, (v >> 8) & 0xff, v & 0xff)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a BMP or PNG image to a pre-converted stub splash.')
+    parser.add_argument('input', help='BMP or PNG image')
+    parser.add_argument('output', help='splash section contents')
+    parser.add_argument('--fill', type=parse_color, default=(0, 0, 0),
+                        help='colour of the screen around the image, RRGGBB')
+    parser.add_argument('--alpha', action='store_true',
+                        help='keep the alpha channel and let the stub blend')
+    parser.add_argument('--rle', action='store_true', help='store the pixels as runs')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+
+    try:
+        width, height, rows = read_png(data) if data[:4] == b'\x89PNG' else read_bmp(data)
+    except (ImageError, struct.error, zlib.error) as e:
+        raise SystemExit('%s: %s' % (args.input, e))
+
+    alpha = args.alpha and any(p[3] != 0xff for row in rows for p in row)
+
+    pixels = bytearray()
+    for row in rows:
+        for r, g, b, a in row:
+            if alpha:
+                pixels += bytes((b, g, r, a))
+            else:
+                pixels += bytes((blend(b, a, args.fill[2]), blend(g, a, args.fill[1]),
+                                 blend(r, a, args.fill[0]), 0))
+
+    flags = FLAG_ALPHA if alpha else 0
+    if args.rle:
+        flags |= FLAG_RLE
+        pixels = rle(pixels)
+
+    fill = bytes((args.fill[2], args.fill[1], args.fill[0], 0))
+    with open(args.output, 'wb') as f:
+        f.write(HEADER.pack(MAGIC, VERSION, flags, width, height, fill, 0))
+        f.write(pixels)
+
+
+if __name__ == '__main__':
+    main()
@@ -37,13 +37,33 @@ test -e "$initrd" || initrd=/boot/$(cat /etc/machine-id)/$(uname -r)/initrd
 test -e "$initrd" || initrd=/initrd.img
 test -e "$initrd" || exit 1
 
+# COMPRESS=lz4 stores both as LZ4 frames, decompressed by the stub
+linux_section=.linux
+initrd_section=.initrd
+if [ "$COMPRESS" = lz4 ]; then
+  lz4 -q -f -9 --content-size "$linux" $ROOT/linux.lz4
+  lz4 -q -f -9 --content-size "$initrd" $ROOT/initrd.lz4
+  linux=$ROOT/linux.lz4
+  initrd=$ROOT/initrd.lz4
+  linux_section=.zlinux
+  initrd_section=.zinitrd
+fi
+
+# SPLASH=raw stores the splash pre-converted to BLT pixels, SPLASH=rle as runs of them
+splash=test/bus1.bmp
+if [ "$SPLASH" = raw ] || [ "$SPLASH" = rle ]; then
+  test/convert-splash.py $([ "$SPLASH" = rle ] && echo --rle) "$splash" $ROOT/splash.raw
+  splash=$ROOT/splash.raw
+fi
+
 objcopy \
   --add-section .release=$ROOT/release.txt --change-section-vma .release=0x20000 \
   --add-section .options=$ROOT/options.txt --change-section-vma .options=0x30000 \
-  --add-section .splash=test/bus1.bmp --change-section-vma .splash=0x40000 \
-  --add-section .linux=$linux --change-section-vma .linux=0x2000000 \
-  --add-section .initrd=$initrd --change-section-vma .initrd=0x3000000 \
+  --add-section .splash=$splash --change-section-vma .splash=0x40000 \
+  --add-section $linux_section=$linux --change-section-vma $linux_section=0x2000000 \
+  --add-section $initrd_section=$initrd --change-section-vma $initrd_section=0x3000000 \
   stubx64.efi $ROOT/EFI/org.bus1/bus1-0815.efi
+rm -f $ROOT/linux.lz4 $ROOT/initrd.lz4 $ROOT/splash.raw
 
 sync
 umount $ROOT
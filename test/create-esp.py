@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+#
+# Create a synthetic EFI System Partition with many org.bus1 entries, for
+# boot manager scan benchmarks. Every entry is a small PE image with the
+# .release/.options/.linux/.initrd sections of a stub image; the payloads
+# are generated from the seed, so the same arguments always produce the
+# same files. The tree is written to a directory, and with --image also to
+# a FAT image built with mtools, which does not need root.
+#
+#   test/create-esp.py --entries=2000 --boot-counts=0.3 --malformed=0.05 \
+#           --directory=esp --image=esp.img --boot=bootx64.efi
+#
+
+import argparse
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import uuid
+import zlib
+
+FILE_ALIGNMENT = 0x200
+SECTION_ALIGNMENT = 0x1000
+SECTION_FLAGS = 0x40000040      # initialized data, readable
+MTIME = 315532800               # 1980-01-01, the FAT epoch
+GPT_OFFSET = 1 << 20            # start of the ESP partition in a --gpt image
+GPT_ESP_TYPE = uuid.UUID('c12a7328-f81f-11d2-ba4b-00a0c93ec93b')
+
+MALFORMED = ('truncated', 'garbage', 'mismatch', 'no-release', 'extension', 'boot-count')
+
+
+def parse_range(s):
+    lo, _, hi = s.partition('-')
+    lo = int(lo, 0)
+    hi = int(hi, 0) if hi else lo
+    if lo < 0 or hi < lo:
+        raise argparse.ArgumentTypeError('invalid range: ' + s)
+    return (lo, hi)
+
+
+def parse_share(s):
+    v = float(s)
+    if v < 0 or v > 1:
+        raise argparse.ArgumentTypeError('share must be between 0 and 1: ' + s)
+    return v
+
+
+def align(v, a):
+    return (v + a - 1) // a * a
+
+
+def pe_image(sections, machine=0x8664):
+    """A PE32+ image with the given (name, data) sections and no code."""
+    headers_size = align(0x80 + 24 + 240 + 40 * len(sections), FILE_ALIGNMENT)
+
+    table = b''
+    body = b''
+    va = SECTION_ALIGNMENT
+    for name, data in sections:
+        raw_size = align(len(data), FILE_ALIGNMENT)
+        table += name.encode().ljust(8, b'\0')[:8]
+        table += struct.pack('<IIIIIIHHI', len(data), va, raw_size, headers_size + len(body),
+                             0, 0, 0, 0, SECTION_FLAGS)
+        body += data.ljust(raw_size, b'\0')
+        va += align(max(len(data), 1), SECTION_ALIGNMENT)
+
+    optional = bytearray(240)
+    struct.pack_into('<H', optional, 0, 0x20b)
+    struct.pack_into('<II', optional, 32, SECTION_ALIGNMENT, FILE_ALIGNMENT)
+    struct.pack_into('<II', optional, 56, va, headers_size)
+    struct.pack_into('<H', optional, 68, 10)    # EFI application
+
+    dos = bytearray(0x80)
+    dos[0:2] = b'MZ'
+    struct.pack_into('<I', dos, 0x3c, 0x80)
+
+    coff = b'PE\0\0' + struct.pack('<HHIIIHH', machine, len(sections), 0, 0, 0, len(optional), 0x22)
+    headers = (bytes(dos) + coff + bytes(optional) + table).ljust(headers_size, b'\0')
+    return headers + body
+
+
+def utf16(s):
+    return s.encode('utf-16-le')
+
+
+def linux_payload(rng, size):
+    """A bzImage-shaped blob: a setup header the stub accepts, then filler."""
+    data = bytearray(filler(rng, max(size, 0x1000)))
+    data[0x1f1] = 1                                     # setup_secs
+    data[0x1fe:0x200] = b'\x55\xaa'
+    data[0x200:0x202] = b'\xeb\x66'                     # jump
+    data[0x202:0x206] = b'HdrS'
+    struct.pack_into('<H', data, 0x206, 0x20f)          # version
+    data[0x234] = 1                                     # relocatable_kernel
+    return bytes(data)
+
+
+def filler(rng, size):
+    return rng.getrandbits(8 * size).to_bytes(size, 'little') if size else b''
+
+
+def release_name(i, length, rng):
+    release = 'bus1-%d' % i
+    # the separator only makes sense with at least one character after it
+    if len(release) + 1 < length:
+        release += '.' + ''.join(rng.choice('abcdefghijklmnopqrstuvwxyz0123456789')
+                                 for _ in range(length - len(release) - 1))
+    return release
+
+
+def entry(args, rng, i):
+    """Return (file name, contents) of entry i."""
+    release = release_name(i, rng.randint(*args.release_length), rng)
+    size = rng.randint(*args.section_size)
+    sections = [
+        ('.release', utf16(release)),
+        ('.options', utf16('quiet entry=%d' % i)),
+        ('.linux', linux_payload(rng, size)),
+        ('.initrd', filler(rng, size)),
+    ]
+    for k in range(rng.randint(*args.sections)):
+        sections.append(('.data%d' % k, filler(rng, rng.randint(*args.section_size))))
+    rng.shuffle(sections)
+
+    name = release
+    if rng.random() < args.boot_counts:
+        name += '-boot%d' % rng.randint(0, args.boot_count_max)
+
+    kind = rng.choice(MALFORMED) if rng.random() < args.malformed else None
+    if kind == 'truncated':
+        return name + '.efi', pe_image(sections)[:rng.randint(0x40, 0x200)]
+    if kind == 'garbage':
+        return name + '.efi', filler(rng, rng.randint(1, 4096))
+    if kind == 'mismatch':
+        sections = [(n, utf16('other-%d' % i) if n == '.release' else d) for n, d in sections]
+    elif kind == 'no-release':
+        sections = [(n, d) for n, d in sections if n != '.release']
+    elif kind == 'extension':
+        return name + '.efi.bak', pe_image(sections)
+    elif kind == 'boot-count':
+        name = release + '-boot' + rng.choice(('x', '10', ''))
+
+    return name + '.efi', pe_image(sections)
+
+
+def write(path, data):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, 'wb') as f:
+        f.write(data)
+    os.utime(path, (MTIME, MTIME))
+
+
+def tree_size(directory):
+    size = 0
+    for root, dirs, files in os.walk(directory):
+        size += 4096 * (len(dirs) + 1)
+        for f in files:
+            size += align(os.path.getsize(os.path.join(root, f)), 4096) + 4096
+    return size
+
+
+def mtools(*cmd):
+    env = dict(os.environ, MTOOLS_SKIP_CHECK='1', SOURCE_DATE_EPOCH=str(MTIME))
+    subprocess.run(cmd, check=True, env=env)
+
+
+def gpt_write(f, disk_size, part_size, rng):
+    """A protective MBR and both GPTs with one ESP partition at GPT_OFFSET."""
+    sectors = disk_size // 512
+    first = GPT_OFFSET // 512
+    disk_guid = uuid.UUID(int=rng.getrandbits(128), version=4)
+    part_guid = uuid.UUID(int=rng.getrandbits(128), version=4)
+
+    mbr = bytearray(512)
+    mbr[446:462] = struct.pack('<BBBBBBBBII', 0, 0, 2, 0, 0xee, 0xff, 0xff, 0xff,
+                               1, min(sectors - 1, 0xffffffff))
+    mbr[510:512] = b'\x55\xaa'
+
+    entries = bytearray(128 * 128)
+    entries[0:128] = (GPT_ESP_TYPE.bytes_le + part_guid.bytes_le +
+                      struct.pack('<QQQ', first, first + part_size // 512 - 1, 0) +
+                      utf16('ESP').ljust(72, b'\0'))
+    entries_crc = zlib.crc32(entries)
+
+    def header(lba, alternate, entries_lba):
+        h = bytearray(b'EFI PART' + struct.pack('<IIII', 0x10000, 92, 0, 0) +
+                      struct.pack('<QQQQ', lba, alternate, 34, sectors - 34) +
+                      disk_guid.bytes_le + struct.pack('<QIII', entries_lba, 128, 128, entries_crc))
+        struct.pack_into('<I', h, 16, zlib.crc32(h))
+        return bytes(h).ljust(512, b'\0')
+
+    f.seek(0)
+    f.write(mbr + header(1, sectors - 1, 2) + entries)
+    f.seek((sectors - 33) * 512)
+    f.write(entries + header(sectors - 1, 1, sectors - 33))
+
+
+def create_image(args):
+    if not shutil.which('mformat') or not shutil.which('mcopy'):
+        sys.exit('mformat and mcopy from mtools are required for --image')
+
+    # FAT32 needs at least 65525 clusters; leave room for the directory entries
+    size = max(align(tree_size(args.directory) * 5 // 4, 1 << 20), 64 << 20)
+    image = args.image
+    with open(args.image, 'wb') as f:
+        if args.gpt:
+            f.truncate(GPT_OFFSET + size + GPT_OFFSET)
+            gpt_write(f, GPT_OFFSET + size + GPT_OFFSET, size, random.Random(args.seed))
+            image += '@@%d' % GPT_OFFSET
+        else:
+            f.truncate(size)
+
+    mtools('mformat', '-i', image, '-T', str(size // 512), '-h', '64', '-s', '32', '-F',
+           '-N', '%08x' % (args.seed & 0xffffffff), '-v', 'ESP', '::')
+    mtools('mcopy', '-i', image, '-s', '-m', '-Q', os.path.join(args.directory, 'EFI'), '::/')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Create a synthetic ESP with many org.bus1 entries.')
+    parser.add_argument('--directory', required=True, help='write the tree to this directory')
+    parser.add_argument('--image', help='also build a FAT image of the tree with mtools')
+    parser.add_argument('--gpt', action='store_true', help='put the FAT image into a GPT partition')
+    parser.add_argument('--entries', type=int, default=100, help='number of synthetic org.bus1 entries (0-5000)')
+    parser.add_argument('--boot-counts', type=parse_share, default=0.0,
+                        help='share of entries with a -bootN suffix')
+    parser.add_argument('--boot-count-max', type=int, default=3, choices=range(10),
+                        help='highest N of the -bootN suffixes')
+    parser.add_argument('--release-length', type=parse_range, default=(9, 9),
+                        help='length of the release strings, MIN[-MAX]')
+    parser.add_argument('--sections', type=parse_range, default=(0, 0),
+                        help='number of extra sections per entry, MIN[-MAX]')
+    parser.add_argument('--section-size', type=parse_range, default=(4096, 4096),
+                        help='size of the payload sections in bytes, MIN[-MAX]')
+    parser.add_argument('--malformed', type=parse_share, default=0.0,
+                        help='share of malformed or non-matching entries')
+    parser.add_argument('--entry', action='append', default=[], help='add this file as an org.bus1 entry')
+    parser.add_argument('--boot', help='install this boot manager as the removable media loader')
+    parser.add_argument('--arch', default='x64', help='EFI machine type name of --boot')
+    parser.add_argument('--seed', type=int, default=0, help='seed of the generated contents')
+    args = parser.parse_args()
+
+    if args.entries < 0 or args.entries > 5000:
+        parser.error('--entries must be between 0 and 5000')
+
+    # only the generated part of an existing tree is replaced
+    if os.path.exists(os.path.join(args.directory, 'EFI')):
+        shutil.rmtree(os.path.join(args.directory, 'EFI'))
+
+    rng = random.Random(args.seed)
+    bus1 = os.path.join(args.directory, 'EFI', 'org.bus1')
+    os.makedirs(bus1)
+    for i in range(args.entries):
+        name, data = entry(args, rng, i)
+        write(os.path.join(bus1, name), data)
+
+    for path in args.entry:
+        with open(path, 'rb') as f:
+            write(os.path.join(bus1, os.path.basename(path)), f.read())
+
+    if args.boot:
+        with open(args.boot, 'rb') as f:
+            write(os.path.join(args.directory, 'EFI', 'Boot', 'boot%s.efi' % args.arch), f.read())
+
+    if args.image:
+        create_image(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,510 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Minimal subset of the gnu-efi headers, enough to build the sources for
+ * Linux userspace. Only what the sources use is declared; layouts of the
+ * firmware tables match the UEFI specification up to the last used member.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t UINT8;
+typedef int8_t INT8;
+typedef uint16_t UINT16;
+typedef int16_t INT16;
+typedef uint32_t UINT32;
+typedef int32_t INT32;
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+typedef uintptr_t UINTN;
+typedef intptr_t INTN;
+typedef UINT8 CHAR8;
+typedef UINT16 CHAR16;
+typedef UINT8 BOOLEAN;
+typedef void VOID;
+
+typedef UINTN EFI_STATUS;
+typedef VOID *EFI_HANDLE;
+typedef VOID *EFI_EVENT;
+typedef UINT64 EFI_PHYSICAL_ADDRESS;
+typedef UINT64 EFI_LBA;
+typedef UINTN EFI_TPL;
+
+#define TRUE                    1
+#define FALSE                   0
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+
+#define uefi_call_wrapper(func, va_num, ...) func(__VA_ARGS__)
+
+#define EFIERR(a)               (((UINTN)1 << (sizeof(UINTN) * 8 - 1)) | (a))
+#define EFI_ERROR(a)            (((INTN)(a)) < 0)
+
+#define EFI_SUCCESS             0
+#define EFI_LOAD_ERROR          EFIERR(1)
+#define EFI_INVALID_PARAMETER   EFIERR(2)
+#define EFI_UNSUPPORTED         EFIERR(3)
+#define EFI_BAD_BUFFER_SIZE     EFIERR(4)
+#define EFI_BUFFER_TOO_SMALL    EFIERR(5)
+#define EFI_NOT_READY           EFIERR(6)
+#define EFI_DEVICE_ERROR        EFIERR(7)
+#define EFI_WRITE_PROTECTED     EFIERR(8)
+#define EFI_OUT_OF_RESOURCES    EFIERR(9)
+#define EFI_VOLUME_CORRUPTED    EFIERR(10)
+#define EFI_MEDIA_CHANGED       EFIERR(13)
+#define EFI_NOT_FOUND           EFIERR(14)
+#define EFI_ACCESS_DENIED       EFIERR(15)
+#define EFI_TIMEOUT             EFIERR(18)
+#define EFI_ALREADY_STARTED     EFIERR(20)
+#define EFI_SECURITY_VIOLATION  EFIERR(26)
+#define EFI_CRC_ERROR           EFIERR(27)
+#define EFI_END_OF_FILE         EFIERR(31)
+#define EFI_COMPROMISED_DATA    EFIERR(33)
+
+typedef struct {
+        UINT32 Data1;
+        UINT16 Data2;
+        UINT16 Data3;
+        UINT8 Data4[8];
+} EFI_GUID;
+
+typedef struct {
+        UINT16 Year;
+        UINT8 Month;
+        UINT8 Day;
+        UINT8 Hour;
+        UINT8 Minute;
+        UINT8 Second;
+        UINT8 Pad1;
+        UINT32 Nanosecond;
+        INT16 TimeZone;
+        UINT8 Daylight;
+        UINT8 Pad2;
+} EFI_TIME;
+
+typedef struct {
+        UINT32 Resolution;
+        UINT32 Accuracy;
+        BOOLEAN SetsToZero;
+} EFI_TIME_CAPABILITIES;
+
+/* device paths */
+typedef struct _EFI_DEVICE_PATH {
+        UINT8 Type;
+        UINT8 SubType;
+        UINT8 Length[2];
+} EFI_DEVICE_PATH, EFI_DEVICE_PATH_PROTOCOL;
+
+#define MESSAGING_DEVICE_PATH           0x03
+#define MEDIA_DEVICE_PATH               0x04
+#define MEDIA_HARDDRIVE_DP              0x01
+#define MEDIA_VENDOR_DP                 0x03
+#define MEDIA_FILEPATH_DP               0x04
+#define END_DEVICE_PATH_TYPE            0x7f
+#define END_ENTIRE_DEVICE_PATH_SUBTYPE  0xff
+
+typedef struct {
+        EFI_DEVICE_PATH Header;
+        CHAR16 PathName[1];
+} FILEPATH_DEVICE_PATH;
+
+typedef struct {
+        EFI_DEVICE_PATH Header;
+        EFI_GUID Guid;
+} VENDOR_DEVICE_PATH;
+
+typedef struct {
+        EFI_DEVICE_PATH Header;
+        UINT32 PartitionNumber;
+        UINT64 PartitionStart;
+        UINT64 PartitionSize;
+        UINT8 Signature[16];
+        UINT8 MBRType;
+        UINT8 SignatureType;
+} __attribute__((packed)) HARDDRIVE_DEVICE_PATH;
+
+#define DevicePathType(a)               (((a)->Type) & 0x7f)
+#define DevicePathSubType(a)            ((a)->SubType)
+#define DevicePathNodeLength(a)         ((UINTN)((a)->Length[0] | ((a)->Length[1] << 8)))
+#define NextDevicePathNode(a)           ((EFI_DEVICE_PATH *)(((UINT8 *)(a)) + DevicePathNodeLength(a)))
+#define IsDevicePathEnd(a)              (DevicePathType(a) == END_DEVICE_PATH_TYPE && \
+                                         (a)->SubType == END_ENTIRE_DEVICE_PATH_SUBTYPE)
+#define SetDevicePathNodeLength(a, l)   { (a)->Length[0] = (UINT8)(l); (a)->Length[1] = (UINT8)((l) >> 8); }
+#define SetDevicePathEndNode(a)         { (a)->Type = END_DEVICE_PATH_TYPE; \
+                                          (a)->SubType = END_ENTIRE_DEVICE_PATH_SUBTYPE; \
+                                          (a)->Length[0] = 4; (a)->Length[1] = 0; }
+
+/* memory */
+typedef enum {
+        AllocateAnyPages,
+        AllocateMaxAddress,
+        AllocateAddress,
+        MaxAllocateType,
+} EFI_ALLOCATE_TYPE;
+
+typedef enum {
+        EfiReservedMemoryType,
+        EfiLoaderCode,
+        EfiLoaderData,
+        EfiBootServicesCode,
+        EfiBootServicesData,
+} EFI_MEMORY_TYPE;
+
+#define EFI_PAGE_SIZE           4096
+#define EFI_PAGE_SHIFT          12
+#define EFI_SIZE_TO_PAGES(a)    (((a) >> EFI_PAGE_SHIFT) + (((a) & 0xfff) ? 1 : 0))
+
+#define EFI_FIELD_OFFSET(TYPE, Field) ((UINTN)(&(((TYPE *)0)->Field)))
+
+typedef enum {
+        EfiResetCold,
+        EfiResetWarm,
+        EfiResetShutdown,
+} EFI_RESET_TYPE;
+
+typedef enum {
+        AllHandles,
+        ByRegisterNotify,
+        ByProtocol,
+} EFI_LOCATE_SEARCH_TYPE;
+
+typedef enum {
+        EFI_NATIVE_INTERFACE,
+} EFI_INTERFACE_TYPE;
+
+#define EFI_OPEN_PROTOCOL_GET_PROTOCOL  0x00000002
+
+typedef enum {
+        TimerCancel,
+        TimerPeriodic,
+        TimerRelative,
+} EFI_TIMER_DELAY;
+
+#define EVT_TIMER                       0x80000000
+#define EVT_NOTIFY_SIGNAL               0x00000200
+#define TPL_APPLICATION                 4
+#define TPL_CALLBACK                    8
+
+/* variables */
+#define EFI_MAXIMUM_VARIABLE_SIZE       1024
+#define EFI_VARIABLE_NON_VOLATILE       0x00000001
+#define EFI_VARIABLE_BOOTSERVICE_ACCESS 0x00000002
+#define EFI_VARIABLE_RUNTIME_ACCESS     0x00000004
+
+#define EFI_OS_INDICATIONS_BOOT_TO_FW_UI 0x0000000000000001
+
+#define EFI_GLOBAL_VARIABLE \
+        { 0x8be4df61, 0x93ca, 0x11d2, { 0xaa, 0x0d, 0x00, 0xe0, 0x98, 0x03, 0x2b, 0x8c } }
+
+/* files */
+#define EFI_FILE_INFO_ID \
+        { 0x09576e92, 0x6d3f, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } }
+
+#define EFI_FILE_MODE_READ              0x0000000000000001ULL
+#define EFI_FILE_MODE_WRITE             0x0000000000000002ULL
+#define EFI_FILE_MODE_CREATE            0x8000000000000000ULL
+#define EFI_FILE_READ_ONLY              0x0000000000000001ULL
+#define EFI_FILE_DIRECTORY              0x0000000000000010ULL
+#define EFI_FILE_PROTOCOL_REVISION2     0x00020000
+
+typedef struct {
+        UINT64 Size;
+        UINT64 FileSize;
+        UINT64 PhysicalSize;
+        EFI_TIME CreateTime;
+        EFI_TIME LastAccessTime;
+        EFI_TIME ModificationTime;
+        UINT64 Attribute;
+        CHAR16 FileName[1];
+} EFI_FILE_INFO;
+
+#define SIZE_OF_EFI_FILE_INFO EFI_FIELD_OFFSET(EFI_FILE_INFO, FileName)
+
+typedef struct {
+        EFI_EVENT Event;
+        EFI_STATUS Status;
+        UINTN BufferSize;
+        VOID *Buffer;
+} EFI_FILE_IO_TOKEN;
+
+typedef struct _EFI_FILE_HANDLE {
+        UINT64 Revision;
+        EFI_STATUS (*Open)(struct _EFI_FILE_HANDLE *, struct _EFI_FILE_HANDLE **, CHAR16 *, UINT64, UINT64);
+        EFI_STATUS (*Close)(struct _EFI_FILE_HANDLE *);
+        EFI_STATUS (*Delete)(struct _EFI_FILE_HANDLE *);
+        EFI_STATUS (*Read)(struct _EFI_FILE_HANDLE *, UINTN *, VOID *);
+        EFI_STATUS (*Write)(struct _EFI_FILE_HANDLE *, UINTN *, VOID *);
+        EFI_STATUS (*GetPosition)(struct _EFI_FILE_HANDLE *, UINT64 *);
+        EFI_STATUS (*SetPosition)(struct _EFI_FILE_HANDLE *, UINT64);
+        EFI_STATUS (*GetInfo)(struct _EFI_FILE_HANDLE *, EFI_GUID *, UINTN *, VOID *);
+        EFI_STATUS (*SetInfo)(struct _EFI_FILE_HANDLE *, EFI_GUID *, UINTN, VOID *);
+        EFI_STATUS (*Flush)(struct _EFI_FILE_HANDLE *);
+        EFI_STATUS (*OpenEx)(struct _EFI_FILE_HANDLE *, struct _EFI_FILE_HANDLE **, CHAR16 *, UINT64, UINT64,
+                             EFI_FILE_IO_TOKEN *);
+        EFI_STATUS (*ReadEx)(struct _EFI_FILE_HANDLE *, EFI_FILE_IO_TOKEN *);
+        EFI_STATUS (*WriteEx)(struct _EFI_FILE_HANDLE *, EFI_FILE_IO_TOKEN *);
+        EFI_STATUS (*FlushEx)(struct _EFI_FILE_HANDLE *, EFI_FILE_IO_TOKEN *);
+} EFI_FILE, *EFI_FILE_HANDLE, EFI_FILE_PROTOCOL;
+
+typedef struct _EFI_FILE_IO_INTERFACE {
+        UINT64 Revision;
+        EFI_STATUS (*OpenVolume)(struct _EFI_FILE_IO_INTERFACE *, EFI_FILE_HANDLE *);
+} EFI_FILE_IO_INTERFACE, EFI_SIMPLE_FILE_SYSTEM_PROTOCOL;
+
+/* block devices */
+typedef struct {
+        UINT32 MediaId;
+        BOOLEAN RemovableMedia;
+        BOOLEAN MediaPresent;
+        BOOLEAN LogicalPartition;
+        BOOLEAN ReadOnly;
+        BOOLEAN WriteCaching;
+        UINT32 BlockSize;
+        UINT32 IoAlign;
+        EFI_LBA LastBlock;
+} EFI_BLOCK_IO_MEDIA;
+
+typedef struct _EFI_BLOCK_IO {
+        UINT64 Revision;
+        EFI_BLOCK_IO_MEDIA *Media;
+        EFI_STATUS (*Reset)(struct _EFI_BLOCK_IO *, BOOLEAN);
+        EFI_STATUS (*ReadBlocks)(struct _EFI_BLOCK_IO *, UINT32, EFI_LBA, UINTN, VOID *);
+        EFI_STATUS (*WriteBlocks)(struct _EFI_BLOCK_IO *, UINT32, EFI_LBA, UINTN, VOID *);
+        EFI_STATUS (*FlushBlocks)(struct _EFI_BLOCK_IO *);
+} EFI_BLOCK_IO;
+
+/* graphics */
+typedef struct {
+        UINT8 Blue;
+        UINT8 Green;
+        UINT8 Red;
+        UINT8 Reserved;
+} EFI_GRAPHICS_OUTPUT_BLT_PIXEL;
+
+typedef enum {
+        EfiBltVideoFill,
+        EfiBltVideoToBltBuffer,
+        EfiBltBufferToVideo,
+        EfiBltVideoToVideo,
+        EfiGraphicsOutputBltOperationMax,
+} EFI_GRAPHICS_OUTPUT_BLT_OPERATION;
+
+typedef struct {
+        UINT32 Version;
+        UINT32 HorizontalResolution;
+        UINT32 VerticalResolution;
+        UINT32 PixelFormat;
+        UINT32 PixelInformation[4];
+        UINT32 PixelsPerScanLine;
+} EFI_GRAPHICS_OUTPUT_MODE_INFORMATION;
+
+typedef struct {
+        UINT32 MaxMode;
+        UINT32 Mode;
+        EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+        UINTN SizeOfInfo;
+        EFI_PHYSICAL_ADDRESS FrameBufferBase;
+        UINTN FrameBufferSize;
+} EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE;
+
+typedef struct _EFI_GRAPHICS_OUTPUT_PROTOCOL {
+        EFI_STATUS (*QueryMode)(struct _EFI_GRAPHICS_OUTPUT_PROTOCOL *, UINT32, UINTN *,
+                                EFI_GRAPHICS_OUTPUT_MODE_INFORMATION **);
+        EFI_STATUS (*SetMode)(struct _EFI_GRAPHICS_OUTPUT_PROTOCOL *, UINT32);
+        EFI_STATUS (*Blt)(struct _EFI_GRAPHICS_OUTPUT_PROTOCOL *, EFI_GRAPHICS_OUTPUT_BLT_PIXEL *,
+                          EFI_GRAPHICS_OUTPUT_BLT_OPERATION, UINTN, UINTN, UINTN, UINTN, UINTN, UINTN, UINTN);
+        EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE *Mode;
+} EFI_GRAPHICS_OUTPUT_PROTOCOL;
+
+#define EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID \
+        { 0x9042a9de, 0x23dc, 0x4a38, { 0x96, 0xfb, 0x7a, 0xde, 0xd0, 0x80, 0x51, 0x6a } }
+
+/* console */
+typedef struct {
+        UINT16 ScanCode;
+        CHAR16 UnicodeChar;
+} EFI_INPUT_KEY;
+
+typedef struct _SIMPLE_INPUT_INTERFACE {
+        EFI_STATUS (*Reset)(struct _SIMPLE_INPUT_INTERFACE *, BOOLEAN);
+        EFI_STATUS (*ReadKeyStroke)(struct _SIMPLE_INPUT_INTERFACE *, EFI_INPUT_KEY *);
+        EFI_EVENT WaitForKey;
+} SIMPLE_INPUT_INTERFACE, EFI_SIMPLE_TEXT_INPUT_PROTOCOL;
+
+typedef struct {
+        INT32 MaxMode;
+        INT32 Mode;
+        INT32 Attribute;
+        INT32 CursorColumn;
+        INT32 CursorRow;
+        BOOLEAN CursorVisible;
+} SIMPLE_TEXT_OUTPUT_MODE;
+
+typedef struct _SIMPLE_TEXT_OUTPUT_INTERFACE {
+        EFI_STATUS (*Reset)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, BOOLEAN);
+        EFI_STATUS (*OutputString)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, CHAR16 *);
+        EFI_STATUS (*TestString)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, CHAR16 *);
+        EFI_STATUS (*QueryMode)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, UINTN, UINTN *, UINTN *);
+        EFI_STATUS (*SetMode)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, UINTN);
+        EFI_STATUS (*SetAttribute)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, UINTN);
+        EFI_STATUS (*ClearScreen)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *);
+        EFI_STATUS (*SetCursorPosition)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, UINTN, UINTN);
+        EFI_STATUS (*EnableCursor)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *, BOOLEAN);
+        SIMPLE_TEXT_OUTPUT_MODE *Mode;
+} SIMPLE_TEXT_OUTPUT_INTERFACE, EFI_SIMPLE_TEXT_OUT_PROTOCOL;
+
+#define SCAN_NULL               0x00
+#define SCAN_UP                 0x01
+#define SCAN_DOWN               0x02
+#define SCAN_RIGHT              0x03
+#define SCAN_LEFT               0x04
+#define SCAN_HOME               0x05
+#define SCAN_END                0x06
+#define SCAN_INSERT             0x07
+#define SCAN_DELETE             0x08
+#define SCAN_PAGE_UP            0x09
+#define SCAN_PAGE_DOWN          0x0a
+#define SCAN_F1                 0x0b
+#define SCAN_ESC                0x17
+
+#define CHAR_NULL               0x0000
+#define CHAR_BACKSPACE          0x0008
+#define CHAR_TAB                0x0009
+#define CHAR_LINEFEED           0x000a
+#define CHAR_CARRIAGE_RETURN    0x000d
+
+#define EFI_BLACK               0x00
+#define EFI_LIGHTGRAY           0x07
+#define EFI_WHITE               0x0f
+#define EFI_BACKGROUND_BLACK    0x00
+#define EFI_BACKGROUND_LIGHTGRAY 0x70
+
+/* system table */
+typedef struct {
+        UINT64 Signature;
+        UINT32 Revision;
+        UINT32 HeaderSize;
+        UINT32 CRC32;
+        UINT32 Reserved;
+} EFI_TABLE_HEADER;
+
+typedef struct {
+        EFI_GUID VendorGuid;
+        VOID *VendorTable;
+} EFI_CONFIGURATION_TABLE;
+
+typedef VOID (*EFI_EVENT_NOTIFY)(EFI_EVENT, VOID *);
+
+typedef struct {
+        EFI_TABLE_HEADER Hdr;
+        VOID *RaiseTPL;
+        VOID *RestoreTPL;
+        EFI_STATUS (*AllocatePages)(EFI_ALLOCATE_TYPE, EFI_MEMORY_TYPE, UINTN, EFI_PHYSICAL_ADDRESS *);
+        EFI_STATUS (*FreePages)(EFI_PHYSICAL_ADDRESS, UINTN);
+        VOID *GetMemoryMap;
+        EFI_STATUS (*AllocatePool)(EFI_MEMORY_TYPE, UINTN, VOID **);
+        EFI_STATUS (*FreePool)(VOID *);
+        EFI_STATUS (*CreateEvent)(UINT32, EFI_TPL, EFI_EVENT_NOTIFY, VOID *, EFI_EVENT *);
+        EFI_STATUS (*SetTimer)(EFI_EVENT, EFI_TIMER_DELAY, UINT64);
+        EFI_STATUS (*WaitForEvent)(UINTN, EFI_EVENT *, UINTN *);
+        EFI_STATUS (*SignalEvent)(EFI_EVENT);
+        EFI_STATUS (*CloseEvent)(EFI_EVENT);
+        EFI_STATUS (*CheckEvent)(EFI_EVENT);
+        EFI_STATUS (*InstallProtocolInterface)(EFI_HANDLE *, EFI_GUID *, EFI_INTERFACE_TYPE, VOID *);
+        VOID *ReinstallProtocolInterface;
+        EFI_STATUS (*UninstallProtocolInterface)(EFI_HANDLE, EFI_GUID *, VOID *);
+        EFI_STATUS (*HandleProtocol)(EFI_HANDLE, EFI_GUID *, VOID **);
+        VOID *Reserved;
+        VOID *RegisterProtocolNotify;
+        EFI_STATUS (*LocateHandle)(EFI_LOCATE_SEARCH_TYPE, EFI_GUID *, VOID *, UINTN *, EFI_HANDLE *);
+        EFI_STATUS (*LocateDevicePath)(EFI_GUID *, EFI_DEVICE_PATH **, EFI_HANDLE *);
+        EFI_STATUS (*InstallConfigurationTable)(EFI_GUID *, VOID *);
+        EFI_STATUS (*LoadImage)(BOOLEAN, EFI_HANDLE, EFI_DEVICE_PATH *, VOID *, UINTN, EFI_HANDLE *);
+        EFI_STATUS (*StartImage)(EFI_HANDLE, UINTN *, CHAR16 **);
+        EFI_STATUS (*Exit)(EFI_HANDLE, EFI_STATUS, UINTN, CHAR16 *);
+        EFI_STATUS (*UnloadImage)(EFI_HANDLE);
+        VOID *ExitBootServices;
+        EFI_STATUS (*GetNextMonotonicCount)(UINT64 *);
+        EFI_STATUS (*Stall)(UINTN);
+        EFI_STATUS (*SetWatchdogTimer)(UINTN, UINT64, UINTN, CHAR16 *);
+        VOID *ConnectController;
+        VOID *DisconnectController;
+        EFI_STATUS (*OpenProtocol)(EFI_HANDLE, EFI_GUID *, VOID **, EFI_HANDLE, EFI_HANDLE, UINT32);
+        EFI_STATUS (*CloseProtocol)(EFI_HANDLE, EFI_GUID *, EFI_HANDLE, EFI_HANDLE);
+        VOID *OpenProtocolInformation;
+        VOID *ProtocolsPerHandle;
+        EFI_STATUS (*LocateHandleBuffer)(EFI_LOCATE_SEARCH_TYPE, EFI_GUID *, VOID *, UINTN *, EFI_HANDLE **);
+        EFI_STATUS (*LocateProtocol)(EFI_GUID *, VOID *, VOID **);
+        EFI_STATUS (*InstallMultipleProtocolInterfaces)(EFI_HANDLE *, ...);
+        EFI_STATUS (*UninstallMultipleProtocolInterfaces)(EFI_HANDLE, ...);
+        EFI_STATUS (*CalculateCrc32)(VOID *, UINTN, UINT32 *);
+        VOID (*CopyMem)(VOID *, VOID *, UINTN);
+        VOID (*SetMem)(VOID *, UINTN, UINT8);
+} EFI_BOOT_SERVICES;
+
+typedef struct {
+        EFI_TABLE_HEADER Hdr;
+        EFI_STATUS (*GetTime)(EFI_TIME *, EFI_TIME_CAPABILITIES *);
+        VOID *SetTime;
+        VOID *GetWakeupTime;
+        VOID *SetWakeupTime;
+        VOID *SetVirtualAddressMap;
+        VOID *ConvertPointer;
+        EFI_STATUS (*GetVariable)(CHAR16 *, EFI_GUID *, UINT32 *, UINTN *, VOID *);
+        EFI_STATUS (*GetNextVariableName)(UINTN *, CHAR16 *, EFI_GUID *);
+        EFI_STATUS (*SetVariable)(CHAR16 *, EFI_GUID *, UINT32, UINTN, VOID *);
+        VOID *GetNextHighMonotonicCount;
+        EFI_STATUS (*ResetSystem)(EFI_RESET_TYPE, EFI_STATUS, UINTN, CHAR16 *);
+} EFI_RUNTIME_SERVICES;
+
+typedef struct {
+        EFI_TABLE_HEADER Hdr;
+        CHAR16 *FirmwareVendor;
+        UINT32 FirmwareRevision;
+        EFI_HANDLE ConsoleInHandle;
+        SIMPLE_INPUT_INTERFACE *ConIn;
+        EFI_HANDLE ConsoleOutHandle;
+        SIMPLE_TEXT_OUTPUT_INTERFACE *ConOut;
+        EFI_HANDLE StandardErrorHandle;
+        SIMPLE_TEXT_OUTPUT_INTERFACE *StdErr;
+        EFI_RUNTIME_SERVICES *RuntimeServices;
+        EFI_BOOT_SERVICES *BootServices;
+        UINTN NumberOfTableEntries;
+        EFI_CONFIGURATION_TABLE *ConfigurationTable;
+} EFI_SYSTEM_TABLE;
+
+typedef struct {
+        UINT32 Revision;
+        EFI_HANDLE ParentHandle;
+        EFI_SYSTEM_TABLE *SystemTable;
+        EFI_HANDLE DeviceHandle;
+        EFI_DEVICE_PATH *FilePath;
+        VOID *Reserved;
+        UINT32 LoadOptionsSize;
+        VOID *LoadOptions;
+        VOID *ImageBase;
+        UINT64 ImageSize;
+        EFI_MEMORY_TYPE ImageCodeType;
+        EFI_MEMORY_TYPE ImageDataType;
+        VOID *Unload;
+} EFI_LOADED_IMAGE;
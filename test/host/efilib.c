@@ -0,0 +1,750 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+EFI_SYSTEM_TABLE *ST;
+EFI_BOOT_SERVICES *BS;
+EFI_RUNTIME_SERVICES *RT;
+
+EFI_GUID LoadedImageProtocol = { 0x5b1b31a1, 0x9562, 0x11d2, { 0x8e, 0x3f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID FileSystemProtocol = { 0x964e5b22, 0x6459, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID BlockIoProtocol = { 0x964e5b21, 0x6459, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID DevicePathProtocol = { 0x09576e91, 0x6d3f, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID GraphicsOutputProtocol = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
+EFI_GUID GenericFileInfo = EFI_FILE_INFO_ID;
+EFI_DEVICE_PATH EndDevicePath[] = {
+        { END_DEVICE_PATH_TYPE, END_ENTIRE_DEVICE_PATH_SUBTYPE, { 4, 0 } },
+};
+
+UINT64 host_n_allocs;
+UINT64 host_n_alloc_bytes;
+
+VOID InitializeLib(EFI_HANDLE image, EFI_SYSTEM_TABLE *system_table) {
+        (VOID)image;
+
+        ST = system_table;
+        BS = system_table->BootServices;
+        RT = system_table->RuntimeServices;
+}
+
+/* memory */
+VOID *AllocatePool(UINTN size) {
+        host_n_allocs++;
+        host_n_alloc_bytes += size;
+        return malloc(size ? size : 1);
+}
+
+VOID *AllocateZeroPool(UINTN size) {
+        VOID *p;
+
+        p = AllocatePool(size);
+        if (p)
+                memset(p, 0, size);
+
+        return p;
+}
+
+VOID *ReallocatePool(VOID *p, UINTN old_size, UINTN new_size) {
+        (VOID)old_size;
+
+        host_n_allocs++;
+        host_n_alloc_bytes += new_size;
+        return realloc(p, new_size ? new_size : 1);
+}
+
+VOID FreePool(VOID *p) {
+        free(p);
+}
+
+VOID CopyMem(VOID *dst, const VOID *src, UINTN len) {
+        memmove(dst, src, len);
+}
+
+VOID ZeroMem(VOID *p, UINTN len) {
+        memset(p, 0, len);
+}
+
+VOID SetMem(VOID *p, UINTN len, UINT8 value) {
+        memset(p, value, len);
+}
+
+INTN CompareMem(const VOID *a, const VOID *b, UINTN len) {
+        return memcmp(a, b, len);
+}
+
+INTN CompareGuid(EFI_GUID *a, EFI_GUID *b) {
+        return memcmp(a, b, sizeof(EFI_GUID));
+}
+
+/* strings */
+UINTN StrLen(const CHAR16 *s) {
+        UINTN len = 0;
+
+        while (s[len])
+                len++;
+
+        return len;
+}
+
+INTN StrCmp(const CHAR16 *a, const CHAR16 *b) {
+        while (*a && *a == *b) {
+                a++;
+                b++;
+        }
+
+        return *a - *b;
+}
+
+INTN StrnCmp(const CHAR16 *a, const CHAR16 *b, UINTN len) {
+        while (len > 0 && *a && *a == *b) {
+                a++;
+                b++;
+                len--;
+        }
+
+        return len > 0 ? *a - *b : 0;
+}
+
+static CHAR16 to_lower(CHAR16 c) {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+INTN StriCmp(const CHAR16 *a, const CHAR16 *b) {
+        while (*a && to_lower(*a) == to_lower(*b)) {
+                a++;
+                b++;
+        }
+
+        return to_lower(*a) - to_lower(*b);
+}
+
+VOID StrCpy(CHAR16 *dst, const CHAR16 *src) {
+        while ((*dst++ = *src++))
+                ;
+}
+
+VOID StrCat(CHAR16 *dst, const CHAR16 *src) {
+        StrCpy(dst + StrLen(dst), src);
+}
+
+CHAR16 *StrDuplicate(const CHAR16 *s) {
+        UINTN size = (StrLen(s) + 1) * sizeof(CHAR16);
+        CHAR16 *d;
+
+        d = AllocatePool(size);
+        if (d)
+                memcpy(d, s, size);
+
+        return d;
+}
+
+UINTN strlena(const CHAR8 *s) {
+        return strlen((const char *)s);
+}
+
+INTN strcmpa(const CHAR8 *a, const CHAR8 *b) {
+        return strcmp((const char *)a, (const char *)b);
+}
+
+INTN strncmpa(const CHAR8 *a, const CHAR8 *b, UINTN len) {
+        return strncmp((const char *)a, (const char *)b, len);
+}
+
+UINTN Atoi(const CHAR16 *s) {
+        UINTN n = 0;
+
+        while (*s >= '0' && *s <= '9')
+                n = n * 10 + (*s++ - '0');
+
+        return n;
+}
+
+/* formatting, supports the subset of gnu-efi's conversions used by the sources */
+typedef struct {
+        CHAR16 *buf;
+        UINTN size;
+        UINTN len;
+} Output;
+
+static VOID out_char(Output *out, CHAR16 c) {
+        if (out->len + 1 < out->size)
+                out->buf[out->len] = c;
+        out->len++;
+}
+
+static VOID out_number(Output *out, UINT64 value, BOOLEAN negative, UINTN base, UINTN width, CHAR16 pad) {
+        CHAR16 digits[32];
+        UINTN n = 0;
+
+        do {
+                digits[n++] = L"0123456789abcdef"[value % base];
+                value /= base;
+        } while (value > 0);
+
+        if (negative)
+                digits[n++] = '-';
+
+        while (width > n) {
+                out_char(out, pad);
+                width--;
+        }
+
+        while (n > 0)
+                out_char(out, digits[--n]);
+}
+
+static const CHAR16 *status_to_str(EFI_STATUS status) {
+        switch (status) {
+        case EFI_SUCCESS:               return L"Success";
+        case EFI_LOAD_ERROR:            return L"Load Error";
+        case EFI_INVALID_PARAMETER:     return L"Invalid Parameter";
+        case EFI_UNSUPPORTED:           return L"Unsupported";
+        case EFI_BUFFER_TOO_SMALL:      return L"Buffer Too Small";
+        case EFI_NOT_READY:             return L"Not Ready";
+        case EFI_DEVICE_ERROR:          return L"Device Error";
+        case EFI_WRITE_PROTECTED:       return L"Write Protected";
+        case EFI_OUT_OF_RESOURCES:      return L"Out of Resources";
+        case EFI_MEDIA_CHANGED:         return L"Media changed";
+        case EFI_NOT_FOUND:             return L"Not Found";
+        case EFI_ACCESS_DENIED:         return L"Access Denied";
+        case EFI_TIMEOUT:               return L"Time out";
+        case EFI_SECURITY_VIOLATION:    return L"Security Violation";
+        case EFI_CRC_ERROR:             return L"CRC Error";
+        default:                        return L"Unknown Error";
+        }
+}
+
+static VOID format(Output *out, const CHAR16 *fmt, va_list ap) {
+        for (; *fmt; fmt++) {
+                BOOLEAN is_long = FALSE;
+                CHAR16 pad = ' ';
+                UINTN width = 0;
+                INT64 value;
+
+                if (*fmt != '%') {
+                        out_char(out, *fmt);
+                        continue;
+                }
+
+                fmt++;
+                if (*fmt == '0') {
+                        pad = '0';
+                        fmt++;
+                }
+                while (*fmt >= '0' && *fmt <= '9')
+                        width = width * 10 + (*fmt++ - '0');
+                if (*fmt == 'l') {
+                        is_long = TRUE;
+                        fmt++;
+                }
+
+                switch (*fmt) {
+                case 's': {
+                        const CHAR16 *s = va_arg(ap, CHAR16 *);
+
+                        for (s = s ? s : L"(null)"; *s; s++)
+                                out_char(out, *s);
+                        break;
+                }
+
+                case 'a': {
+                        const char *s = va_arg(ap, char *);
+
+                        for (s = s ? s : "(null)"; *s; s++)
+                                out_char(out, *s);
+                        break;
+                }
+
+                case 'c':
+                        out_char(out, (CHAR16)va_arg(ap, int));
+                        break;
+
+                case 'd':
+                        value = is_long ? va_arg(ap, INT64) : va_arg(ap, int);
+                        out_number(out, value < 0 ? -(UINT64)value : (UINT64)value, value < 0, 10, width, pad);
+                        break;
+
+                case 'u':
+                        out_number(out, is_long ? va_arg(ap, UINT64) : va_arg(ap, unsigned int), FALSE, 10, width, pad);
+                        break;
+
+                case 'x':
+                case 'X':
+                        out_number(out, is_long ? va_arg(ap, UINT64) : va_arg(ap, unsigned int), FALSE, 16, width, pad);
+                        break;
+
+                case 'r':
+                        for (const CHAR16 *s = status_to_str(va_arg(ap, EFI_STATUS)); *s; s++)
+                                out_char(out, *s);
+                        break;
+
+                case '%':
+                        out_char(out, '%');
+                        break;
+
+                default:
+                        out_char(out, '%');
+                        out_char(out, *fmt);
+                        break;
+                }
+        }
+
+        if (out->size > 0)
+                out->buf[out->len < out->size ? out->len : out->size - 1] = '\0';
+}
+
+UINTN SPrint(CHAR16 *buf, UINTN size, const CHAR16 *fmt, ...) {
+        Output out = { buf, size / sizeof(CHAR16), 0 };
+        va_list ap;
+
+        va_start(ap, fmt);
+        format(&out, fmt, ap);
+        va_end(ap);
+
+        return out.len;
+}
+
+CHAR16 *PoolPrint(const CHAR16 *fmt, ...) {
+        Output out = {};
+        va_list ap;
+
+        va_start(ap, fmt);
+        format(&out, fmt, ap);
+        va_end(ap);
+
+        out.buf = AllocatePool((out.len + 1) * sizeof(CHAR16));
+        if (!out.buf)
+                return NULL;
+        out.size = out.len + 1;
+        out.len = 0;
+
+        va_start(ap, fmt);
+        format(&out, fmt, ap);
+        va_end(ap);
+
+        return out.buf;
+}
+
+UINTN Print(const CHAR16 *fmt, ...) {
+        CHAR16 buf[1024];
+        Output out = { buf, sizeof(buf) / sizeof(CHAR16), 0 };
+        va_list ap;
+
+        va_start(ap, fmt);
+        format(&out, fmt, ap);
+        va_end(ap);
+
+        if (ST && ST->ConOut)
+                ST->ConOut->OutputString(ST->ConOut, buf);
+        else
+                for (CHAR16 *s = buf; *s; s++)
+                        putchar(*s < 0x80 ? *s : '?');
+
+        return out.len;
+}
+
+VOID GuidToString(CHAR16 *buf, EFI_GUID *guid) {
+        SPrint(buf, 37 * sizeof(CHAR16), L"%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+               guid->Data1, guid->Data2, guid->Data3,
+               guid->Data4[0], guid->Data4[1], guid->Data4[2], guid->Data4[3],
+               guid->Data4[4], guid->Data4[5], guid->Data4[6], guid->Data4[7]);
+}
+
+/* protocols */
+EFI_FILE_HANDLE LibOpenRoot(EFI_HANDLE device) {
+        EFI_FILE_IO_INTERFACE *volume;
+        EFI_FILE_HANDLE root;
+
+        if (BS->HandleProtocol(device, &FileSystemProtocol, (VOID **)&volume) != EFI_SUCCESS)
+                return NULL;
+
+        if (volume->OpenVolume(volume, &root) != EFI_SUCCESS)
+                return NULL;
+
+        return root;
+}
+
+EFI_FILE_INFO *LibFileInfo(EFI_FILE_HANDLE handle) {
+        EFI_FILE_INFO *info;
+        UINTN size = SIZE_OF_EFI_FILE_INFO + 256 * sizeof(CHAR16);
+        EFI_STATUS r;
+
+        info = AllocatePool(size);
+        r = handle->GetInfo(handle, &GenericFileInfo, &size, info);
+        if (r == EFI_BUFFER_TOO_SMALL) {
+                FreePool(info);
+                info = AllocatePool(size);
+                r = handle->GetInfo(handle, &GenericFileInfo, &size, info);
+        }
+
+        if (EFI_ERROR(r)) {
+                FreePool(info);
+                return NULL;
+        }
+
+        return info;
+}
+
+EFI_STATUS LibLocateHandle(EFI_LOCATE_SEARCH_TYPE type, EFI_GUID *protocol, VOID *key,
+                           UINTN *n_handles, EFI_HANDLE **handles) {
+        return BS->LocateHandleBuffer(type, protocol, key, n_handles, handles);
+}
+
+EFI_STATUS LibLocateProtocol(EFI_GUID *protocol, VOID **interface) {
+        return BS->LocateProtocol(protocol, NULL, interface);
+}
+
+EFI_STATUS LibGetSystemConfigurationTable(EFI_GUID *guid, VOID **table) {
+        for (UINTN i = 0; i < ST->NumberOfTableEntries; i++)
+                if (CompareGuid(&ST->ConfigurationTable[i].VendorGuid, guid) == 0) {
+                        *table = ST->ConfigurationTable[i].VendorTable;
+                        return EFI_SUCCESS;
+                }
+
+        return EFI_NOT_FOUND;
+}
+
+/* device paths */
+EFI_DEVICE_PATH *DevicePathFromHandle(EFI_HANDLE handle) {
+        EFI_DEVICE_PATH *path;
+
+        if (BS->HandleProtocol(handle, &DevicePathProtocol, (VOID **)&path) != EFI_SUCCESS)
+                return NULL;
+
+        return path;
+}
+
+UINTN DevicePathSize(EFI_DEVICE_PATH *path) {
+        EFI_DEVICE_PATH *node;
+
+        for (node = path; !IsDevicePathEnd(node); node = NextDevicePathNode(node))
+                ;
+
+        return (UINT8 *)node - (UINT8 *)path + sizeof(EFI_DEVICE_PATH);
+}
+
+EFI_DEVICE_PATH *AppendDevicePath(EFI_DEVICE_PATH *a, EFI_DEVICE_PATH *b) {
+        EFI_DEVICE_PATH *path;
+        UINTN size_a = a ? DevicePathSize(a) - sizeof(EFI_DEVICE_PATH) : 0;
+        UINTN size_b = DevicePathSize(b);
+
+        path = AllocatePool(size_a + size_b);
+        if (!path)
+                return NULL;
+
+        if (a)
+                memcpy(path, a, size_a);
+        memcpy((UINT8 *)path + size_a, b, size_b);
+
+        return path;
+}
+
+EFI_DEVICE_PATH *FileDevicePath(EFI_HANDLE device, CHAR16 *file_name) {
+        _Alignas(8) UINT8 buf[sizeof(EFI_DEVICE_PATH) + 512 * sizeof(CHAR16) + sizeof(EFI_DEVICE_PATH)];
+        FILEPATH_DEVICE_PATH *file = (FILEPATH_DEVICE_PATH *)buf;
+        UINTN size = (StrLen(file_name) + 1) * sizeof(CHAR16);
+        EFI_DEVICE_PATH *end;
+
+        if (size > 512 * sizeof(CHAR16))
+                return NULL;
+
+        file->Header.Type = MEDIA_DEVICE_PATH;
+        file->Header.SubType = MEDIA_FILEPATH_DP;
+        SetDevicePathNodeLength(&file->Header, sizeof(EFI_DEVICE_PATH) + size);
+        memcpy(file->PathName, file_name, size);
+        end = NextDevicePathNode(&file->Header);
+        SetDevicePathEndNode(end);
+
+        return AppendDevicePath(device ? DevicePathFromHandle(device) : NULL, &file->Header);
+}
+
+CHAR16 *DevicePathToStr(EFI_DEVICE_PATH *path) {
+        CHAR16 *str;
+        UINTN len = 0;
+
+        str = AllocateZeroPool(DevicePathSize(path) * sizeof(CHAR16) + sizeof(CHAR16));
+        if (!str)
+                return NULL;
+
+        /* only file path nodes are printed, all others are abbreviated */
+        for (EFI_DEVICE_PATH *node = path; !IsDevicePathEnd(node); node = NextDevicePathNode(node)) {
+                if (len > 0)
+                        str[len++] = '/';
+
+                if (DevicePathType(node) == MEDIA_DEVICE_PATH && DevicePathSubType(node) == MEDIA_FILEPATH_DP) {
+                        FILEPATH_DEVICE_PATH *file = (FILEPATH_DEVICE_PATH *)node;
+
+                        for (CHAR16 *s = file->PathName; *s; s++)
+                                str[len++] = *s;
+                } else
+                        str[len++] = '?';
+        }
+
+        return str;
+}
+
+/* default firmware: memory, time and a volatile variable store, no devices */
+typedef struct HostVariable {
+        struct HostVariable *next;
+        EFI_GUID vendor;
+        CHAR16 *name;
+        UINT32 attributes;
+        UINTN size;
+        UINT8 data[];
+} HostVariable;
+
+static HostVariable *host_variables;
+
+static EFI_STATUS host_allocate_pages(EFI_ALLOCATE_TYPE type, EFI_MEMORY_TYPE memory_type,
+                                      UINTN n_pages, EFI_PHYSICAL_ADDRESS *addr) {
+        VOID *p;
+
+        (VOID)memory_type;
+
+        /* fixed addresses cannot be honored in a process */
+        if (type != AllocateAnyPages && type != AllocateMaxAddress)
+                return EFI_NOT_FOUND;
+
+        if (posix_memalign(&p, EFI_PAGE_SIZE, n_pages * EFI_PAGE_SIZE) != 0)
+                return EFI_OUT_OF_RESOURCES;
+
+        host_n_allocs++;
+        host_n_alloc_bytes += n_pages * EFI_PAGE_SIZE;
+        *addr = (EFI_PHYSICAL_ADDRESS)(UINTN)p;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_free_pages(EFI_PHYSICAL_ADDRESS addr, UINTN n_pages) {
+        (VOID)n_pages;
+
+        free((VOID *)(UINTN)addr);
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_allocate_pool(EFI_MEMORY_TYPE type, UINTN size, VOID **p) {
+        (VOID)type;
+
+        *p = AllocatePool(size);
+        return *p ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+static EFI_STATUS host_free_pool(VOID *p) {
+        FreePool(p);
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_handle_protocol(EFI_HANDLE handle, EFI_GUID *protocol, VOID **interface) {
+        (VOID)handle;
+        (VOID)protocol;
+        (VOID)interface;
+
+        return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS host_locate_handle_buffer(EFI_LOCATE_SEARCH_TYPE type, EFI_GUID *protocol, VOID *key,
+                                            UINTN *n_handles, EFI_HANDLE **handles) {
+        (VOID)type;
+        (VOID)protocol;
+        (VOID)key;
+
+        *n_handles = 0;
+        *handles = NULL;
+        return EFI_NOT_FOUND;
+}
+
+static EFI_STATUS host_locate_protocol(EFI_GUID *protocol, VOID *key, VOID **interface) {
+        (VOID)protocol;
+        (VOID)key;
+
+        *interface = NULL;
+        return EFI_NOT_FOUND;
+}
+
+static EFI_STATUS host_stall(UINTN usec) {
+        struct timespec ts = { usec / 1000000, (usec % 1000000) * 1000 };
+
+        nanosleep(&ts, NULL);
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_set_watchdog_timer(UINTN timeout, UINT64 code, UINTN size, CHAR16 *data) {
+        (VOID)timeout;
+        (VOID)code;
+        (VOID)size;
+        (VOID)data;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_calculate_crc32(VOID *data, UINTN size, UINT32 *crc) {
+        UINT32 c = 0xffffffff;
+
+        for (UINTN i = 0; i < size; i++) {
+                c ^= ((UINT8 *)data)[i];
+                for (UINTN k = 0; k < 8; k++)
+                        c = (c >> 1) ^ (0xedb88320 & -(c & 1));
+        }
+
+        *crc = ~c;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_get_time(EFI_TIME *time, EFI_TIME_CAPABILITIES *capabilities) {
+        struct timespec ts;
+        struct tm tm;
+
+        (VOID)capabilities;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        gmtime_r(&ts.tv_sec, &tm);
+        ZeroMem(time, sizeof(*time));
+        time->Year = tm.tm_year + 1900;
+        time->Month = tm.tm_mon + 1;
+        time->Day = tm.tm_mday;
+        time->Hour = tm.tm_hour;
+        time->Minute = tm.tm_min;
+        time->Second = tm.tm_sec;
+        time->Nanosecond = ts.tv_nsec;
+        return EFI_SUCCESS;
+}
+
+static HostVariable **host_variable_find(CHAR16 *name, EFI_GUID *vendor) {
+        HostVariable **v;
+
+        for (v = &host_variables; *v; v = &(*v)->next)
+                if (CompareGuid(&(*v)->vendor, vendor) == 0 && StrCmp((*v)->name, name) == 0)
+                        break;
+
+        return v;
+}
+
+static EFI_STATUS host_get_variable(CHAR16 *name, EFI_GUID *vendor, UINT32 *attributes, UINTN *size, VOID *data) {
+        HostVariable *v;
+
+        v = *host_variable_find(name, vendor);
+        if (!v)
+                return EFI_NOT_FOUND;
+
+        if (attributes)
+                *attributes = v->attributes;
+
+        if (*size < v->size) {
+                *size = v->size;
+                return EFI_BUFFER_TOO_SMALL;
+        }
+
+        CopyMem(data, v->data, v->size);
+        *size = v->size;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_set_variable(CHAR16 *name, EFI_GUID *vendor, UINT32 attributes, UINTN size, VOID *data) {
+        HostVariable **slot, *v;
+
+        slot = host_variable_find(name, vendor);
+        if (*slot) {
+                v = *slot;
+                *slot = v->next;
+                FreePool(v->name);
+                FreePool(v);
+        }
+
+        if (size == 0)
+                return EFI_SUCCESS;
+
+        v = AllocatePool(sizeof(HostVariable) + size);
+        if (!v)
+                return EFI_OUT_OF_RESOURCES;
+
+        v->vendor = *vendor;
+        v->name = StrDuplicate(name);
+        v->attributes = attributes;
+        v->size = size;
+        CopyMem(v->data, data, size);
+        v->next = host_variables;
+        host_variables = v;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS host_get_next_variable_name(UINTN *size, CHAR16 *name, EFI_GUID *vendor) {
+        HostVariable *v = host_variables;
+        UINTN len;
+
+        /* an empty name starts the iteration, otherwise continue after the given variable */
+        if (name[0] != '\0') {
+                v = *host_variable_find(name, vendor);
+                if (!v)
+                        return EFI_INVALID_PARAMETER;
+                v = v->next;
+        }
+
+        if (!v)
+                return EFI_NOT_FOUND;
+
+        len = (StrLen(v->name) + 1) * sizeof(CHAR16);
+        if (*size < len) {
+                *size = len;
+                return EFI_BUFFER_TOO_SMALL;
+        }
+
+        CopyMem(name, v->name, len);
+        *vendor = v->vendor;
+        *size = len;
+        return EFI_SUCCESS;
+}
+
+static EFI_BOOT_SERVICES host_boot_services = {
+        .AllocatePages = host_allocate_pages,
+        .FreePages = host_free_pages,
+        .AllocatePool = host_allocate_pool,
+        .FreePool = host_free_pool,
+        .HandleProtocol = host_handle_protocol,
+        .LocateHandleBuffer = host_locate_handle_buffer,
+        .LocateProtocol = host_locate_protocol,
+        .Stall = host_stall,
+        .SetWatchdogTimer = host_set_watchdog_timer,
+        .CalculateCrc32 = host_calculate_crc32,
+};
+
+static EFI_RUNTIME_SERVICES host_runtime_services = {
+        .GetTime = host_get_time,
+        .GetVariable = host_get_variable,
+        .GetNextVariableName = host_get_next_variable_name,
+        .SetVariable = host_set_variable,
+};
+
+static EFI_SYSTEM_TABLE host_system_table = {
+        .FirmwareVendor = L"bus1 host",
+        .FirmwareRevision = 0x10000,
+        .BootServices = &host_boot_services,
+        .RuntimeServices = &host_runtime_services,
+};
+
+VOID host_init(VOID) {
+        host_boot_services.Hdr.Revision = 2 << 16 | 60;
+        host_runtime_services.Hdr.Revision = 2 << 16 | 60;
+        host_system_table.Hdr.Revision = 2 << 16 | 60;
+        InitializeLib(NULL, &host_system_table);
+}
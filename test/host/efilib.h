@@ -0,0 +1,86 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * The parts of gnu-efi's library used by the sources, implemented for
+ * Linux userspace on top of the firmware tables in ST/BS/RT.
+ */
+
+#pragma once
+
+#include <efi.h>
+
+extern EFI_SYSTEM_TABLE *ST;
+extern EFI_BOOT_SERVICES *BS;
+extern EFI_RUNTIME_SERVICES *RT;
+
+extern EFI_GUID LoadedImageProtocol;
+extern EFI_GUID FileSystemProtocol;
+extern EFI_GUID BlockIoProtocol;
+extern EFI_GUID DevicePathProtocol;
+extern EFI_GUID GraphicsOutputProtocol;
+extern EFI_GUID GenericFileInfo;
+extern EFI_DEVICE_PATH EndDevicePath[];
+
+VOID InitializeLib(EFI_HANDLE image, EFI_SYSTEM_TABLE *system_table);
+
+VOID *AllocatePool(UINTN size);
+VOID *AllocateZeroPool(UINTN size);
+VOID *ReallocatePool(VOID *p, UINTN old_size, UINTN new_size);
+VOID FreePool(VOID *p);
+
+VOID CopyMem(VOID *dst, const VOID *src, UINTN len);
+VOID ZeroMem(VOID *p, UINTN len);
+VOID SetMem(VOID *p, UINTN len, UINT8 value);
+INTN CompareMem(const VOID *a, const VOID *b, UINTN len);
+INTN CompareGuid(EFI_GUID *a, EFI_GUID *b);
+
+UINTN StrLen(const CHAR16 *s);
+INTN StrCmp(const CHAR16 *a, const CHAR16 *b);
+INTN StrnCmp(const CHAR16 *a, const CHAR16 *b, UINTN len);
+INTN StriCmp(const CHAR16 *a, const CHAR16 *b);
+VOID StrCpy(CHAR16 *dst, const CHAR16 *src);
+VOID StrCat(CHAR16 *dst, const CHAR16 *src);
+CHAR16 *StrDuplicate(const CHAR16 *s);
+UINTN strlena(const CHAR8 *s);
+INTN strcmpa(const CHAR8 *a, const CHAR8 *b);
+INTN strncmpa(const CHAR8 *a, const CHAR8 *b, UINTN len);
+UINTN Atoi(const CHAR16 *s);
+
+UINTN Print(const CHAR16 *fmt, ...);
+UINTN SPrint(CHAR16 *buf, UINTN size, const CHAR16 *fmt, ...);
+CHAR16 *PoolPrint(const CHAR16 *fmt, ...);
+VOID GuidToString(CHAR16 *buf, EFI_GUID *guid);
+
+EFI_FILE_HANDLE LibOpenRoot(EFI_HANDLE device);
+EFI_FILE_INFO *LibFileInfo(EFI_FILE_HANDLE handle);
+EFI_STATUS LibLocateHandle(EFI_LOCATE_SEARCH_TYPE type, EFI_GUID *protocol, VOID *key,
+                           UINTN *n_handles, EFI_HANDLE **handles);
+EFI_STATUS LibLocateProtocol(EFI_GUID *protocol, VOID **interface);
+EFI_STATUS LibGetSystemConfigurationTable(EFI_GUID *guid, VOID **table);
+
+EFI_DEVICE_PATH *DevicePathFromHandle(EFI_HANDLE handle);
+EFI_DEVICE_PATH *FileDevicePath(EFI_HANDLE device, CHAR16 *file_name);
+EFI_DEVICE_PATH *AppendDevicePath(EFI_DEVICE_PATH *a, EFI_DEVICE_PATH *b);
+UINTN DevicePathSize(EFI_DEVICE_PATH *path);
+CHAR16 *DevicePathToStr(EFI_DEVICE_PATH *path);
+
+/* host only: allocation statistics and a default firmware for code without I/O */
+extern UINT64 host_n_allocs;
+extern UINT64 host_n_alloc_bytes;
+
+VOID host_init(VOID);
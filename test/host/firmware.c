@@ -0,0 +1,2202 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <efi.h>
+#include <efilib.h>
+#include "firmware.h"
+
+#define CONSOLE_COLUMNS         80
+#define CONSOLE_ROWS            25
+#define HANDLES_MAX             64
+#define PROTOCOLS_MAX           8
+#define KEYS_MAX                256
+
+static const char *call_names[_FIRMWARE_CALL_MAX] = {
+        [FIRMWARE_OPEN_VOLUME]          = "OpenVolume",
+        [FIRMWARE_OPEN]                 = "Open",
+        [FIRMWARE_CLOSE]                = "Close",
+        [FIRMWARE_READ]                 = "Read",
+        [FIRMWARE_READ_EX]              = "ReadEx",
+        [FIRMWARE_WRITE]                = "Write",
+        [FIRMWARE_GET_INFO]             = "GetInfo",
+        [FIRMWARE_SET_INFO]             = "SetInfo",
+        [FIRMWARE_SET_POSITION]         = "SetPosition",
+        [FIRMWARE_DELETE]               = "Delete",
+        [FIRMWARE_FLUSH]                = "Flush",
+        [FIRMWARE_READ_BLOCKS]          = "ReadBlocks",
+        [FIRMWARE_HANDLE_PROTOCOL]      = "HandleProtocol",
+        [FIRMWARE_LOCATE_HANDLE_BUFFER] = "LocateHandleBuffer",
+        [FIRMWARE_LOCATE_PROTOCOL]      = "LocateProtocol",
+        [FIRMWARE_LOCATE_DEVICE_PATH]   = "LocateDevicePath",
+        [FIRMWARE_ALLOCATE_PAGES]       = "AllocatePages",
+        [FIRMWARE_ALLOCATE_POOL]        = "AllocatePool",
+        [FIRMWARE_LOAD_IMAGE]           = "LoadImage",
+        [FIRMWARE_GET_VARIABLE]         = "GetVariable",
+        [FIRMWARE_SET_VARIABLE]         = "SetVariable",
+        [FIRMWARE_OUTPUT_STRING]        = "OutputString",
+        [FIRMWARE_READ_KEY_STROKE]      = "ReadKeyStroke",
+        [FIRMWARE_BLT]                  = "Blt",
+        [FIRMWARE_BLT_READ]             = "BltRead",
+        [FIRMWARE_STALL]                = "Stall",
+};
+
+typedef struct {
+        UINT64 count;
+        UINT64 bytes;
+        UINT64 nsec;
+} CallStats;
+
+typedef struct {
+        EFI_GUID guid;
+        VOID *interface;
+} Protocol;
+
+typedef struct {
+        Protocol protocols[PROTOCOLS_MAX];
+        UINTN n_protocols;
+} Handle;
+
+typedef struct {
+        EFI_FILE_IO_INTERFACE io;
+        char *root;
+        Handle *handle;
+} Volume;
+
+typedef struct {
+        EFI_FILE file;
+        Volume *volume;
+        char *path;
+        int fd;
+        DIR *dir;
+        struct dirent *pending;
+} File;
+
+typedef struct {
+        EFI_BLOCK_IO io;
+        EFI_BLOCK_IO_MEDIA media;
+        int fd;
+} Disk;
+
+typedef struct {
+        EFI_GRAPHICS_OUTPUT_PROTOCOL gop;
+        EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE mode;
+        EFI_GRAPHICS_OUTPUT_MODE_INFORMATION info;
+        UINT32 *framebuffer;
+} Display;
+
+typedef struct {
+        EFI_LOADED_IMAGE loaded_image;
+        Handle *handle;
+        char *path;
+} Image;
+
+typedef struct {
+        UINT32 type;
+        EFI_EVENT_NOTIFY notify;
+        VOID *context;
+        BOOLEAN signaled;
+        UINT64 deadline;
+        UINT64 period;
+} Event;
+
+static FirmwareConfig firmware;
+static CallStats stats[_FIRMWARE_CALL_MAX];
+static jmp_buf firmware_jmp;
+static EFI_STATUS firmware_status;
+static const char *firmware_reason;
+static UINT64 firmware_start;
+
+static EFI_SYSTEM_TABLE system_table;
+static EFI_BOOT_SERVICES boot_services;
+static EFI_RUNTIME_SERVICES runtime_services;
+static EFI_RUNTIME_SERVICES host_runtime_services;
+static EFI_BOOT_SERVICES host_boot_services;
+static EFI_CONFIGURATION_TABLE config_tables[16];
+
+static Handle *handles[HANDLES_MAX];
+static UINTN n_handles;
+static Volume *esp;
+static Display *display;
+
+static SIMPLE_TEXT_OUTPUT_INTERFACE conout;
+static SIMPLE_TEXT_OUTPUT_MODE conout_mode;
+static CHAR16 screen[CONSOLE_ROWS][CONSOLE_COLUMNS];
+static UINT8 screen_attr[CONSOLE_ROWS][CONSOLE_COLUMNS];
+static BOOLEAN screen_dirty;
+static UINTN n_frames;
+
+static SIMPLE_INPUT_INTERFACE conin;
+static Event conin_event;
+static EFI_INPUT_KEY keys[KEYS_MAX];
+static const char *key_names[KEYS_MAX];
+static UINTN n_keys;
+static UINTN keys_pos;
+
+/* time and costs */
+static UINT64 now_nsec(VOID) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (UINT64)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+static VOID wait_nsec(UINT64 nsec) {
+        UINT64 end = now_nsec() + nsec;
+
+        /* sleep through long waits, spin through short ones to stay accurate */
+        if (nsec > 1000 * 1000) {
+                struct timespec ts = { (nsec - 100 * 1000) / 1000000000, (nsec - 100 * 1000) % 1000000000 };
+
+                nanosleep(&ts, NULL);
+        }
+
+        while (now_nsec() < end)
+                ;
+}
+
+/* account a call and return its cost without spending it */
+static UINT64 charge_async(FirmwareCall call, UINT64 bytes) {
+        const FirmwareCost *cost = &firmware.costs[call];
+        UINT64 nsec = cost->nsec + cost->nsec_per_byte * bytes;
+
+        stats[call].count++;
+        stats[call].bytes += bytes;
+        stats[call].nsec += nsec;
+
+        return nsec;
+}
+
+static VOID charge(FirmwareCall call, UINT64 bytes) {
+        UINT64 nsec;
+
+        nsec = charge_async(call, bytes);
+        if (nsec > 0)
+                wait_nsec(nsec);
+}
+
+static BOOLEAN duration_parse(const char *s, UINT64 *nsec) {
+        static const struct {
+                const char *suffix;
+                double factor;
+        } units[] = {
+                { "ns", 1 },
+                { "us", 1000 },
+                { "ms", 1000 * 1000 },
+                { "s", 1000 * 1000 * 1000 },
+                { "", 1000 },
+        };
+        char *end;
+        double value;
+
+        value = strtod(s, &end);
+        if (end == s || value < 0)
+                return FALSE;
+
+        for (UINTN i = 0; i < sizeof(units) / sizeof(units[0]); i++)
+                if (strcmp(end, units[i].suffix) == 0) {
+                        *nsec = (UINT64)(value * units[i].factor + 0.5);
+                        return TRUE;
+                }
+
+        return FALSE;
+}
+
+/* "<call>=<cost>[/<cost per byte>]", durations take ns, us, ms or s, and default to us; "all" sets every call */
+EFI_STATUS firmware_cost_parse(FirmwareConfig *config, const char *spec) {
+        char name[64];
+        char fixed[64];
+        const char *eq, *slash;
+        FirmwareCost cost = {};
+        BOOLEAN found = FALSE;
+
+        eq = strchr(spec, '=');
+        if (!eq || (UINTN)(eq - spec) >= sizeof(name))
+                return EFI_INVALID_PARAMETER;
+        memcpy(name, spec, eq - spec);
+        name[eq - spec] = '\0';
+
+        slash = strchr(eq + 1, '/');
+        if (slash) {
+                if ((UINTN)(slash - eq - 1) >= sizeof(fixed))
+                        return EFI_INVALID_PARAMETER;
+                memcpy(fixed, eq + 1, slash - eq - 1);
+                fixed[slash - eq - 1] = '\0';
+                if (!duration_parse(slash + 1, &cost.nsec_per_byte))
+                        return EFI_INVALID_PARAMETER;
+        } else
+                snprintf(fixed, sizeof(fixed), "%s", eq + 1);
+
+        if (fixed[0] != '\0' && !duration_parse(fixed, &cost.nsec))
+                return EFI_INVALID_PARAMETER;
+
+        for (UINTN i = 0; i < _FIRMWARE_CALL_MAX; i++)
+                if (strcasecmp(name, "all") == 0 || strcasecmp(name, call_names[i]) == 0) {
+                        config->costs[i] = cost;
+                        found = TRUE;
+                }
+
+        return found ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+/* strings */
+static char *utf8_from_utf16(const CHAR16 *s, UINTN len) {
+        char *str, *p;
+
+        p = str = malloc(len * 3 + 1);
+        for (UINTN i = 0; i < len && s[i]; i++) {
+                CHAR16 c = s[i];
+
+                if (c < 0x80)
+                        *p++ = c;
+                else if (c < 0x800) {
+                        *p++ = 0xc0 | (c >> 6);
+                        *p++ = 0x80 | (c & 0x3f);
+                } else {
+                        *p++ = 0xe0 | (c >> 12);
+                        *p++ = 0x80 | ((c >> 6) & 0x3f);
+                        *p++ = 0x80 | (c & 0x3f);
+                }
+        }
+        *p = '\0';
+
+        return str;
+}
+
+static CHAR16 *utf16_from_utf8(const char *s) {
+        const UINT8 *u = (const UINT8 *)s;
+        CHAR16 *str, *p;
+
+        p = str = AllocatePool((strlen(s) + 1) * sizeof(CHAR16));
+        while (*u) {
+                if (*u < 0x80)
+                        *p++ = *u++;
+                else if ((*u & 0xe0) == 0xc0 && u[1]) {
+                        *p++ = ((u[0] & 0x1f) << 6) | (u[1] & 0x3f);
+                        u += 2;
+                } else if ((*u & 0xf0) == 0xe0 && u[1] && u[2]) {
+                        *p++ = ((u[0] & 0x0f) << 12) | ((u[1] & 0x3f) << 6) | (u[2] & 0x3f);
+                        u += 3;
+                } else {
+                        *p++ = 0xfffd;
+                        u++;
+                }
+        }
+        *p = '\0';
+
+        return str;
+}
+
+static VOID json_string(FILE *f, const char *s) {
+        fputc('"', f);
+        for (; *s; s++) {
+                if (*s == '"' || *s == '\\')
+                        fprintf(f, "\\%c", *s);
+                else if ((UINT8)*s < 0x20)
+                        fprintf(f, "\\u%04x", (UINT8)*s);
+                else
+                        fputc(*s, f);
+        }
+        fputc('"', f);
+}
+
+/* {"event":"<event>","<key>":"<value>",...} on the log */
+VOID firmware_event(const char *event, ...) {
+        const char *key;
+        va_list ap;
+
+        if (!firmware.log)
+                return;
+
+        fprintf(firmware.log, "{\"event\":");
+        json_string(firmware.log, event);
+
+        va_start(ap, event);
+        while ((key = va_arg(ap, const char *))) {
+                fprintf(firmware.log, ",");
+                json_string(firmware.log, key);
+                fprintf(firmware.log, ":");
+                json_string(firmware.log, va_arg(ap, const char *));
+        }
+        va_end(ap);
+
+        fprintf(firmware.log, "}\n");
+        fflush(firmware.log);
+}
+
+/* handles */
+static Handle *handle_new(VOID) {
+        Handle *h;
+
+        if (n_handles == HANDLES_MAX)
+                return NULL;
+
+        h = calloc(1, sizeof(Handle));
+        handles[n_handles++] = h;
+        return h;
+}
+
+static VOID handle_free(Handle *h) {
+        for (UINTN i = 0; i < n_handles; i++)
+                if (handles[i] == h) {
+                        memmove(&handles[i], &handles[i + 1], (n_handles - i - 1) * sizeof(Handle *));
+                        n_handles--;
+                        break;
+                }
+
+        free(h);
+}
+
+static BOOLEAN handle_valid(EFI_HANDLE handle) {
+        for (UINTN i = 0; i < n_handles; i++)
+                if (handles[i] == handle)
+                        return TRUE;
+
+        return FALSE;
+}
+
+static VOID *handle_protocol(Handle *h, EFI_GUID *guid) {
+        for (UINTN i = 0; i < h->n_protocols; i++)
+                if (CompareGuid(&h->protocols[i].guid, guid) == 0)
+                        return h->protocols[i].interface;
+
+        return NULL;
+}
+
+static EFI_STATUS handle_install(Handle *h, EFI_GUID *guid, VOID *interface) {
+        if (handle_protocol(h, guid))
+                return EFI_INVALID_PARAMETER;
+
+        if (h->n_protocols == PROTOCOLS_MAX)
+                return EFI_OUT_OF_RESOURCES;
+
+        h->protocols[h->n_protocols++] = (Protocol){ *guid, interface };
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS handle_uninstall(Handle *h, EFI_GUID *guid, VOID *interface) {
+        for (UINTN i = 0; i < h->n_protocols; i++)
+                if (CompareGuid(&h->protocols[i].guid, guid) == 0 && h->protocols[i].interface == interface) {
+                        h->protocols[i] = h->protocols[--h->n_protocols];
+                        return EFI_SUCCESS;
+                }
+
+        return EFI_NOT_FOUND;
+}
+
+/* SATA(port)[/HD(1,GPT)] */
+static EFI_DEVICE_PATH *device_path_new(UINT16 port, BOOLEAN partition) {
+        struct {
+                EFI_DEVICE_PATH header;
+                UINT16 port;
+                UINT16 multiplier;
+                UINT16 lun;
+        } __attribute__((packed)) sata = {
+                { MESSAGING_DEVICE_PATH, 0x12, { sizeof(sata), 0 } }, port, 0xffff, 0,
+        };
+        HARDDRIVE_DEVICE_PATH hd = {
+                .Header = { MEDIA_DEVICE_PATH, MEDIA_HARDDRIVE_DP, { sizeof(hd), 0 } },
+                .PartitionNumber = 1,
+                .MBRType = 2,
+                .SignatureType = 2,
+        };
+        UINT8 *path, *p;
+
+        p = path = AllocateZeroPool(sizeof(sata) + sizeof(hd) + sizeof(EFI_DEVICE_PATH));
+        memcpy(p, &sata, sizeof(sata));
+        p += sizeof(sata);
+        if (partition) {
+                memcpy(p, &hd, sizeof(hd));
+                p += sizeof(hd);
+        }
+        SetDevicePathEndNode((EFI_DEVICE_PATH *)p);
+
+        return (EFI_DEVICE_PATH *)path;
+}
+
+/* the device path of a handle is a prefix of the given path */
+static UINTN device_path_match(Handle *h, EFI_DEVICE_PATH *path) {
+        EFI_DEVICE_PATH *device_path;
+        UINTN len;
+
+        device_path = handle_protocol(h, &DevicePathProtocol);
+        if (!device_path)
+                return 0;
+
+        len = DevicePathSize(device_path) - sizeof(EFI_DEVICE_PATH);
+        if (len == 0 || len > DevicePathSize(path) - sizeof(EFI_DEVICE_PATH))
+                return 0;
+
+        if (memcmp(device_path, path, len) != 0)
+                return 0;
+
+        return len;
+}
+
+/* files */
+static EFI_STATUS file_open(EFI_FILE *this, EFI_FILE **new, CHAR16 *name, UINT64 mode, UINT64 attributes);
+static EFI_STATUS file_close(EFI_FILE *this);
+static EFI_STATUS file_delete(EFI_FILE *this);
+static EFI_STATUS file_read(EFI_FILE *this, UINTN *size, VOID *buf);
+static EFI_STATUS file_write(EFI_FILE *this, UINTN *size, VOID *buf);
+static EFI_STATUS file_get_position(EFI_FILE *this, UINT64 *pos);
+static EFI_STATUS file_set_position(EFI_FILE *this, UINT64 pos);
+static EFI_STATUS file_get_info(EFI_FILE *this, EFI_GUID *type, UINTN *size, VOID *buf);
+static EFI_STATUS file_set_info(EFI_FILE *this, EFI_GUID *type, UINTN size, VOID *buf);
+static EFI_STATUS file_flush(EFI_FILE *this);
+static EFI_STATUS file_open_ex(EFI_FILE *this, EFI_FILE **new, CHAR16 *name, UINT64 mode, UINT64 attributes,
+                               EFI_FILE_IO_TOKEN *token);
+static EFI_STATUS file_read_ex(EFI_FILE *this, EFI_FILE_IO_TOKEN *token);
+static EFI_STATUS file_write_ex(EFI_FILE *this, EFI_FILE_IO_TOKEN *token);
+static EFI_STATUS file_flush_ex(EFI_FILE *this, EFI_FILE_IO_TOKEN *token);
+static EFI_STATUS event_signal(EFI_EVENT event);
+
+static File *file_new(Volume *volume, char *path, UINT64 mode) {
+        struct stat st;
+        File *f;
+
+        if (stat(path, &st) < 0)
+                return NULL;
+
+        f = calloc(1, sizeof(File));
+        f->file = (EFI_FILE){
+                .Revision = EFI_FILE_PROTOCOL_REVISION2,
+                .Open = file_open,
+                .Close = file_close,
+                .Delete = file_delete,
+                .Read = file_read,
+                .Write = file_write,
+                .GetPosition = file_get_position,
+                .SetPosition = file_set_position,
+                .GetInfo = file_get_info,
+                .SetInfo = file_set_info,
+                .Flush = file_flush,
+                .OpenEx = file_open_ex,
+                .ReadEx = file_read_ex,
+                .WriteEx = file_write_ex,
+                .FlushEx = file_flush_ex,
+        };
+        f->volume = volume;
+        f->path = path;
+        f->fd = -1;
+
+        if (S_ISDIR(st.st_mode))
+                f->dir = opendir(path);
+        else
+                f->fd = open(path, (mode & EFI_FILE_MODE_WRITE) ? O_RDWR : O_RDONLY);
+
+        if (!f->dir && f->fd < 0) {
+                free(f);
+                return NULL;
+        }
+
+        return f;
+}
+
+/* look up one path component, FAT is case-insensitive */
+static char *path_child(const char *dir, const char *name, BOOLEAN *exists) {
+        char *path = NULL;
+        struct dirent *de;
+        struct stat st;
+        DIR *d;
+
+        if (asprintf(&path, "%s/%s", dir, name) < 0)
+                return NULL;
+
+        *exists = stat(path, &st) == 0;
+        if (*exists)
+                return path;
+
+        d = opendir(dir);
+        if (!d)
+                return path;
+
+        while ((de = readdir(d)))
+                if (strcasecmp(de->d_name, name) == 0) {
+                        free(path);
+                        if (asprintf(&path, "%s/%s", dir, de->d_name) < 0)
+                                path = NULL;
+                        *exists = TRUE;
+                        break;
+                }
+
+        closedir(d);
+        return path;
+}
+
+static char *path_resolve(Volume *volume, const char *base, const CHAR16 *name, BOOLEAN *exists) {
+        char *name8, *component, *save = NULL;
+        char *path;
+
+        name8 = utf8_from_utf16(name, StrLen(name));
+        path = strdup(name8[0] == '\\' ? volume->root : base);
+        *exists = TRUE;
+
+        for (component = strtok_r(name8, "\\", &save); component; component = strtok_r(NULL, "\\", &save)) {
+                char *child;
+
+                /* only the last component may be missing */
+                if (!*exists) {
+                        free(path);
+                        path = NULL;
+                        break;
+                }
+
+                if (strcmp(component, ".") == 0)
+                        continue;
+
+                if (strcmp(component, "..") == 0) {
+                        if (strcmp(path, volume->root) != 0)
+                                *strrchr(path, '/') = '\0';
+                        continue;
+                }
+
+                child = path_child(path, component, exists);
+                free(path);
+                path = child;
+                if (!path)
+                        break;
+        }
+
+        free(name8);
+        return path;
+}
+
+static EFI_STATUS file_open(EFI_FILE *this, EFI_FILE **new, CHAR16 *name, UINT64 mode, UINT64 attributes) {
+        File *f = (File *)this;
+        File *n;
+        char *path;
+        BOOLEAN exists;
+
+        charge(FIRMWARE_OPEN, 0);
+
+        if (!f->dir)
+                return EFI_INVALID_PARAMETER;
+
+        path = path_resolve(f->volume, f->path, name, &exists);
+        if (!path)
+                return EFI_NOT_FOUND;
+
+        if (!exists) {
+                int fd;
+
+                if (!(mode & EFI_FILE_MODE_CREATE)) {
+                        free(path);
+                        return EFI_NOT_FOUND;
+                }
+
+                if (attributes & EFI_FILE_DIRECTORY) {
+                        if (mkdir(path, 0755) < 0) {
+                                free(path);
+                                return EFI_ACCESS_DENIED;
+                        }
+                } else {
+                        fd = open(path, O_CREAT|O_EXCL|O_WRONLY, 0644);
+                        if (fd < 0) {
+                                free(path);
+                                return EFI_ACCESS_DENIED;
+                        }
+                        close(fd);
+                }
+        }
+
+        n = file_new(f->volume, path, mode);
+        if (!n) {
+                free(path);
+                return EFI_ACCESS_DENIED;
+        }
+
+        *new = &n->file;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_close(EFI_FILE *this) {
+        File *f = (File *)this;
+
+        charge(FIRMWARE_CLOSE, 0);
+
+        if (f->dir)
+                closedir(f->dir);
+        if (f->fd >= 0)
+                close(f->fd);
+        free(f->path);
+        free(f);
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_delete(EFI_FILE *this) {
+        File *f = (File *)this;
+        int k;
+
+        charge(FIRMWARE_DELETE, 0);
+
+        k = f->dir ? rmdir(f->path) : unlink(f->path);
+        file_close(this);
+
+        return k < 0 ? EFI_ACCESS_DENIED : EFI_SUCCESS;
+}
+
+static EFI_TIME time_from_timespec(const struct timespec *ts) {
+        EFI_TIME t = {};
+        struct tm tm;
+
+        gmtime_r(&ts->tv_sec, &tm);
+        t.Year = tm.tm_year + 1900;
+        t.Month = tm.tm_mon + 1;
+        t.Day = tm.tm_mday;
+        t.Hour = tm.tm_hour;
+        t.Minute = tm.tm_min;
+        t.Second = tm.tm_sec;
+        t.Nanosecond = ts->tv_nsec;
+
+        return t;
+}
+
+static EFI_STATUS file_info_fill(const char *path, const char *name, UINTN *size, VOID *buf) {
+        EFI_FILE_INFO *info = buf;
+        CHAR16 *name16;
+        UINTN needed;
+        struct stat st;
+
+        if (stat(path, &st) < 0)
+                return EFI_DEVICE_ERROR;
+
+        name16 = utf16_from_utf8(name);
+        needed = SIZE_OF_EFI_FILE_INFO + (StrLen(name16) + 1) * sizeof(CHAR16);
+        if (*size < needed) {
+                FreePool(name16);
+                *size = needed;
+                return EFI_BUFFER_TOO_SMALL;
+        }
+
+        info->Size = needed;
+        info->FileSize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+        info->PhysicalSize = st.st_blocks * 512;
+        info->CreateTime = time_from_timespec(&st.st_ctim);
+        info->LastAccessTime = time_from_timespec(&st.st_atim);
+        info->ModificationTime = time_from_timespec(&st.st_mtim);
+        info->Attribute = S_ISDIR(st.st_mode) ? EFI_FILE_DIRECTORY : 0;
+        if (!(st.st_mode & S_IWUSR))
+                info->Attribute |= EFI_FILE_READ_ONLY;
+        CopyMem(info->FileName, name16, (StrLen(name16) + 1) * sizeof(CHAR16));
+        FreePool(name16);
+
+        *size = needed;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_read_do(File *f, UINTN *size, VOID *buf) {
+        ssize_t len;
+
+        if (f->dir) {
+                for (;;) {
+                        char *path = NULL;
+                        EFI_STATUS r;
+
+                        if (!f->pending)
+                                f->pending = readdir(f->dir);
+
+                        /* end of directory */
+                        if (!f->pending) {
+                                *size = 0;
+                                return EFI_SUCCESS;
+                        }
+
+                        if (strcmp(f->pending->d_name, ".") == 0 || strcmp(f->pending->d_name, "..") == 0) {
+                                f->pending = NULL;
+                                continue;
+                        }
+
+                        if (asprintf(&path, "%s/%s", f->path, f->pending->d_name) < 0)
+                                return EFI_OUT_OF_RESOURCES;
+
+                        /* a buffer which is too small does not consume the entry */
+                        r = file_info_fill(path, f->pending->d_name, size, buf);
+                        free(path);
+                        if (r != EFI_BUFFER_TOO_SMALL)
+                                f->pending = NULL;
+
+                        return r;
+                }
+        }
+
+        len = read(f->fd, buf, *size);
+        if (len < 0)
+                return EFI_DEVICE_ERROR;
+
+        *size = len;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_read(EFI_FILE *this, UINTN *size, VOID *buf) {
+        EFI_STATUS r;
+
+        r = file_read_do((File *)this, size, buf);
+        charge(FIRMWARE_READ, r == EFI_SUCCESS ? *size : 0);
+
+        return r;
+}
+
+static EFI_STATUS file_write(EFI_FILE *this, UINTN *size, VOID *buf) {
+        File *f = (File *)this;
+        ssize_t len;
+
+        charge(FIRMWARE_WRITE, *size);
+
+        if (f->dir)
+                return EFI_UNSUPPORTED;
+
+        len = write(f->fd, buf, *size);
+        if (len < 0)
+                return EFI_DEVICE_ERROR;
+
+        *size = len;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_get_position(EFI_FILE *this, UINT64 *pos) {
+        File *f = (File *)this;
+        off_t offset;
+
+        if (f->dir)
+                return EFI_UNSUPPORTED;
+
+        offset = lseek(f->fd, 0, SEEK_CUR);
+        if (offset < 0)
+                return EFI_DEVICE_ERROR;
+
+        *pos = offset;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_set_position(EFI_FILE *this, UINT64 pos) {
+        File *f = (File *)this;
+
+        charge(FIRMWARE_SET_POSITION, 0);
+
+        if (f->dir) {
+                if (pos != 0)
+                        return EFI_UNSUPPORTED;
+
+                rewinddir(f->dir);
+                f->pending = NULL;
+                return EFI_SUCCESS;
+        }
+
+        if (pos == 0xffffffffffffffffULL) {
+                if (lseek(f->fd, 0, SEEK_END) < 0)
+                        return EFI_DEVICE_ERROR;
+        } else if (lseek(f->fd, pos, SEEK_SET) < 0)
+                return EFI_DEVICE_ERROR;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_get_info(EFI_FILE *this, EFI_GUID *type, UINTN *size, VOID *buf) {
+        File *f = (File *)this;
+        const char *name;
+
+        charge(FIRMWARE_GET_INFO, 0);
+
+        if (CompareGuid(type, &GenericFileInfo) != 0)
+                return EFI_UNSUPPORTED;
+
+        /* the root directory has an empty name */
+        name = strcmp(f->path, f->volume->root) == 0 ? "" : strrchr(f->path, '/') + 1;
+        return file_info_fill(f->path, name, size, buf);
+}
+
+static EFI_STATUS file_set_info(EFI_FILE *this, EFI_GUID *type, UINTN size, VOID *buf) {
+        File *f = (File *)this;
+        EFI_FILE_INFO *info = buf;
+        char *name;
+
+        charge(FIRMWARE_SET_INFO, size);
+
+        if (CompareGuid(type, &GenericFileInfo) != 0)
+                return EFI_UNSUPPORTED;
+
+        if (size < SIZE_OF_EFI_FILE_INFO + sizeof(CHAR16))
+                return EFI_BAD_BUFFER_SIZE;
+
+        if (!f->dir && ftruncate(f->fd, info->FileSize) < 0)
+                return EFI_ACCESS_DENIED;
+
+        /* a different file name renames the file in its directory */
+        name = utf8_from_utf16(info->FileName, (size - SIZE_OF_EFI_FILE_INFO) / sizeof(CHAR16));
+        if (name[0] != '\0' && !strchr(name, '\\') && strcmp(name, strrchr(f->path, '/') + 1) != 0) {
+                char *path = NULL;
+                int k;
+
+                k = asprintf(&path, "%.*s/%s", (int)(strrchr(f->path, '/') - f->path), f->path, name);
+                if (k < 0 || rename(f->path, path) < 0) {
+                        free(path);
+                        free(name);
+                        return EFI_ACCESS_DENIED;
+                }
+
+                free(f->path);
+                f->path = path;
+        }
+        free(name);
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_flush(EFI_FILE *this) {
+        (VOID)this;
+
+        charge(FIRMWARE_FLUSH, 0);
+        return EFI_SUCCESS;
+}
+
+/* the asynchronous variants complete immediately and signal the token */
+static EFI_STATUS token_complete(EFI_FILE_IO_TOKEN *token, EFI_STATUS r) {
+        if (!token->Event)
+                return r;
+
+        token->Status = r;
+        event_signal(token->Event);
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_open_ex(EFI_FILE *this, EFI_FILE **new, CHAR16 *name, UINT64 mode, UINT64 attributes,
+                               EFI_FILE_IO_TOKEN *token) {
+        return token_complete(token, file_open(this, new, name, mode, attributes));
+}
+
+/* an asynchronous read is done at once, but its event fires only after the cost has passed */
+static EFI_STATUS file_read_ex(EFI_FILE *this, EFI_FILE_IO_TOKEN *token) {
+        Event *e = token->Event;
+        UINT64 nsec;
+        EFI_STATUS r;
+
+        r = file_read_do((File *)this, &token->BufferSize, token->Buffer);
+        if (!e) {
+                charge(FIRMWARE_READ_EX, r == EFI_SUCCESS ? token->BufferSize : 0);
+                return r;
+        }
+
+        nsec = charge_async(FIRMWARE_READ_EX, r == EFI_SUCCESS ? token->BufferSize : 0);
+        token->Status = r;
+        if (nsec == 0)
+                return token_complete(token, r);
+
+        e->period = 0;
+        e->deadline = now_nsec() + nsec;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS file_write_ex(EFI_FILE *this, EFI_FILE_IO_TOKEN *token) {
+        return token_complete(token, file_write(this, &token->BufferSize, token->Buffer));
+}
+
+static EFI_STATUS file_flush_ex(EFI_FILE *this, EFI_FILE_IO_TOKEN *token) {
+        return token_complete(token, file_flush(this));
+}
+
+static EFI_STATUS volume_open(EFI_FILE_IO_INTERFACE *this, EFI_FILE_HANDLE *root) {
+        Volume *volume = (Volume *)this;
+        File *f;
+
+        charge(FIRMWARE_OPEN_VOLUME, 0);
+
+        f = file_new(volume, strdup(volume->root), EFI_FILE_MODE_READ);
+        if (!f)
+                return EFI_DEVICE_ERROR;
+
+        *root = &f->file;
+        return EFI_SUCCESS;
+}
+
+static Volume *volume_new(const char *dir, UINT16 port) {
+        char path[PATH_MAX];
+        Volume *volume;
+
+        if (!realpath(dir, path))
+                return NULL;
+
+        volume = calloc(1, sizeof(Volume));
+        volume->io.Revision = 0x00010000;
+        volume->io.OpenVolume = volume_open;
+        volume->root = strdup(path);
+        volume->handle = handle_new();
+        handle_install(volume->handle, &FileSystemProtocol, volume);
+        handle_install(volume->handle, &DevicePathProtocol, device_path_new(port, TRUE));
+
+        return volume;
+}
+
+/* block device */
+static EFI_STATUS disk_reset(EFI_BLOCK_IO *this, BOOLEAN verify) {
+        (VOID)this;
+        (VOID)verify;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS disk_read_blocks(EFI_BLOCK_IO *this, UINT32 media_id, EFI_LBA lba, UINTN size, VOID *buf) {
+        Disk *disk = (Disk *)this;
+
+        charge(FIRMWARE_READ_BLOCKS, size);
+
+        if (media_id != disk->media.MediaId)
+                return EFI_MEDIA_CHANGED;
+
+        if (size % disk->media.BlockSize != 0)
+                return EFI_BAD_BUFFER_SIZE;
+
+        if (lba > disk->media.LastBlock || size / disk->media.BlockSize > disk->media.LastBlock - lba + 1)
+                return EFI_INVALID_PARAMETER;
+
+        if (pread(disk->fd, buf, size, lba * disk->media.BlockSize) != (ssize_t)size)
+                return EFI_DEVICE_ERROR;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS disk_write_blocks(EFI_BLOCK_IO *this, UINT32 media_id, EFI_LBA lba, UINTN size, VOID *buf) {
+        (VOID)this;
+        (VOID)media_id;
+        (VOID)lba;
+        (VOID)size;
+        (VOID)buf;
+
+        return EFI_WRITE_PROTECTED;
+}
+
+static EFI_STATUS disk_flush_blocks(EFI_BLOCK_IO *this) {
+        (VOID)this;
+
+        return EFI_SUCCESS;
+}
+
+static Disk *disk_new(const char *image) {
+        struct stat st;
+        Disk *disk;
+        Handle *h;
+        int fd;
+
+        fd = open(image, O_RDONLY);
+        if (fd < 0)
+                return NULL;
+
+        if (fstat(fd, &st) < 0 || st.st_size < 512) {
+                close(fd);
+                return NULL;
+        }
+
+        disk = calloc(1, sizeof(Disk));
+        disk->fd = fd;
+        disk->media = (EFI_BLOCK_IO_MEDIA){
+                .MediaPresent = TRUE,
+                .ReadOnly = TRUE,
+                .BlockSize = 512,
+                .LastBlock = st.st_size / 512 - 1,
+        };
+        disk->io = (EFI_BLOCK_IO){
+                .Revision = 0x00010000,
+                .Media = &disk->media,
+                .Reset = disk_reset,
+                .ReadBlocks = disk_read_blocks,
+                .WriteBlocks = disk_write_blocks,
+                .FlushBlocks = disk_flush_blocks,
+        };
+
+        h = handle_new();
+        handle_install(h, &BlockIoProtocol, &disk->io);
+        handle_install(h, &DevicePathProtocol, device_path_new(0, FALSE));
+
+        return disk;
+}
+
+/* graphics */
+static EFI_STATUS display_query_mode(EFI_GRAPHICS_OUTPUT_PROTOCOL *this, UINT32 mode, UINTN *size,
+                                     EFI_GRAPHICS_OUTPUT_MODE_INFORMATION **info) {
+        Display *d = (Display *)this;
+
+        if (mode != 0)
+                return EFI_INVALID_PARAMETER;
+
+        *info = AllocatePool(sizeof(d->info));
+        **info = d->info;
+        *size = sizeof(d->info);
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS display_set_mode(EFI_GRAPHICS_OUTPUT_PROTOCOL *this, UINT32 mode) {
+        (VOID)this;
+
+        return mode == 0 ? EFI_SUCCESS : EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS display_blt(EFI_GRAPHICS_OUTPUT_PROTOCOL *this, EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf,
+                              EFI_GRAPHICS_OUTPUT_BLT_OPERATION op, UINTN src_x, UINTN src_y,
+                              UINTN dst_x, UINTN dst_y, UINTN width, UINTN height, UINTN delta) {
+        Display *d = (Display *)this;
+        UINTN w = d->info.HorizontalResolution;
+        UINTN h = d->info.VerticalResolution;
+        UINT32 *pixels = (UINT32 *)buf;
+
+        /* reading video memory back is much slower than writing it on real hardware */
+        charge(op == EfiBltVideoToBltBuffer ? FIRMWARE_BLT_READ : FIRMWARE_BLT, width * height * sizeof(UINT32));
+
+        if (delta == 0)
+                delta = width * sizeof(UINT32);
+
+        switch (op) {
+        case EfiBltVideoFill:
+                if (dst_x + width > w || dst_y + height > h)
+                        return EFI_INVALID_PARAMETER;
+                for (UINTN y = 0; y < height; y++)
+                        for (UINTN x = 0; x < width; x++)
+                                d->framebuffer[(dst_y + y) * w + dst_x + x] = pixels[0];
+                break;
+
+        case EfiBltVideoToBltBuffer:
+                if (src_x + width > w || src_y + height > h)
+                        return EFI_INVALID_PARAMETER;
+                for (UINTN y = 0; y < height; y++)
+                        memcpy((UINT8 *)buf + (dst_y + y) * delta + dst_x * sizeof(UINT32),
+                               &d->framebuffer[(src_y + y) * w + src_x], width * sizeof(UINT32));
+                break;
+
+        case EfiBltBufferToVideo:
+                if (dst_x + width > w || dst_y + height > h)
+                        return EFI_INVALID_PARAMETER;
+                for (UINTN y = 0; y < height; y++)
+                        memcpy(&d->framebuffer[(dst_y + y) * w + dst_x],
+                               (UINT8 *)buf + (src_y + y) * delta + src_x * sizeof(UINT32), width * sizeof(UINT32));
+                break;
+
+        case EfiBltVideoToVideo:
+                if (src_x + width > w || src_y + height > h || dst_x + width > w || dst_y + height > h)
+                        return EFI_INVALID_PARAMETER;
+                for (UINTN y = 0; y < height; y++) {
+                        UINTN row = dst_y > src_y ? height - y - 1 : y;
+
+                        memmove(&d->framebuffer[(dst_y + row) * w + dst_x],
+                                &d->framebuffer[(src_y + row) * w + src_x], width * sizeof(UINT32));
+                }
+                break;
+
+        default:
+                return EFI_INVALID_PARAMETER;
+        }
+
+        return EFI_SUCCESS;
+}
+
+static Display *display_new(UINT32 x, UINT32 y) {
+        Display *d;
+        Handle *h;
+
+        d = calloc(1, sizeof(Display));
+        d->framebuffer = calloc((UINTN)x * y, sizeof(UINT32));
+        d->info = (EFI_GRAPHICS_OUTPUT_MODE_INFORMATION){
+                .HorizontalResolution = x,
+                .VerticalResolution = y,
+                .PixelFormat = 1,               /* PixelBlueGreenRedReserved8BitPerColor */
+                .PixelsPerScanLine = x,
+        };
+        d->mode = (EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE){
+                .MaxMode = 1,
+                .Info = &d->info,
+                .SizeOfInfo = sizeof(d->info),
+                .FrameBufferBase = (EFI_PHYSICAL_ADDRESS)(UINTN)d->framebuffer,
+                .FrameBufferSize = (UINTN)x * y * sizeof(UINT32),
+        };
+        d->gop = (EFI_GRAPHICS_OUTPUT_PROTOCOL){
+                .QueryMode = display_query_mode,
+                .SetMode = display_set_mode,
+                .Blt = display_blt,
+                .Mode = &d->mode,
+        };
+
+        h = handle_new();
+        handle_install(h, &GraphicsOutputProtocol, &d->gop);
+
+        return d;
+}
+
+EFI_STATUS firmware_ppm_write(const char *path) {
+        UINTN w, h;
+        FILE *f;
+
+        if (!display)
+                return EFI_UNSUPPORTED;
+
+        f = fopen(path, "we");
+        if (!f)
+                return EFI_ACCESS_DENIED;
+
+        w = display->info.HorizontalResolution;
+        h = display->info.VerticalResolution;
+        fprintf(f, "P6\n%u %u\n255\n", (unsigned)w, (unsigned)h);
+        for (UINTN i = 0; i < w * h; i++) {
+                UINT32 p = display->framebuffer[i];
+
+                fputc((p >> 16) & 0xff, f);
+                fputc((p >> 8) & 0xff, f);
+                fputc(p & 0xff, f);
+        }
+
+        return fclose(f) == 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+/* text console; the screen is recorded whenever input is consumed */
+static VOID screen_dump(const char *reason) {
+        if (!screen_dirty || !firmware.conout)
+                return;
+
+        fprintf(firmware.conout, "--- frame %u: %s\n", (unsigned)++n_frames, reason);
+        for (UINTN y = 0; y < CONSOLE_ROWS; y++) {
+                UINTN len = CONSOLE_COLUMNS;
+                BOOLEAN highlight = FALSE;
+                char *line;
+
+                /* rows with a lit background are the selected menu entry */
+                for (UINTN x = 0; x < CONSOLE_COLUMNS; x++)
+                        if (screen_attr[y][x] & 0x70)
+                                highlight = TRUE;
+
+                while (len > 0 && screen[y][len - 1] == ' ')
+                        len--;
+
+                line = utf8_from_utf16(screen[y], len);
+                fprintf(firmware.conout, "%c%s\n", highlight ? '>' : '|', line);
+                free(line);
+        }
+        fflush(firmware.conout);
+
+        screen_dirty = FALSE;
+}
+
+static VOID screen_scroll(VOID) {
+        memmove(screen[0], screen[1], sizeof(screen[0]) * (CONSOLE_ROWS - 1));
+        memmove(screen_attr[0], screen_attr[1], sizeof(screen_attr[0]) * (CONSOLE_ROWS - 1));
+        for (UINTN x = 0; x < CONSOLE_COLUMNS; x++) {
+                screen[CONSOLE_ROWS - 1][x] = ' ';
+                screen_attr[CONSOLE_ROWS - 1][x] = conout_mode.Attribute;
+        }
+}
+
+static EFI_STATUS conout_reset(SIMPLE_TEXT_OUTPUT_INTERFACE *this, BOOLEAN verify);
+static EFI_STATUS conout_clear_screen(SIMPLE_TEXT_OUTPUT_INTERFACE *this);
+
+static EFI_STATUS conout_output_string(SIMPLE_TEXT_OUTPUT_INTERFACE *this, CHAR16 *s) {
+        UINTN len = StrLen(s);
+
+        (VOID)this;
+
+        charge(FIRMWARE_OUTPUT_STRING, len * sizeof(CHAR16));
+
+        for (UINTN i = 0; i < len; i++) {
+                switch (s[i]) {
+                case '\n':
+                        if (conout_mode.CursorRow == CONSOLE_ROWS - 1)
+                                screen_scroll();
+                        else
+                                conout_mode.CursorRow++;
+                        break;
+
+                case '\r':
+                        conout_mode.CursorColumn = 0;
+                        break;
+
+                default:
+                        screen[conout_mode.CursorRow][conout_mode.CursorColumn] = s[i];
+                        screen_attr[conout_mode.CursorRow][conout_mode.CursorColumn] = conout_mode.Attribute;
+                        if (++conout_mode.CursorColumn == CONSOLE_COLUMNS) {
+                                conout_mode.CursorColumn = 0;
+                                if (conout_mode.CursorRow == CONSOLE_ROWS - 1)
+                                        screen_scroll();
+                                else
+                                        conout_mode.CursorRow++;
+                        }
+                        break;
+                }
+        }
+
+        screen_dirty = TRUE;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_test_string(SIMPLE_TEXT_OUTPUT_INTERFACE *this, CHAR16 *s) {
+        (VOID)this;
+        (VOID)s;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_query_mode(SIMPLE_TEXT_OUTPUT_INTERFACE *this, UINTN mode, UINTN *columns, UINTN *rows) {
+        (VOID)this;
+
+        if (mode != 0)
+                return EFI_UNSUPPORTED;
+
+        *columns = CONSOLE_COLUMNS;
+        *rows = CONSOLE_ROWS;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_set_mode(SIMPLE_TEXT_OUTPUT_INTERFACE *this, UINTN mode) {
+        if (mode != 0)
+                return EFI_UNSUPPORTED;
+
+        return conout_clear_screen(this);
+}
+
+static EFI_STATUS conout_set_attribute(SIMPLE_TEXT_OUTPUT_INTERFACE *this, UINTN attribute) {
+        (VOID)this;
+
+        conout_mode.Attribute = attribute;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_clear_screen(SIMPLE_TEXT_OUTPUT_INTERFACE *this) {
+        (VOID)this;
+
+        for (UINTN y = 0; y < CONSOLE_ROWS; y++)
+                for (UINTN x = 0; x < CONSOLE_COLUMNS; x++) {
+                        screen[y][x] = ' ';
+                        screen_attr[y][x] = conout_mode.Attribute;
+                }
+
+        conout_mode.CursorColumn = 0;
+        conout_mode.CursorRow = 0;
+        screen_dirty = TRUE;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_set_cursor_position(SIMPLE_TEXT_OUTPUT_INTERFACE *this, UINTN column, UINTN row) {
+        (VOID)this;
+
+        if (column >= CONSOLE_COLUMNS || row >= CONSOLE_ROWS)
+                return EFI_UNSUPPORTED;
+
+        conout_mode.CursorColumn = column;
+        conout_mode.CursorRow = row;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_enable_cursor(SIMPLE_TEXT_OUTPUT_INTERFACE *this, BOOLEAN visible) {
+        (VOID)this;
+
+        conout_mode.CursorVisible = visible;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conout_reset(SIMPLE_TEXT_OUTPUT_INTERFACE *this, BOOLEAN verify) {
+        (VOID)verify;
+
+        conout_mode.Attribute = EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK;
+        return conout_clear_screen(this);
+}
+
+static EFI_STATUS conin_reset(SIMPLE_INPUT_INTERFACE *this, BOOLEAN verify) {
+        (VOID)this;
+        (VOID)verify;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS conin_read_key_stroke(SIMPLE_INPUT_INTERFACE *this, EFI_INPUT_KEY *key) {
+        char reason[64];
+
+        (VOID)this;
+
+        charge(FIRMWARE_READ_KEY_STROKE, 0);
+
+        if (keys_pos == n_keys)
+                return EFI_NOT_READY;
+
+        snprintf(reason, sizeof(reason), "key %s", key_names[keys_pos]);
+        screen_dump(reason);
+
+        *key = keys[keys_pos++];
+        return EFI_SUCCESS;
+}
+
+/* whitespace or comma separated list of characters and key names */
+static EFI_STATUS keys_parse(const char *script) {
+        static const struct {
+                const char *name;
+                UINT16 scan;
+                CHAR16 c;
+        } names[] = {
+                { "up",         SCAN_UP,        0 },
+                { "down",       SCAN_DOWN,      0 },
+                { "right",      SCAN_RIGHT,     0 },
+                { "left",       SCAN_LEFT,      0 },
+                { "home",       SCAN_HOME,      0 },
+                { "end",        SCAN_END,       0 },
+                { "insert",     SCAN_INSERT,    0 },
+                { "delete",     SCAN_DELETE,    0 },
+                { "pgup",       SCAN_PAGE_UP,   0 },
+                { "pgdown",     SCAN_PAGE_DOWN, 0 },
+                { "f1",         SCAN_F1,        0 },
+                { "esc",        SCAN_ESC,       0 },
+                { "enter",      SCAN_NULL,      CHAR_CARRIAGE_RETURN },
+                { "tab",        SCAN_NULL,      CHAR_TAB },
+                { "backspace",  SCAN_NULL,      CHAR_BACKSPACE },
+                { "space",      SCAN_NULL,      ' ' },
+                { "comma",      SCAN_NULL,      ',' },
+        };
+        char *s, *token, *save = NULL;
+
+        s = strdup(script);
+        for (token = strtok_r(s, " \t\n,", &save); token; token = strtok_r(NULL, " \t\n,", &save)) {
+                BOOLEAN found = FALSE;
+
+                if (n_keys == KEYS_MAX)
+                        break;
+
+                if (strlen(token) == 1) {
+                        keys[n_keys] = (EFI_INPUT_KEY){ SCAN_NULL, token[0] };
+                        found = TRUE;
+                }
+
+                for (UINTN i = 0; !found && i < sizeof(names) / sizeof(names[0]); i++)
+                        if (strcasecmp(token, names[i].name) == 0) {
+                                keys[n_keys] = (EFI_INPUT_KEY){ names[i].scan, names[i].c };
+                                found = TRUE;
+                        }
+
+                if (!found) {
+                        free(s);
+                        return EFI_INVALID_PARAMETER;
+                }
+
+                key_names[n_keys++] = strdup(token);
+        }
+
+        free(s);
+        return EFI_SUCCESS;
+}
+
+/* events */
+static BOOLEAN event_ready(Event *e) {
+        if (e == &conin_event)
+                return keys_pos < n_keys;
+
+        if (e->deadline > 0 && now_nsec() >= e->deadline) {
+                e->deadline = e->period > 0 ? e->deadline + e->period : 0;
+                e->signaled = TRUE;
+        }
+
+        return e->signaled;
+}
+
+static EFI_STATUS event_create(UINT32 type, EFI_TPL tpl, EFI_EVENT_NOTIFY notify, VOID *context, EFI_EVENT *event) {
+        Event *e;
+
+        (VOID)tpl;
+
+        e = calloc(1, sizeof(Event));
+        e->type = type;
+        e->notify = notify;
+        e->context = context;
+
+        *event = e;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS event_set_timer(EFI_EVENT event, EFI_TIMER_DELAY type, UINT64 trigger) {
+        Event *e = event;
+
+        /* the trigger time is in units of 100ns */
+        switch (type) {
+        case TimerCancel:
+                e->deadline = 0;
+                e->period = 0;
+                break;
+
+        case TimerPeriodic:
+                e->period = trigger * 100;
+                e->deadline = now_nsec() + e->period;
+                break;
+
+        case TimerRelative:
+                e->period = 0;
+                e->deadline = now_nsec() + trigger * 100;
+                break;
+
+        default:
+                return EFI_INVALID_PARAMETER;
+        }
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS event_signal(EFI_EVENT event) {
+        Event *e = event;
+
+        e->signaled = TRUE;
+        if ((e->type & EVT_NOTIFY_SIGNAL) && e->notify)
+                e->notify(e, e->context);
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS event_close(EFI_EVENT event) {
+        if (event != &conin_event)
+                free(event);
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS event_check(EFI_EVENT event) {
+        Event *e = event;
+
+        if (!event_ready(e))
+                return EFI_NOT_READY;
+
+        e->signaled = FALSE;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS event_wait(UINTN n_events, EFI_EVENT *events, UINTN *index) {
+        for (;;) {
+                UINT64 deadline = 0;
+
+                for (UINTN i = 0; i < n_events; i++) {
+                        Event *e = events[i];
+
+                        if (event_ready(e)) {
+                                e->signaled = FALSE;
+                                *index = i;
+                                return EFI_SUCCESS;
+                        }
+
+                        if (e->deadline > 0 && (deadline == 0 || e->deadline < deadline))
+                                deadline = e->deadline;
+                }
+
+                /* nothing will ever happen, the script is over */
+                if (deadline == 0)
+                        firmware_exit(EFI_TIMEOUT, "input exhausted");
+
+                if (deadline > now_nsec())
+                        wait_nsec(deadline - now_nsec());
+        }
+}
+
+/* boot services */
+static EFI_STATUS bs_allocate_pages(EFI_ALLOCATE_TYPE type, EFI_MEMORY_TYPE memory_type,
+                                    UINTN n_pages, EFI_PHYSICAL_ADDRESS *addr) {
+        charge(FIRMWARE_ALLOCATE_PAGES, n_pages * EFI_PAGE_SIZE);
+        return host_boot_services.AllocatePages(type, memory_type, n_pages, addr);
+}
+
+static EFI_STATUS bs_allocate_pool(EFI_MEMORY_TYPE type, UINTN size, VOID **p) {
+        charge(FIRMWARE_ALLOCATE_POOL, size);
+        return host_boot_services.AllocatePool(type, size, p);
+}
+
+static EFI_STATUS bs_stall(UINTN usec) {
+        charge(FIRMWARE_STALL, 0);
+        return host_boot_services.Stall(usec);
+}
+
+static EFI_STATUS bs_handle_protocol(EFI_HANDLE handle, EFI_GUID *protocol, VOID **interface) {
+        charge(FIRMWARE_HANDLE_PROTOCOL, 0);
+
+        if (!handle_valid(handle))
+                return EFI_INVALID_PARAMETER;
+
+        *interface = handle_protocol(handle, protocol);
+        return *interface ? EFI_SUCCESS : EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS bs_open_protocol(EFI_HANDLE handle, EFI_GUID *protocol, VOID **interface,
+                                   EFI_HANDLE agent, EFI_HANDLE controller, UINT32 attributes) {
+        (VOID)agent;
+        (VOID)controller;
+        (VOID)attributes;
+
+        return bs_handle_protocol(handle, protocol, interface);
+}
+
+static EFI_STATUS bs_close_protocol(EFI_HANDLE handle, EFI_GUID *protocol, EFI_HANDLE agent, EFI_HANDLE controller) {
+        (VOID)agent;
+        (VOID)controller;
+
+        if (!handle_valid(handle) || !handle_protocol(handle, protocol))
+                return EFI_NOT_FOUND;
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS bs_install_protocol_interface(EFI_HANDLE *handle, EFI_GUID *protocol,
+                                                EFI_INTERFACE_TYPE type, VOID *interface) {
+        (VOID)type;
+
+        if (!*handle) {
+                *handle = handle_new();
+                if (!*handle)
+                        return EFI_OUT_OF_RESOURCES;
+        } else if (!handle_valid(*handle))
+                return EFI_INVALID_PARAMETER;
+
+        return handle_install(*handle, protocol, interface);
+}
+
+static EFI_STATUS bs_uninstall_protocol_interface(EFI_HANDLE handle, EFI_GUID *protocol, VOID *interface) {
+        EFI_STATUS r;
+
+        if (!handle_valid(handle))
+                return EFI_INVALID_PARAMETER;
+
+        r = handle_uninstall(handle, protocol, interface);
+        if (r == EFI_SUCCESS && ((Handle *)handle)->n_protocols == 0)
+                handle_free(handle);
+
+        return r;
+}
+
+static EFI_STATUS bs_install_multiple_protocol_interfaces(EFI_HANDLE *handle, ...) {
+        EFI_GUID *protocol;
+        va_list ap;
+        EFI_STATUS r = EFI_SUCCESS;
+
+        va_start(ap, handle);
+        while (r == EFI_SUCCESS && (protocol = va_arg(ap, EFI_GUID *)))
+                r = bs_install_protocol_interface(handle, protocol, EFI_NATIVE_INTERFACE, va_arg(ap, VOID *));
+        va_end(ap);
+
+        return r;
+}
+
+static EFI_STATUS bs_uninstall_multiple_protocol_interfaces(EFI_HANDLE handle, ...) {
+        EFI_GUID *protocol;
+        va_list ap;
+        EFI_STATUS r = EFI_SUCCESS;
+
+        va_start(ap, handle);
+        while (r == EFI_SUCCESS && (protocol = va_arg(ap, EFI_GUID *)))
+                r = bs_uninstall_protocol_interface(handle, protocol, va_arg(ap, VOID *));
+        va_end(ap);
+
+        return r;
+}
+
+static EFI_STATUS bs_locate_handle_buffer(EFI_LOCATE_SEARCH_TYPE type, EFI_GUID *protocol, VOID *key,
+                                          UINTN *n_ret, EFI_HANDLE **ret) {
+        EFI_HANDLE *found;
+        UINTN n = 0;
+
+        (VOID)key;
+
+        charge(FIRMWARE_LOCATE_HANDLE_BUFFER, 0);
+
+        found = AllocatePool(n_handles * sizeof(EFI_HANDLE) + 1);
+        for (UINTN i = 0; i < n_handles; i++)
+                if (type == AllHandles || handle_protocol(handles[i], protocol))
+                        found[n++] = handles[i];
+
+        if (n == 0) {
+                FreePool(found);
+                return EFI_NOT_FOUND;
+        }
+
+        *n_ret = n;
+        *ret = found;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS bs_locate_protocol(EFI_GUID *protocol, VOID *key, VOID **interface) {
+        (VOID)key;
+
+        charge(FIRMWARE_LOCATE_PROTOCOL, 0);
+
+        for (UINTN i = 0; i < n_handles; i++) {
+                *interface = handle_protocol(handles[i], protocol);
+                if (*interface)
+                        return EFI_SUCCESS;
+        }
+
+        return EFI_NOT_FOUND;
+}
+
+static EFI_STATUS bs_locate_device_path(EFI_GUID *protocol, EFI_DEVICE_PATH **path, EFI_HANDLE *device) {
+        Handle *best = NULL;
+        UINTN best_len = 0;
+
+        charge(FIRMWARE_LOCATE_DEVICE_PATH, 0);
+
+        for (UINTN i = 0; i < n_handles; i++) {
+                UINTN len;
+
+                if (!handle_protocol(handles[i], protocol))
+                        continue;
+
+                len = device_path_match(handles[i], *path);
+                if (len > best_len) {
+                        best = handles[i];
+                        best_len = len;
+                }
+        }
+
+        if (!best)
+                return EFI_NOT_FOUND;
+
+        *path = (EFI_DEVICE_PATH *)((UINT8 *)*path + best_len);
+        *device = best;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS bs_install_configuration_table(EFI_GUID *guid, VOID *table) {
+        UINTN i;
+
+        for (i = 0; i < system_table.NumberOfTableEntries; i++)
+                if (CompareGuid(&config_tables[i].VendorGuid, guid) == 0)
+                        break;
+
+        /* a NULL table removes the entry */
+        if (!table) {
+                if (i == system_table.NumberOfTableEntries)
+                        return EFI_NOT_FOUND;
+
+                config_tables[i] = config_tables[--system_table.NumberOfTableEntries];
+                return EFI_SUCCESS;
+        }
+
+        if (i == sizeof(config_tables) / sizeof(config_tables[0]))
+                return EFI_OUT_OF_RESOURCES;
+
+        config_tables[i] = (EFI_CONFIGURATION_TABLE){ *guid, table };
+        if (i == system_table.NumberOfTableEntries)
+                system_table.NumberOfTableEntries++;
+
+        return EFI_SUCCESS;
+}
+
+/* map the sections of a PE image at their virtual addresses */
+static EFI_STATUS pe_load(const UINT8 *data, UINTN size, VOID **ret_base, UINT64 *ret_size) {
+        UINT32 pe, image_size, headers_size;
+        UINT16 n_sections, opt_size;
+        UINTN sect;
+        UINT64 end;
+        VOID *base;
+
+        if (size < 0x40 || memcmp(data, "MZ", 2) != 0)
+                return EFI_LOAD_ERROR;
+
+        memcpy(&pe, data + 0x3c, sizeof(pe));
+        if ((UINTN)pe + 24 + 64 > size || memcmp(data + pe, "PE\0\0", 4) != 0)
+                return EFI_LOAD_ERROR;
+
+        memcpy(&n_sections, data + pe + 6, sizeof(n_sections));
+        memcpy(&opt_size, data + pe + 20, sizeof(opt_size));
+        memcpy(&image_size, data + pe + 24 + 56, sizeof(image_size));
+        memcpy(&headers_size, data + pe + 24 + 60, sizeof(headers_size));
+
+        sect = pe + 24 + opt_size;
+        if (sect + n_sections * 40 > size)
+                return EFI_LOAD_ERROR;
+
+        end = image_size > headers_size ? image_size : headers_size;
+        for (UINTN i = 0; i < n_sections; i++) {
+                UINT32 vsize, addr;
+
+                memcpy(&vsize, data + sect + i * 40 + 8, sizeof(vsize));
+                memcpy(&addr, data + sect + i * 40 + 12, sizeof(addr));
+                if ((UINT64)addr + vsize > end)
+                        end = (UINT64)addr + vsize;
+        }
+
+        if (end > 1024 * 1024 * 1024 || posix_memalign(&base, EFI_PAGE_SIZE, end ? end : 1) != 0)
+                return EFI_OUT_OF_RESOURCES;
+
+        memset(base, 0, end);
+        memcpy(base, data, headers_size < size ? headers_size : size);
+        for (UINTN i = 0; i < n_sections; i++) {
+                UINT32 vsize, addr, raw_size, raw;
+
+                memcpy(&vsize, data + sect + i * 40 + 8, sizeof(vsize));
+                memcpy(&addr, data + sect + i * 40 + 12, sizeof(addr));
+                memcpy(&raw_size, data + sect + i * 40 + 16, sizeof(raw_size));
+                memcpy(&raw, data + sect + i * 40 + 20, sizeof(raw));
+
+                if (vsize > 0 && raw_size > vsize)
+                        raw_size = vsize;
+                if (raw > size)
+                        raw_size = 0;
+                else if (raw_size > size - raw)
+                        raw_size = size - raw;
+
+                memcpy((UINT8 *)base + addr, data + raw, raw_size);
+        }
+
+        *ret_base = base;
+        *ret_size = end;
+        return EFI_SUCCESS;
+}
+
+static UINT8 *file_slurp(const char *path, UINTN *size) {
+        struct stat st;
+        UINT8 *data;
+        int fd;
+
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+                return NULL;
+
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                return NULL;
+        }
+
+        data = malloc(st.st_size + 1);
+        if (read(fd, data, st.st_size) != st.st_size) {
+                free(data);
+                close(fd);
+                return NULL;
+        }
+
+        close(fd);
+        *size = st.st_size;
+        return data;
+}
+
+/* FILEPATH nodes concatenated to "\\dir\\file" */
+static CHAR16 *file_path_str(EFI_DEVICE_PATH *path) {
+        CHAR16 *str;
+        UINTN len = 0;
+
+        str = AllocateZeroPool(DevicePathSize(path) + sizeof(CHAR16));
+        for (EFI_DEVICE_PATH *node = path; !IsDevicePathEnd(node); node = NextDevicePathNode(node)) {
+                FILEPATH_DEVICE_PATH *file = (FILEPATH_DEVICE_PATH *)node;
+
+                if (DevicePathType(node) != MEDIA_DEVICE_PATH || DevicePathSubType(node) != MEDIA_FILEPATH_DP) {
+                        FreePool(str);
+                        return NULL;
+                }
+
+                if (len > 0 && str[len - 1] != '\\' && file->PathName[0] != '\\')
+                        str[len++] = '\\';
+                for (CHAR16 *s = file->PathName; *s; s++)
+                        str[len++] = *s;
+        }
+
+        return str;
+}
+
+static EFI_STATUS image_new(EFI_HANDLE parent, Volume *volume, const CHAR16 *path,
+                            const UINT8 *data, UINTN size, Image **ret) {
+        Image *image;
+        EFI_STATUS r;
+
+        image = calloc(1, sizeof(Image));
+        image->loaded_image = (EFI_LOADED_IMAGE){
+                .Revision = 0x1000,
+                .ParentHandle = parent,
+                .SystemTable = &system_table,
+                .DeviceHandle = volume ? volume->handle : NULL,
+                .FilePath = FileDevicePath(NULL, (CHAR16 *)path),
+                .ImageCodeType = EfiLoaderCode,
+                .ImageDataType = EfiLoaderData,
+        };
+        image->path = utf8_from_utf16(path, StrLen(path));
+
+        if (data) {
+                r = pe_load(data, size, &image->loaded_image.ImageBase, &image->loaded_image.ImageSize);
+                if (EFI_ERROR(r)) {
+                        FreePool(image->loaded_image.FilePath);
+                        free(image->path);
+                        free(image);
+                        return r;
+                }
+        }
+
+        image->handle = handle_new();
+        handle_install(image->handle, &LoadedImageProtocol, &image->loaded_image);
+
+        *ret = image;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS bs_load_image(BOOLEAN boot_policy, EFI_HANDLE parent, EFI_DEVICE_PATH *path,
+                                VOID *source, UINTN source_size, EFI_HANDLE *ret) {
+        Volume *volume = NULL;
+        CHAR16 *file_path = NULL;
+        UINT8 *data = NULL;
+        UINTN size = source_size;
+        Image *image;
+        EFI_STATUS r;
+
+        (VOID)boot_policy;
+
+        if (!source && !path)
+                return EFI_INVALID_PARAMETER;
+
+        /* with a source buffer, the path only names the device and the file of the loaded image */
+        if (path) {
+                EFI_DEVICE_PATH *p = path;
+                EFI_HANDLE device;
+
+                if (bs_locate_device_path(&FileSystemProtocol, &p, &device) == EFI_SUCCESS) {
+                        volume = handle_protocol(device, &FileSystemProtocol);
+                        file_path = file_path_str(p);
+                }
+        }
+
+        if (!source) {
+                BOOLEAN exists;
+                char *host_path;
+
+                if (!volume || !file_path) {
+                        FreePool(file_path);
+                        return EFI_NOT_FOUND;
+                }
+
+                host_path = path_resolve(volume, volume->root, file_path, &exists);
+                if (host_path && exists)
+                        data = file_slurp(host_path, &size);
+                free(host_path);
+                if (!data) {
+                        FreePool(file_path);
+                        return EFI_NOT_FOUND;
+                }
+        }
+
+        charge(FIRMWARE_LOAD_IMAGE, size);
+
+        r = image_new(parent, volume, file_path ? file_path : L"", data ? data : source, size, &image);
+        FreePool(file_path);
+        free(data);
+        if (EFI_ERROR(r))
+                return r;
+
+        *ret = image->handle;
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS bs_start_image(EFI_HANDLE handle, UINTN *exit_data_size, CHAR16 **exit_data) {
+        Image *image;
+        char *options = NULL;
+
+        (VOID)exit_data_size;
+        (VOID)exit_data;
+
+        if (!handle_valid(handle))
+                return EFI_INVALID_PARAMETER;
+
+        image = handle_protocol(handle, &LoadedImageProtocol);
+        if (!image)
+                return EFI_INVALID_PARAMETER;
+
+        if (image->loaded_image.LoadOptionsSize > 0)
+                options = utf8_from_utf16(image->loaded_image.LoadOptions,
+                                          image->loaded_image.LoadOptionsSize / sizeof(CHAR16));
+
+        /* what runs next is not part of the simulation */
+        firmware_event("StartImage", "path", image->path, options ? "options" : NULL, options, NULL);
+        free(options);
+        firmware_exit(EFI_SUCCESS, "StartImage");
+}
+
+static EFI_STATUS bs_unload_image(EFI_HANDLE handle) {
+        Image *image;
+
+        if (!handle_valid(handle))
+                return EFI_INVALID_PARAMETER;
+
+        image = handle_protocol(handle, &LoadedImageProtocol);
+        if (!image)
+                return EFI_INVALID_PARAMETER;
+
+        handle_free(image->handle);
+        FreePool(image->loaded_image.FilePath);
+        free(image->loaded_image.ImageBase);
+        free(image->path);
+        free(image);
+
+        return EFI_SUCCESS;
+}
+
+static EFI_STATUS bs_exit(EFI_HANDLE handle, EFI_STATUS status, UINTN size, CHAR16 *data) {
+        (VOID)handle;
+        (VOID)size;
+        (VOID)data;
+
+        firmware_exit(status, "Exit");
+}
+
+/* runtime services */
+static EFI_STATUS rt_get_variable(CHAR16 *name, EFI_GUID *vendor, UINT32 *attributes, UINTN *size, VOID *data) {
+        EFI_STATUS r;
+
+        r = host_runtime_services.GetVariable(name, vendor, attributes, size, data);
+        charge(FIRMWARE_GET_VARIABLE, r == EFI_SUCCESS ? *size : 0);
+
+        return r;
+}
+
+static EFI_STATUS rt_set_variable(CHAR16 *name, EFI_GUID *vendor, UINT32 attributes, UINTN size, VOID *data) {
+        charge(FIRMWARE_SET_VARIABLE, size);
+        return host_runtime_services.SetVariable(name, vendor, attributes, size, data);
+}
+
+static EFI_STATUS rt_reset_system(EFI_RESET_TYPE type, EFI_STATUS status, UINTN size, CHAR16 *data) {
+        static const char *types[] = { "cold", "warm", "shutdown" };
+
+        (VOID)size;
+        (VOID)data;
+
+        firmware_event("ResetSystem", "type", (UINTN)type < 3 ? types[type] : "unknown", NULL);
+        firmware_exit(status, "ResetSystem");
+}
+
+EFI_STATUS firmware_init(const FirmwareConfig *config, EFI_HANDLE *ret) {
+        Handle *console;
+        Image *image;
+        CHAR16 *image_path;
+        UINT8 *data = NULL;
+        UINTN size = 0;
+        EFI_STATUS r;
+
+        firmware = *config;
+
+        host_init();
+        host_boot_services = *BS;
+        host_runtime_services = *RT;
+
+        boot_services = *BS;
+        boot_services.AllocatePages = bs_allocate_pages;
+        boot_services.AllocatePool = bs_allocate_pool;
+        boot_services.CreateEvent = event_create;
+        boot_services.SetTimer = event_set_timer;
+        boot_services.WaitForEvent = event_wait;
+        boot_services.SignalEvent = event_signal;
+        boot_services.CloseEvent = event_close;
+        boot_services.CheckEvent = event_check;
+        boot_services.InstallProtocolInterface = bs_install_protocol_interface;
+        boot_services.UninstallProtocolInterface = bs_uninstall_protocol_interface;
+        boot_services.HandleProtocol = bs_handle_protocol;
+        boot_services.LocateDevicePath = bs_locate_device_path;
+        boot_services.InstallConfigurationTable = bs_install_configuration_table;
+        boot_services.LoadImage = bs_load_image;
+        boot_services.StartImage = bs_start_image;
+        boot_services.Exit = bs_exit;
+        boot_services.UnloadImage = bs_unload_image;
+        boot_services.Stall = bs_stall;
+        boot_services.OpenProtocol = bs_open_protocol;
+        boot_services.CloseProtocol = bs_close_protocol;
+        boot_services.LocateHandleBuffer = bs_locate_handle_buffer;
+        boot_services.LocateProtocol = bs_locate_protocol;
+        boot_services.InstallMultipleProtocolInterfaces = bs_install_multiple_protocol_interfaces;
+        boot_services.UninstallMultipleProtocolInterfaces = bs_uninstall_multiple_protocol_interfaces;
+
+        runtime_services = *RT;
+        runtime_services.GetVariable = rt_get_variable;
+        runtime_services.SetVariable = rt_set_variable;
+        runtime_services.ResetSystem = rt_reset_system;
+
+        conout_mode = (SIMPLE_TEXT_OUTPUT_MODE){ .MaxMode = 1, .CursorVisible = TRUE };
+        conout = (SIMPLE_TEXT_OUTPUT_INTERFACE){
+                .Reset = conout_reset,
+                .OutputString = conout_output_string,
+                .TestString = conout_test_string,
+                .QueryMode = conout_query_mode,
+                .SetMode = conout_set_mode,
+                .SetAttribute = conout_set_attribute,
+                .ClearScreen = conout_clear_screen,
+                .SetCursorPosition = conout_set_cursor_position,
+                .EnableCursor = conout_enable_cursor,
+                .Mode = &conout_mode,
+        };
+        conout_reset(&conout, FALSE);
+        screen_dirty = FALSE;
+
+        conin = (SIMPLE_INPUT_INTERFACE){
+                .Reset = conin_reset,
+                .ReadKeyStroke = conin_read_key_stroke,
+                .WaitForKey = &conin_event,
+        };
+        if (firmware.keys) {
+                r = keys_parse(firmware.keys);
+                if (EFI_ERROR(r))
+                        return r;
+        }
+
+        system_table = *ST;
+        system_table.FirmwareVendor = L"bus1 simulator";
+        system_table.BootServices = &boot_services;
+        system_table.RuntimeServices = &runtime_services;
+        system_table.ConIn = &conin;
+        system_table.ConOut = &conout;
+        system_table.StdErr = &conout;
+        system_table.ConfigurationTable = config_tables;
+        system_table.NumberOfTableEntries = 0;
+
+        console = handle_new();
+        system_table.ConsoleInHandle = console;
+        system_table.ConsoleOutHandle = console;
+        system_table.StandardErrorHandle = console;
+
+        /* the boot volume is always the first */
+        esp = volume_new(firmware.esp, 0);
+        if (!esp)
+                return EFI_NOT_FOUND;
+
+        for (UINTN i = 0; i < firmware.n_volumes; i++)
+                if (!volume_new(firmware.volumes[i], i + 1))
+                        return EFI_NOT_FOUND;
+
+        if (firmware.disk && !disk_new(firmware.disk))
+                return EFI_NOT_FOUND;
+
+        if (firmware.gop_x > 0 && firmware.gop_y > 0)
+                display = display_new(firmware.gop_x, firmware.gop_y);
+
+        /* the running image is loaded from the boot volume if it exists there */
+        image_path = utf16_from_utf8(firmware.image);
+        if (firmware.image) {
+                BOOLEAN exists;
+                char *host_path;
+
+                host_path = path_resolve(esp, esp->root, image_path, &exists);
+                if (host_path && exists)
+                        data = file_slurp(host_path, &size);
+                free(host_path);
+        }
+
+        r = image_new(NULL, esp, image_path, data, size, &image);
+        FreePool(image_path);
+        free(data);
+        if (EFI_ERROR(r))
+                return r;
+
+        if (firmware.options) {
+                image->loaded_image.LoadOptions = utf16_from_utf8(firmware.options);
+                image->loaded_image.LoadOptionsSize = (StrLen(image->loaded_image.LoadOptions) + 1) * sizeof(CHAR16);
+        }
+
+        InitializeLib(image->handle, &system_table);
+        *ret = image->handle;
+        return EFI_SUCCESS;
+}
+
+VOID firmware_exit(EFI_STATUS status, const char *reason) {
+        firmware_status = status;
+        firmware_reason = reason;
+        longjmp(firmware_jmp, 1);
+}
+
+EFI_STATUS firmware_run(EFI_STATUS (*entry)(EFI_HANDLE, EFI_SYSTEM_TABLE *), EFI_HANDLE image) {
+        CHAR16 status[64];
+        char usec[32];
+        char *status8;
+
+        firmware_start = now_nsec();
+        if (setjmp(firmware_jmp) == 0) {
+                firmware_status = entry(image, &system_table);
+                firmware_reason = "return";
+        }
+
+        screen_dump(firmware_reason);
+
+        SPrint(status, sizeof(status), L"%r", firmware_status);
+        status8 = utf8_from_utf16(status, StrLen(status));
+        snprintf(usec, sizeof(usec), "%llu", (unsigned long long)(now_nsec() - firmware_start) / 1000);
+        firmware_event("exit", "reason", firmware_reason, "status", status8, "usec", usec, NULL);
+        free(status8);
+
+        return firmware_status;
+}
+
+/* per-call statistics and the variable store */
+VOID firmware_report(VOID) {
+        CHAR16 name[256] = {};
+        EFI_GUID vendor = {};
+
+        if (!firmware.log)
+                return;
+
+        for (UINTN i = 0; i < _FIRMWARE_CALL_MAX; i++) {
+                if (stats[i].count == 0)
+                        continue;
+
+                fprintf(firmware.log, "{\"call\":\"%s\",\"count\":%llu,\"bytes\":%llu,\"cost_usec\":%llu}\n",
+                        call_names[i], (unsigned long long)stats[i].count, (unsigned long long)stats[i].bytes,
+                        (unsigned long long)stats[i].nsec / 1000);
+        }
+
+        for (;;) {
+                UINT8 data[EFI_MAXIMUM_VARIABLE_SIZE];
+                UINTN size = sizeof(name);
+                CHAR16 guid[37];
+                BOOLEAN text;
+                char *name8, *guid8;
+
+                if (host_runtime_services.GetNextVariableName(&size, name, &vendor) != EFI_SUCCESS)
+                        break;
+
+                size = sizeof(data);
+                if (host_runtime_services.GetVariable(name, &vendor, NULL, &size, data) != EFI_SUCCESS)
+                        continue;
+
+                /* NUL-terminated UTF-16 strings are shown as text, everything else as hex */
+                text = size >= sizeof(CHAR16) && size % sizeof(CHAR16) == 0 &&
+                       ((CHAR16 *)data)[size / sizeof(CHAR16) - 1] == '\0';
+                for (UINTN i = 0; text && i < size / sizeof(CHAR16) - 1; i++)
+                        if (((CHAR16 *)data)[i] < 0x20)
+                                text = FALSE;
+
+                GuidToString(guid, &vendor);
+                name8 = utf8_from_utf16(name, StrLen(name));
+                guid8 = utf8_from_utf16(guid, StrLen(guid));
+                fprintf(firmware.log, "{\"variable\":");
+                json_string(firmware.log, name8);
+                fprintf(firmware.log, ",\"vendor\":\"%s\",", guid8);
+                if (text) {
+                        char *value = utf8_from_utf16((CHAR16 *)data, size / sizeof(CHAR16));
+
+                        fprintf(firmware.log, "\"value\":");
+                        json_string(firmware.log, value);
+                        free(value);
+                } else {
+                        fprintf(firmware.log, "\"data\":\"");
+                        for (UINTN i = 0; i < size; i++)
+                                fprintf(firmware.log, "%02x", data[i]);
+                        fprintf(firmware.log, "\"");
+                }
+                fprintf(firmware.log, "}\n");
+
+                free(name8);
+                free(guid8);
+        }
+
+        fflush(firmware.log);
+}
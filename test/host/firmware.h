@@ -0,0 +1,88 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * A firmware for Linux userspace: the boot volume and additional volumes are
+ * host directories, the boot disk is an image file, the display is an
+ * in-memory framebuffer and the console reads keys from a script and
+ * records the screen. Every firmware call can be charged a fixed and a
+ * per-byte cost to model slow firmware.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#include <efi.h>
+
+typedef enum {
+        FIRMWARE_OPEN_VOLUME,
+        FIRMWARE_OPEN,
+        FIRMWARE_CLOSE,
+        FIRMWARE_READ,
+        FIRMWARE_READ_EX,
+        FIRMWARE_WRITE,
+        FIRMWARE_GET_INFO,
+        FIRMWARE_SET_INFO,
+        FIRMWARE_SET_POSITION,
+        FIRMWARE_DELETE,
+        FIRMWARE_FLUSH,
+        FIRMWARE_READ_BLOCKS,
+        FIRMWARE_HANDLE_PROTOCOL,
+        FIRMWARE_LOCATE_HANDLE_BUFFER,
+        FIRMWARE_LOCATE_PROTOCOL,
+        FIRMWARE_LOCATE_DEVICE_PATH,
+        FIRMWARE_ALLOCATE_PAGES,
+        FIRMWARE_ALLOCATE_POOL,
+        FIRMWARE_LOAD_IMAGE,
+        FIRMWARE_GET_VARIABLE,
+        FIRMWARE_SET_VARIABLE,
+        FIRMWARE_OUTPUT_STRING,
+        FIRMWARE_READ_KEY_STROKE,
+        FIRMWARE_BLT,
+        FIRMWARE_BLT_READ,
+        FIRMWARE_STALL,
+        _FIRMWARE_CALL_MAX,
+} FirmwareCall;
+
+typedef struct {
+        UINT64 nsec;
+        UINT64 nsec_per_byte;
+} FirmwareCost;
+
+typedef struct {
+        const char *esp;
+        const char **volumes;
+        UINTN n_volumes;
+        const char *disk;
+        const char *image;
+        const char *options;
+        const char *keys;
+        UINT32 gop_x;
+        UINT32 gop_y;
+        FILE *log;
+        FILE *conout;
+        FirmwareCost costs[_FIRMWARE_CALL_MAX];
+} FirmwareConfig;
+
+EFI_STATUS firmware_cost_parse(FirmwareConfig *config, const char *spec);
+EFI_STATUS firmware_init(const FirmwareConfig *config, EFI_HANDLE *image);
+EFI_STATUS firmware_run(EFI_STATUS (*entry)(EFI_HANDLE, EFI_SYSTEM_TABLE *), EFI_HANDLE image);
+VOID firmware_exit(EFI_STATUS status, const char *reason) __attribute__((noreturn));
+VOID firmware_event(const char *event, ...) __attribute__((sentinel));
+EFI_STATUS firmware_ppm_write(const char *path);
+VOID firmware_report(VOID);
@@ -0,0 +1,123 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * A stand-in for the kernel, for boot latency benchmarks. It is wrapped in
+ * a setup header by test/bench-efi.py and entered through the EFI handover
+ * protocol by linux_exec(). It prints the boot timestamps published by the
+ * boot manager and the stub, and its own entry time, as
+ *
+ *   bus1-bench: <name>=<usec>
+ *
+ * lines to the console and powers the machine off. It is linked as a flat
+ * binary, so it must not need relocations: no pointers in data, no library.
+ */
+
+#include <efi.h>
+
+#include "shared/util.h"
+
+/* the variables to report, separated by NUL, terminated by an empty string */
+#define PAYLOAD_VARIABLES \
+        L"BootTimeEntryUSec\0" \
+        L"BootTimeScanUSec\0" \
+        L"BootTimeSortUSec\0" \
+        L"BootTimeMenuUSec\0" \
+        L"BootTimeLoadImageUSec\0" \
+        L"BootTimeStartImageUSec\0" \
+        L"StubTimeEntryUSec\0" \
+        L"StubTimeSectionsUSec\0" \
+        L"StubTimeDiskUUIDUSec\0" \
+        L"StubTimeDecompressUSec\0" \
+        L"StubDecompressInBytes\0" \
+        L"StubDecompressOutBytes\0" \
+        L"StubTimeLinuxUSec\0" \
+        L"StubLinuxMovedBytes\0" \
+        L"StubTimeSplashUSec\0" \
+        L"StubTimeInitrdUSec\0" \
+        L"StubTimeHandoverUSec\0"
+
+static UINT64 ticks_read(VOID) {
+        UINT32 lo, hi;
+
+        asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+        return ((UINT64)hi << 32) | lo;
+}
+
+static UINTN str_len(const CHAR16 *s) {
+        UINTN n = 0;
+
+        while (s[n])
+                n++;
+        return n;
+}
+
+static VOID print(EFI_SYSTEM_TABLE *st, CHAR16 *s) {
+        uefi_call_wrapper(st->ConOut->OutputString, 2, st->ConOut, s);
+}
+
+static VOID print_value(EFI_SYSTEM_TABLE *st, CHAR16 *name, CHAR16 *value) {
+        print(st, L"bus1-bench: ");
+        print(st, name);
+        print(st, L"=");
+        print(st, value);
+        print(st, L"\r\n");
+}
+
+VOID payload_handover(EFI_HANDLE image, EFI_SYSTEM_TABLE *st, VOID *setup) {
+        EFI_GUID guid = BOOT_EFI_VARIABLE_GUID;
+        UINT64 ticks;
+        UINT64 freq = 0;
+        UINTN size;
+        CHAR16 buf[32];
+        UINTN i;
+
+        (VOID)image;
+        (VOID)setup;
+
+        ticks = ticks_read();
+
+        for (CHAR16 *name = PAYLOAD_VARIABLES; *name; name += str_len(name) + 1) {
+                size = sizeof(buf) - sizeof(CHAR16);
+                if (uefi_call_wrapper(st->RuntimeServices->GetVariable, 5, name, &guid, NULL, &size, buf) != EFI_SUCCESS)
+                        continue;
+
+                buf[size / sizeof(CHAR16)] = '\0';
+                print_value(st, name, buf);
+        }
+
+        /* the calibrated TSC rate is left behind by the boot manager */
+        size = sizeof(freq);
+        uefi_call_wrapper(st->RuntimeServices->GetVariable, 5, L"TimerFrequency", &guid, NULL, &size, &freq);
+        if (freq >= 1000 * 1000) {
+                UINT64 usec = ticks / (freq / (1000 * 1000));
+
+                i = C_ARRAY_SIZE(buf) - 1;
+                buf[i] = '\0';
+                do {
+                        buf[--i] = '0' + usec % 10;
+                        usec /= 10;
+                } while (usec > 0);
+                print_value(st, L"PayloadTimeEntryUSec", buf + i);
+        }
+
+        print(st, L"bus1-bench: done\r\n");
+        uefi_call_wrapper(st->RuntimeServices->ResetSystem, 4, EfiResetShutdown, EFI_SUCCESS, 0, NULL);
+
+        for (;;)
+                asm volatile ("hlt");
+}
@@ -0,0 +1,450 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Runs the boot manager or the stub on the simulated firmware in
+ * test/host/firmware.c. Firmware events and the final report are printed
+ * as one JSON object per line, the console frames go to stderr:
+ *
+ *   sim-boot --esp=esp/ --keys="down,enter" --cost="Read=50us/2ns"
+ *
+ * The run ends when the image returns or hands over to the next stage; the
+ * next stage itself is never executed.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <efi.h>
+#include <efilib.h>
+#include "host/firmware.h"
+
+#ifdef SIM_STUB
+#include "shared/disk.h"
+#include "shared/handoff.h"
+#include "shared/sha256.h"
+#include "stub/initrd.h"
+#include "stub/linux.h"
+#endif
+
+#define SIM_VOLUMES_MAX         16
+#define SIM_VARIABLES_MAX       64
+
+EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table);
+
+#ifdef SIM_STUB
+/* host memory is not limited to the low 4G, any address works */
+UINTN linux_initrd_max(UINTN linux_addr) {
+        (VOID)linux_addr;
+
+        return ~(UINTN)0;
+}
+
+/* fixed addresses are not available in a process, place the kernel anywhere */
+EFI_STATUS linux_alloc(const VOID *header, UINTN image_size, UINTN *linux_addr) {
+        const UINT8 *setup = header;
+        UINT16 version;
+        UINT32 init_size;
+        UINTN setup_size;
+        UINTN code_size;
+        EFI_PHYSICAL_ADDRESS base;
+        EFI_STATUS r;
+
+        memcpy(&version, setup + 0x206, sizeof(version));
+        memcpy(&init_size, setup + 0x260, sizeof(init_size));
+        if (setup[0x1fe] != 0x55 || setup[0x1ff] != 0xaa || memcmp(setup + 0x202, "HdrS", 4) != 0 ||
+            version < 0x20b || !setup[0x234])
+                return EFI_UNSUPPORTED;
+
+        setup_size = ((setup[0x1f1] ?: 4) + 1) * 512;
+        if (image_size <= setup_size)
+                return EFI_LOAD_ERROR;
+
+        code_size = image_size - setup_size;
+        if (code_size < init_size)
+                code_size = init_size;
+
+        r = BS->AllocatePages(AllocateAnyPages, EfiLoaderData,
+                              EFI_SIZE_TO_PAGES(setup_size) + EFI_SIZE_TO_PAGES(code_size), &base);
+        if (EFI_ERROR(r))
+                return r;
+
+        *linux_addr = base + EFI_SIZE_TO_PAGES(setup_size) * EFI_PAGE_SIZE - setup_size;
+        return EFI_SUCCESS;
+}
+
+/* like the kernel's EFI stub, prefer an initrd served by LoadFile2 over the boot parameters */
+static UINT8 *initrd_load_file2(UINTN *size) {
+        struct {
+                VENDOR_DEVICE_PATH vendor;
+                EFI_DEVICE_PATH end;
+        } __attribute__((packed)) media = {
+                .vendor = {
+                        .Header = { MEDIA_DEVICE_PATH, MEDIA_VENDOR_DP, { sizeof(VENDOR_DEVICE_PATH), 0 } },
+                        .Guid = LINUX_EFI_INITRD_MEDIA_GUID,
+                },
+                .end = { END_DEVICE_PATH_TYPE, END_ENTIRE_DEVICE_PATH_SUBTYPE, { sizeof(EFI_DEVICE_PATH), 0 } },
+        };
+        EFI_GUID load_file2_guid = EFI_LOAD_FILE2_PROTOCOL_GUID;
+        EFI_DEVICE_PATH *path = &media.vendor.Header;
+        INITRD_LOAD_FILE2_PROTOCOL *load_file;
+        EFI_HANDLE handle;
+        UINT8 *buf;
+
+        if (BS->LocateDevicePath(&load_file2_guid, &path, &handle) != EFI_SUCCESS ||
+            BS->HandleProtocol(handle, &load_file2_guid, (VOID **)&load_file) != EFI_SUCCESS)
+                return NULL;
+
+        *size = 0;
+        if (load_file->LoadFile(load_file, path, FALSE, size, NULL) != EFI_BUFFER_TOO_SMALL)
+                return NULL;
+
+        buf = malloc(*size);
+        if (load_file->LoadFile(load_file, path, FALSE, size, buf) != EFI_SUCCESS) {
+                free(buf);
+                return NULL;
+        }
+
+        return buf;
+}
+
+/* stands in for the kernel handover, which would leave the simulation */
+EFI_STATUS linux_exec(EFI_HANDLE *image,
+                      CHAR8 *cmdline, UINTN cmdline_len,
+                      UINTN linux_addr,
+                      UINTN initrd_addr, UINTN initrd_size) {
+        const UINT8 *setup = (const UINT8 *)linux_addr;
+        UINT8 digest[SHA256_DIGEST_SIZE];
+        char sha256[SHA256_DIGEST_SIZE * 2 + 1];
+        Sha256 sha;
+        char *line;
+        char size[32];
+        UINT8 *loaded;
+        BOOLEAN valid;
+
+        (VOID)image;
+
+        loaded = initrd_load_file2(&initrd_size);
+        if (loaded)
+                initrd_addr = (UINTN)loaded;
+
+        /* the boot sector signature and the "HdrS" magic of the setup header */
+        valid = setup[0x1fe] == 0x55 && setup[0x1ff] == 0xaa && memcmp(setup + 0x202, "HdrS", 4) == 0;
+
+        line = strndup((const char *)cmdline, cmdline_len);
+        snprintf(size, sizeof(size), "%llu", (unsigned long long)initrd_size);
+
+        sha256_init(&sha);
+        sha256_update(&sha, (const VOID *)initrd_addr, initrd_size);
+        sha256_final(&sha, digest);
+        for (UINTN i = 0; i < SHA256_DIGEST_SIZE; i++)
+                sprintf(sha256 + i * 2, "%02x", digest[i]);
+
+        firmware_event("linux_exec", "cmdline", line, "initrd_size", size, "initrd_sha256", sha256,
+                       "initrd_source", loaded ? "loadfile2" : "boot_params",
+                       "setup", valid ? "valid" : "invalid", NULL);
+        free(line);
+        free(loaded);
+
+        firmware_exit(valid ? EFI_SUCCESS : EFI_LOAD_ERROR, "linux_exec");
+}
+
+/* stands in for the boot manager, which installs what it knows on the image before it starts it */
+static EFI_STATUS handoff_install(EFI_HANDLE image, const char *image_path, const char *flags) {
+        static const EFI_GUID handoff_guid = BOOT_HANDOFF_PROTOCOL_GUID;
+        static CHAR16 file_path[512];
+        static BootHandoff handoff;
+        EFI_LOADED_IMAGE *loaded_image;
+        EFI_FILE_HANDLE root;
+        EFI_FILE_HANDLE file;
+        UINTN i;
+        EFI_STATUS r;
+
+        if (flags && strcmp(flags, "addons") != 0)
+                return EFI_INVALID_PARAMETER;
+
+        for (i = 0; image_path[i] && i < sizeof(file_path) / sizeof(CHAR16) - 1; i++)
+                file_path[i] = image_path[i];
+        file_path[i] = '\0';
+
+        handoff = (BootHandoff){
+                .version = BOOT_HANDOFF_VERSION,
+                .size = sizeof(BootHandoff),
+                .flags = flags ? BOOT_HANDOFF_ADDONS : 0,
+                .file_path = file_path,
+                .boot_count = -1,
+        };
+
+        r = BS->HandleProtocol(image, &LoadedImageProtocol, (VOID **)&loaded_image);
+        if (r != EFI_SUCCESS)
+                return r;
+
+        if (disk_get_disk_uuid(loaded_image->DeviceHandle, handoff.disk_uuid) != EFI_SUCCESS)
+                handoff.disk_uuid[0] = '\0';
+
+        /* the boot manager reads the file for LoadImage() and hands it over as well */
+        root = LibOpenRoot(loaded_image->DeviceHandle);
+        if (root && root->Open(root, &file, file_path, EFI_FILE_MODE_READ, 0) == EFI_SUCCESS) {
+                EFI_FILE_INFO *info = LibFileInfo(file);
+
+                if (info) {
+                        UINTN size = info->FileSize;
+                        VOID *buffer = AllocatePool(size);
+
+                        if (file->Read(file, &size, buffer) == EFI_SUCCESS && size == info->FileSize) {
+                                handoff.file_buffer = buffer;
+                                handoff.file_size = size;
+                        } else
+                                FreePool(buffer);
+                        FreePool(info);
+                }
+                file->Close(file);
+        }
+        if (root)
+                root->Close(root);
+
+        return BS->InstallProtocolInterface(&image, (EFI_GUID *)&handoff_guid, EFI_NATIVE_INTERFACE, &handoff);
+}
+
+#define SIM_STUB_HELP \
+        "     --handoff[=addons] Start the image like the boot manager, with the add-ons flag\n"
+#else
+#define SIM_STUB_HELP ""
+#endif
+
+static VOID help(const char *name) {
+        printf("%s [OPTIONS...]\n\n"
+               "Run the EFI image on a simulated firmware.\n\n"
+               "  -h --help             Show this help\n"
+               "     --esp=DIR          Boot volume directory\n"
+               "     --volume=DIR       Additional volume directory\n"
+               "     --disk=FILE        Disk image with the GPT of the boot volume\n"
+               "     --image=PATH       Path of the running image on the boot volume\n"
+               "     --options=STRING   Load options of the running image\n"
+               "     --keys=KEYS        Key presses, e.g. \"down,down,enter\"\n"
+               "     --gop=WxH          Provide a graphics output of the given size\n"
+               "     --ppm=FILE         Write the final framebuffer as PPM\n"
+               "     --conout=FILE      Record the console frames to FILE\n"
+               "     --cost=CALL=COST   Charge CALL a fixed[/per-byte] cost, e.g. Read=1ms/5ns\n"
+               "     --var=NAME=INT     Set an integer EFI global variable\n"
+               SIM_STUB_HELP,
+               name);
+}
+
+static int variable_set(const char *spec) {
+        static const EFI_GUID global_guid = EFI_GLOBAL_VARIABLE;
+        CHAR16 name[128];
+        const char *value;
+        UINT8 data[8];
+        UINT64 v;
+        UINTN size, i;
+        char *end;
+
+        value = strchr(spec, '=');
+        if (!value || value == spec || (UINTN)(value - spec) >= sizeof(name) / sizeof(CHAR16))
+                return -1;
+
+        for (i = 0; spec + i < value; i++)
+                name[i] = spec[i];
+        name[i] = '\0';
+
+        v = strtoull(value + 1, &end, 0);
+        if (*end)
+                return -1;
+
+        /* booleans like SecureBoot are a single byte */
+        size = v <= 0xff ? 1 : 8;
+        for (i = 0; i < size; i++)
+                data[i] = v >> (8 * i);
+
+        if (RT->SetVariable(name, (EFI_GUID *)&global_guid,
+                            EFI_VARIABLE_BOOTSERVICE_ACCESS|EFI_VARIABLE_RUNTIME_ACCESS, size, data) != EFI_SUCCESS)
+                return -1;
+
+        return 0;
+}
+
+int main(int argc, char **argv) {
+        enum {
+                ARG_ESP = 0x100,
+                ARG_VOLUME,
+                ARG_DISK,
+                ARG_IMAGE,
+                ARG_OPTIONS,
+                ARG_KEYS,
+                ARG_GOP,
+                ARG_PPM,
+                ARG_CONOUT,
+                ARG_COST,
+                ARG_VAR,
+                ARG_HANDOFF,
+        };
+        static const struct option options[] = {
+                { "help",       no_argument,            NULL, 'h'               },
+                { "esp",        required_argument,      NULL, ARG_ESP           },
+                { "volume",     required_argument,      NULL, ARG_VOLUME        },
+                { "disk",       required_argument,      NULL, ARG_DISK          },
+                { "image",      required_argument,      NULL, ARG_IMAGE         },
+                { "options",    required_argument,      NULL, ARG_OPTIONS       },
+                { "keys",       required_argument,      NULL, ARG_KEYS          },
+                { "gop",        required_argument,      NULL, ARG_GOP           },
+                { "ppm",        required_argument,      NULL, ARG_PPM           },
+                { "conout",     required_argument,      NULL, ARG_CONOUT        },
+                { "cost",       required_argument,      NULL, ARG_COST          },
+                { "var",        required_argument,      NULL, ARG_VAR           },
+#ifdef SIM_STUB
+                { "handoff",    optional_argument,      NULL, ARG_HANDOFF       },
+#endif
+                {}
+        };
+        FirmwareConfig config = {
+                .esp = ".",
+                .image = "\\EFI\\BOOT\\BOOT" EFI_MACHINE_TYPE_NAME ".EFI",
+                .log = stdout,
+                .conout = stderr,
+        };
+        const char *volumes[SIM_VOLUMES_MAX];
+        const char *variables[SIM_VARIABLES_MAX];
+        UINTN n_variables = 0;
+        const char *ppm = NULL;
+        BOOLEAN handoff = FALSE;
+        const char *handoff_flags = NULL;
+        EFI_HANDLE image;
+        EFI_STATUS r;
+        int c;
+
+        config.volumes = volumes;
+
+        while ((c = getopt_long(argc, argv, "h", options, NULL)) >= 0) {
+                switch (c) {
+                case 'h':
+                        help(argv[0]);
+                        return EXIT_SUCCESS;
+
+                case ARG_ESP:
+                        config.esp = optarg;
+                        break;
+
+                case ARG_VOLUME:
+                        if (config.n_volumes == SIM_VOLUMES_MAX) {
+                                fprintf(stderr, "Too many volumes.\n");
+                                return EXIT_FAILURE;
+                        }
+                        volumes[config.n_volumes++] = optarg;
+                        break;
+
+                case ARG_DISK:
+                        config.disk = optarg;
+                        break;
+
+                case ARG_IMAGE:
+                        config.image = optarg;
+                        break;
+
+                case ARG_OPTIONS:
+                        config.options = optarg;
+                        break;
+
+                case ARG_KEYS:
+                        config.keys = optarg;
+                        break;
+
+                case ARG_GOP:
+                        if (sscanf(optarg, "%ux%u", &config.gop_x, &config.gop_y) != 2 ||
+                            config.gop_x == 0 || config.gop_y == 0) {
+                                fprintf(stderr, "Invalid display size: %s\n", optarg);
+                                return EXIT_FAILURE;
+                        }
+                        break;
+
+                case ARG_PPM:
+                        ppm = optarg;
+                        break;
+
+                case ARG_CONOUT:
+                        config.conout = fopen(optarg, "we");
+                        if (!config.conout) {
+                                fprintf(stderr, "Unable to open %s: %m\n", optarg);
+                                return EXIT_FAILURE;
+                        }
+                        break;
+
+                case ARG_COST:
+                        if (firmware_cost_parse(&config, optarg) != EFI_SUCCESS) {
+                                fprintf(stderr, "Invalid cost: %s\n", optarg);
+                                return EXIT_FAILURE;
+                        }
+                        break;
+
+                case ARG_VAR:
+                        if (n_variables == SIM_VARIABLES_MAX) {
+                                fprintf(stderr, "Too many variables.\n");
+                                return EXIT_FAILURE;
+                        }
+                        variables[n_variables++] = optarg;
+                        break;
+
+                case ARG_HANDOFF:
+                        handoff = TRUE;
+                        handoff_flags = optarg;
+                        break;
+
+                default:
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (optind < argc) {
+                fprintf(stderr, "Unexpected argument: %s\n", argv[optind]);
+                return EXIT_FAILURE;
+        }
+
+        r = firmware_init(&config, &image);
+        if (r != EFI_SUCCESS) {
+                fprintf(stderr, "Unable to set up the firmware: %d\n", (int)(r & 0xff));
+                return EXIT_FAILURE;
+        }
+
+        for (UINTN i = 0; i < n_variables; i++) {
+                if (variable_set(variables[i]) < 0) {
+                        fprintf(stderr, "Invalid variable: %s\n", variables[i]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+#ifdef SIM_STUB
+        if (handoff && handoff_install(image, config.image, handoff_flags) != EFI_SUCCESS) {
+                fprintf(stderr, "Invalid handoff: %s\n", handoff_flags);
+                return EXIT_FAILURE;
+        }
+#else
+        (VOID)handoff;
+        (VOID)handoff_flags;
+#endif
+
+        r = firmware_run(efi_main, image);
+        firmware_report();
+
+        if (ppm && firmware_ppm_write(ppm) != EFI_SUCCESS) {
+                fprintf(stderr, "Unable to write %s\n", ppm);
+                return EXIT_FAILURE;
+        }
+
+        return r == EFI_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}